@@ -2,258 +2,500 @@
 #ifndef AST_HPP
 #define AST_HPP
 
-#include <string>
-#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
 #include <memory>
+#include <memory_resource>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
 #include <utility>
+#include <vector>
+#include "token.h"
 
 namespace AST {
 
 class Visitor;
+class Arena;
+
+// A growable array whose storage lives in an Arena. It is trivially destructible, so a tree
+// of nodes holding lists is released with the arena without visiting any node.
+template <typename T>
+class NodeList {
+public:
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T* begin() { return items; }
+    T* end() { return items + count; }
+    const T* begin() const { return items; }
+    const T* end() const { return items + count; }
+    T& operator[](size_t index) { return items[index]; }
+    const T& operator[](size_t index) const { return items[index]; }
+    T& back() { return items[count - 1]; }
+    void push_back(Arena& arena, T value);
+    // Replaces removed items starting at first with the given values, in place when they fit.
+    void replace(Arena& arena, size_t first, size_t removed, const T* values, size_t valueCount);
+
+private:
+    T* items = nullptr;
+    uint32_t count = 0;
+    uint32_t capacity = 0;
+};
+
+// Owns every node, list and string of a tree. Nodes are never destroyed one by one; release()
+// or the arena's destructor frees the whole tree at once. The first block is kept across
+// release(), so an arena reused per statement does not go back to the heap each time.
+class Arena {
+public:
+    Arena();
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t alignment);
+    std::string_view copy(std::string_view text);
+    void release();
+
+    // Strings passed as std::string or character arrays are copied into the arena; a
+    // std::string_view is taken to already point at storage that outlives the tree.
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        static_assert(std::is_trivially_destructible<T>::value, "Arena nodes must be trivially destructible");
+        return new (allocate(sizeof(T), alignof(T))) T(keep(std::forward<Args>(args))...);
+    }
+
+    template <typename T>
+    NodeList<T> list(std::initializer_list<T> items) {
+        NodeList<T> result;
+        for (const auto& item : items) {
+            result.push_back(*this, item);
+        }
+        return result;
+    }
+
+private:
+    static constexpr size_t firstBlockSize = 64 * 1024;
+    std::unique_ptr<std::byte[]> firstBlock;
+    std::pmr::monotonic_buffer_resource resource;
+
+    template <typename Value>
+    decltype(auto) keep(Value&& value) {
+        using Plain = std::decay_t<Value>;
+        if constexpr (std::is_same<Plain, std::string>::value || std::is_same<Plain, const char*>::value ||
+                      std::is_same<Plain, char*>::value) {
+            return copy(value);
+        } else {
+            return std::forward<Value>(value);
+        }
+    }
+};
+
+template <typename T>
+void NodeList<T>::push_back(Arena& arena, T value) {
+    static_assert(std::is_trivially_copyable<T>::value, "NodeList elements are moved with a plain copy");
+    if (count == capacity) {
+        uint32_t grown = capacity == 0 ? 4 : capacity * 2;
+        T* storage = static_cast<T*>(arena.allocate(sizeof(T) * grown, alignof(T)));
+        std::copy(items, items + count, storage);
+        items = storage;
+        capacity = grown;
+    }
+    items[count++] = value;
+}
+
+template <typename T>
+void NodeList<T>::replace(Arena& arena, size_t first, size_t removed, const T* values, size_t valueCount) {
+    size_t tail = count - first - removed;
+    size_t replaced = count - removed + valueCount;
+    if (replaced > capacity) {
+        size_t grown = std::max<size_t>(replaced, capacity * 2);
+        T* storage = static_cast<T*>(arena.allocate(sizeof(T) * grown, alignof(T)));
+        std::copy(items, items + first, storage);
+        std::copy(items + first + removed, items + count, storage + first + valueCount);
+        items = storage;
+        capacity = static_cast<uint32_t>(grown);
+    } else if (valueCount != removed) {
+        std::memmove(items + first + valueCount, items + first + removed, tail * sizeof(T));
+    }
+    std::copy(values, values + valueCount, items + first);
+    count = static_cast<uint32_t>(replaced);
+}
+
+struct Field {
+    std::string_view first;
+    std::string_view second;
+};
+
+// An operand as written in the story. Its kind is known from the text; what a name refers to
+// is filled in once by the code generator's resolution pass, after all declarations are seen:
+// a variable, a record field path, or otherwise the normalized key of a story state.
+struct Operand {
+    enum class Kind : uint8_t { NAME, NUMBER, TEXT };
+    enum class Binding : uint8_t { UNRESOLVED, LITERAL, SYMBOL, FIELD, STORY_STATE };
+    std::string_view text;
+    Kind kind;
+    Binding binding = Binding::UNRESOLVED;
+    SymbolId name;
+    SymbolId key = noSymbol;
+    SymbolId symbol = noSymbol;
+    Operand(std::string_view text, Kind kind, SymbolId name = noSymbol) : text(text), kind(kind), name(name) {}
+    Operand(std::string_view text = std::string_view())
+        : Operand(text, isNumberLiteral(text) ? Kind::NUMBER : Kind::NAME) {}
+    Operand(const char* text) : Operand(std::string_view(text)) {}
+};
+
+struct FieldValue {
+    std::string_view first;
+    Operand second;
+};
+
+// One tag per concrete node type, in the order of the Visitor methods. Traversals can switch
+// on it instead of going through accept or dynamic_cast.
+enum class NodeKind : uint8_t {
+    NARRATIVE,
+    CONDITIONAL,
+    INTERACTIVE,
+    RANDOM,
+    WHILE,
+    FOR_EACH,
+    FOR_RANGE,
+    FUNCTION_DECLARATION,
+    FUNCTION_CALL,
+    RETURN,
+    COMMENT,
+    STORY,
+    VARIABLE_DECLARATION,
+    VARIABLE_DECLARATION_BLOCK,
+    ARITHMETIC,
+    RECORD_DECLARATION,
+    RECORD_INSTANCE,
+    IMAGE_DECLARATION,
+    PIXEL_WRITE,
+    IMAGE_FILL,
+    RECTANGLE_PAINT,
+    IMAGE_SAVE,
+    TELL,
+};
 
 class Node {
 public:
-    virtual ~Node() = default;
+    const NodeKind kind;
     virtual void accept(Visitor& visitor) = 0;
+protected:
+    explicit Node(NodeKind kind) : kind(kind) {}
+    ~Node() = default;
+};
+
+// A 128-bit hash of a statement's structure: its kind, the text of its fields and, in order,
+// the fingerprints of the statements below it. Two statements with the same fingerprint
+// generate the same code in the same story. A zero value means it has not been computed.
+struct Fingerprint {
+    uint64_t low = 0;
+    uint64_t high = 0;
+    bool empty() const { return low == 0 && high == 0; }
+    bool operator==(const Fingerprint& other) const { return low == other.low && high == other.high; }
+    bool operator!=(const Fingerprint& other) const { return !(*this == other); }
 };
 
 class Statement : public Node {
 public:
-    virtual ~Statement() = default;
+    // Filled in by AST::fingerprint. Code that changes a statement after parsing resets it,
+    // along with those of the statements it is nested in.
+    Fingerprint fingerprint;
+protected:
+    explicit Statement(NodeKind kind) : Node(kind) {}
+    ~Statement() = default;
 };
 
 class NarrativeStatement : public Statement {
 public:
-    std::string text;
-    NarrativeStatement(std::string text) : text(std::move(text)) {}
+    static constexpr NodeKind nodeKind = NodeKind::NARRATIVE;
+    std::string_view text;
+    NarrativeStatement(std::string_view text) : Statement(nodeKind), text(text) {}
     void accept(Visitor& visitor) override;
 };
 
+enum class ComparisonOperator : uint8_t { EQUAL, NOT_EQUAL, GREATER, LESS, AT_LEAST, AT_MOST };
+
+// A condition as the parser understood it: NEVER when there is nothing to test, FLAG for a
+// phrase without an operator, which is looked up as a story condition, and COMPARISON otherwise.
+struct Condition {
+    enum class Kind : uint8_t { NEVER, FLAG, COMPARISON };
+    Kind kind = Kind::NEVER;
+    ComparisonOperator op = ComparisonOperator::EQUAL;
+    Operand left;
+    Operand right;
+    Condition() = default;
+    explicit Condition(Operand flag) : kind(Kind::FLAG), left(flag) {}
+    Condition(Operand left, ComparisonOperator op, Operand right)
+        : kind(Kind::COMPARISON), op(op), left(left), right(right) {}
+};
+
 class ConditionalStatement : public Statement {
 public:
-    std::string condition;
-    std::vector<std::unique_ptr<Statement>> thenBranch;
-    std::vector<std::unique_ptr<Statement>> elseBranch;
-    explicit ConditionalStatement(const std::string &condition) : condition(condition) {}
+    static constexpr NodeKind nodeKind = NodeKind::CONDITIONAL;
+    std::string_view condition;
+    Condition test;
+    NodeList<Statement*> thenBranch;
+    NodeList<Statement*> elseBranch;
+    ConditionalStatement(std::string_view condition, const Condition& test) : Statement(nodeKind), condition(condition), test(test) {}
     void accept(Visitor& visitor) override;
 };
 
 class InteractiveStatement : public Statement {
 public:
-    std::string prompt;
-    explicit InteractiveStatement(const std::string &prompt) : prompt(prompt) {}
+    static constexpr NodeKind nodeKind = NodeKind::INTERACTIVE;
+    std::string_view prompt;
+    explicit InteractiveStatement(std::string_view prompt) : Statement(nodeKind), prompt(prompt) {}
     void accept(Visitor& visitor) override;
 };
 
 class RandomStatement : public Statement {
 public:
-    std::string subject;
-    std::pair<std::string, std::string> randomStates;
-    RandomStatement(const std::string &subject, const std::pair<std::string, std::string>& randomStates)
-        : subject(subject), randomStates(randomStates) {}
+    static constexpr NodeKind nodeKind = NodeKind::RANDOM;
+    std::string_view subject;
+    std::pair<std::string_view, std::string_view> randomStates;
+    RandomStatement(std::string_view subject, std::pair<std::string_view, std::string_view> randomStates)
+        : Statement(nodeKind), subject(subject), randomStates(randomStates) {}
     void accept(Visitor& visitor) override;
 };
 
 class WhileStatement : public Statement {
 public:
-    std::string condition;
-    std::vector<std::unique_ptr<Statement>> body;
-    explicit WhileStatement(std::string condition) : condition(std::move(condition)) {}
+    static constexpr NodeKind nodeKind = NodeKind::WHILE;
+    std::string_view condition;
+    Condition test;
+    NodeList<Statement*> body;
+    WhileStatement(std::string_view condition, const Condition& test) : Statement(nodeKind), condition(condition), test(test) {}
     void accept(Visitor& visitor) override;
 };
 
 class ForEachStatement : public Statement {
 public:
-    std::string iterator;
-    std::string collection;
-    std::vector<std::unique_ptr<Statement>> body;
-    ForEachStatement(std::string iterator, std::string collection)
-        : iterator(std::move(iterator)), collection(std::move(collection)) {}
+    static constexpr NodeKind nodeKind = NodeKind::FOR_EACH;
+    std::string_view iterator;
+    std::string_view collection;
+    NodeList<Statement*> body;
+    ForEachStatement(std::string_view iterator, std::string_view collection)
+        : Statement(nodeKind), iterator(iterator), collection(collection) {}
     void accept(Visitor& visitor) override;
 };
 
 class FunctionDeclaration : public Statement {
 public:
-    std::string name;
-    std::vector<std::unique_ptr<Statement>> body;
-    explicit FunctionDeclaration(std::string name) : name(std::move(name)) {}
+    static constexpr NodeKind nodeKind = NodeKind::FUNCTION_DECLARATION;
+    std::string_view name;
+    NodeList<Statement*> body;
+    explicit FunctionDeclaration(std::string_view name) : Statement(nodeKind), name(name) {}
     void accept(Visitor& visitor) override;
 };
 
 class FunctionCall : public Statement {
 public:
-    std::string name;
-    explicit FunctionCall(std::string name) : name(std::move(name)) {}
+    static constexpr NodeKind nodeKind = NodeKind::FUNCTION_CALL;
+    std::string_view name;
+    explicit FunctionCall(std::string_view name) : Statement(nodeKind), name(name) {}
     void accept(Visitor& visitor) override;
 };
 
 class ReturnStatement : public Statement {
 public:
+    static constexpr NodeKind nodeKind = NodeKind::RETURN;
+    ReturnStatement() : Statement(nodeKind) {}
     void accept(Visitor& visitor) override;
 };
 
 class CommentStatement : public Statement {
 public:
-    std::string comment;
-    explicit CommentStatement(std::string comment) : comment(std::move(comment)) {}
+    static constexpr NodeKind nodeKind = NodeKind::COMMENT;
+    std::string_view comment;
+    explicit CommentStatement(std::string_view comment) : Statement(nodeKind), comment(comment) {}
     void accept(Visitor& visitor) override;
 };
 
 class VariableDeclaration : public Statement {
 public:
-    std::string owner;
-    std::string varName;
-    std::string value;
-    std::vector<std::string> values;
-    VariableDeclaration(std::string owner, std::string varName, std::string value)
-      : owner(std::move(owner)), varName(std::move(varName)), value(std::move(value)) {}
-    VariableDeclaration(std::string owner, std::string varName, std::vector<std::string> values)
-      : owner(std::move(owner)), varName(std::move(varName)), values(std::move(values)) {}
+    static constexpr NodeKind nodeKind = NodeKind::VARIABLE_DECLARATION;
+    std::string_view owner;
+    std::string_view varName;
+    std::string_view value;
+    NodeList<std::string_view> values;
+    // The C++ id declared, filled in by the code generator's resolution pass like an operand's.
+    SymbolId symbol = noSymbol;
+    VariableDeclaration(std::string_view owner, std::string_view varName, std::string_view value)
+      : Statement(nodeKind), owner(owner), varName(varName), value(value) {}
+    VariableDeclaration(std::string_view owner, std::string_view varName, NodeList<std::string_view> values)
+      : Statement(nodeKind), owner(owner), varName(varName), values(values) {}
     bool isCollection() const { return !values.empty(); }
     void accept(Visitor& visitor) override;
 };
 
 class ForRangeStatement : public Statement {
 public:
-    std::string iterator;
-    std::string start;
-    std::string end;
-    std::vector<std::unique_ptr<Statement>> body;
-    ForRangeStatement(std::string iterator, std::string start, std::string end)
-        : iterator(std::move(iterator)),
-          start(std::move(start)),
-          end(std::move(end)) {}
+    static constexpr NodeKind nodeKind = NodeKind::FOR_RANGE;
+    std::string_view iterator;
+    std::string_view start;
+    std::string_view end;
+    NodeList<Statement*> body;
+    SymbolId symbol = noSymbol;
+    ForRangeStatement(std::string_view iterator, std::string_view start, std::string_view end)
+        : Statement(nodeKind), iterator(iterator),
+          start(start),
+          end(end) {}
     void accept(Visitor& visitor) override;
 };
 
 class VariableDeclarationBlock : public Statement {
 public:
-    std::vector<std::unique_ptr<VariableDeclaration>> declarations;
+    static constexpr NodeKind nodeKind = NodeKind::VARIABLE_DECLARATION_BLOCK;
+    NodeList<VariableDeclaration*> declarations;
+    VariableDeclarationBlock() : Statement(nodeKind) {}
     void accept(Visitor& visitor) override;
 };
 
 class ArithmeticStatement : public Statement {
 public:
-    std::string left;
-    std::string operation;
-    std::string right;
-    std::string target;
-    ArithmeticStatement(std::string left, std::string operation, std::string right, std::string target)
-        : left(std::move(left)),
-          operation(std::move(operation)),
-          right(std::move(right)),
-          target(std::move(target)) {}
+    static constexpr NodeKind nodeKind = NodeKind::ARITHMETIC;
+    Operand left;
+    std::string_view operation;
+    Operand right;
+    Operand target;
+    ArithmeticStatement(Operand left, std::string_view operation, Operand right, Operand target)
+        : Statement(nodeKind), left(left),
+          operation(operation),
+          right(right),
+          target(target) {}
     void accept(Visitor& visitor) override;
 };
 
 class RecordDeclaration : public Statement {
 public:
-    std::string name;
-    std::vector<std::pair<std::string, std::string>> fields;
-    RecordDeclaration(std::string name, std::vector<std::pair<std::string, std::string>> fields)
-        : name(std::move(name)), fields(std::move(fields)) {}
+    static constexpr NodeKind nodeKind = NodeKind::RECORD_DECLARATION;
+    std::string_view name;
+    NodeList<Field> fields;
+    RecordDeclaration(std::string_view name, NodeList<Field> fields)
+        : Statement(nodeKind), name(name), fields(fields) {}
     void accept(Visitor& visitor) override;
 };
 
 class RecordInstanceDeclaration : public Statement {
 public:
-    std::string name;
-    std::string typeName;
-    std::vector<std::pair<std::string, std::string>> fieldValues;
-    RecordInstanceDeclaration(std::string name, std::string typeName,
-                              std::vector<std::pair<std::string, std::string>> fieldValues)
-        : name(std::move(name)),
-          typeName(std::move(typeName)),
-          fieldValues(std::move(fieldValues)) {}
+    static constexpr NodeKind nodeKind = NodeKind::RECORD_INSTANCE;
+    std::string_view name;
+    std::string_view typeName;
+    NodeList<FieldValue> fieldValues;
+    SymbolId symbol = noSymbol;
+    RecordInstanceDeclaration(std::string_view name, std::string_view typeName,
+                              NodeList<FieldValue> fieldValues)
+        : Statement(nodeKind), name(name),
+          typeName(typeName),
+          fieldValues(fieldValues) {}
     void accept(Visitor& visitor) override;
 };
 
 class ImageDeclaration : public Statement {
 public:
-    std::string name;
-    std::string width;
-    std::string height;
-    ImageDeclaration(std::string name, std::string width, std::string height)
-        : name(std::move(name)), width(std::move(width)), height(std::move(height)) {}
+    static constexpr NodeKind nodeKind = NodeKind::IMAGE_DECLARATION;
+    std::string_view name;
+    Operand width;
+    Operand height;
+    ImageDeclaration(std::string_view name, Operand width, Operand height)
+        : Statement(nodeKind), name(name), width(width), height(height) {}
     void accept(Visitor& visitor) override;
 };
 
 class PixelWriteStatement : public Statement {
 public:
-    std::string imageName;
-    std::string x;
-    std::string y;
-    std::string red;
-    std::string green;
-    std::string blue;
-    PixelWriteStatement(std::string imageName, std::string x, std::string y,
-                        std::string red, std::string green, std::string blue)
-        : imageName(std::move(imageName)),
-          x(std::move(x)),
-          y(std::move(y)),
-                        red(std::move(red)),
-                        green(std::move(green)),
-                        blue(std::move(blue)) {}
+    static constexpr NodeKind nodeKind = NodeKind::PIXEL_WRITE;
+    std::string_view imageName;
+    Operand x;
+    Operand y;
+    Operand red;
+    Operand green;
+    Operand blue;
+    PixelWriteStatement(std::string_view imageName, Operand x, Operand y,
+                        Operand red, Operand green, Operand blue)
+        : Statement(nodeKind), imageName(imageName),
+          x(x),
+          y(y),
+                        red(red),
+                        green(green),
+                        blue(blue) {}
     void accept(Visitor& visitor) override;
 };
 
 class ImageFillStatement : public Statement {
 public:
-    std::string imageName;
-    std::string red;
-    std::string green;
-    std::string blue;
-    ImageFillStatement(std::string imageName, std::string red, std::string green, std::string blue)
-        : imageName(std::move(imageName)),
-          red(std::move(red)),
-          green(std::move(green)),
-          blue(std::move(blue)) {}
+    static constexpr NodeKind nodeKind = NodeKind::IMAGE_FILL;
+    std::string_view imageName;
+    Operand red;
+    Operand green;
+    Operand blue;
+    ImageFillStatement(std::string_view imageName, Operand red, Operand green, Operand blue)
+        : Statement(nodeKind), imageName(imageName),
+          red(red),
+          green(green),
+          blue(blue) {}
     void accept(Visitor& visitor) override;
 };
 
 class RectanglePaintStatement : public Statement {
 public:
-    std::string imageName;
-    std::string left;
-    std::string bottom;
-    std::string right;
-    std::string top;
-    std::string red;
-    std::string green;
-    std::string blue;
-    RectanglePaintStatement(std::string imageName, std::string left, std::string bottom,
-                            std::string right, std::string top,
-                            std::string red, std::string green, std::string blue)
-        : imageName(std::move(imageName)),
-          left(std::move(left)),
-          bottom(std::move(bottom)),
-          right(std::move(right)),
-          top(std::move(top)),
-          red(std::move(red)),
-          green(std::move(green)),
-          blue(std::move(blue)) {}
+    static constexpr NodeKind nodeKind = NodeKind::RECTANGLE_PAINT;
+    std::string_view imageName;
+    Operand left;
+    Operand bottom;
+    Operand right;
+    Operand top;
+    Operand red;
+    Operand green;
+    Operand blue;
+    RectanglePaintStatement(std::string_view imageName, Operand left, Operand bottom,
+                            Operand right, Operand top,
+                            Operand red, Operand green, Operand blue)
+        : Statement(nodeKind), imageName(imageName),
+          left(left),
+          bottom(bottom),
+          right(right),
+          top(top),
+          red(red),
+          green(green),
+          blue(blue) {}
     void accept(Visitor& visitor) override;
 };
 
 class ImageSaveStatement : public Statement {
 public:
-    std::string imageName;
-    std::string outputPath;
-    ImageSaveStatement(std::string imageName, std::string outputPath)
-        : imageName(std::move(imageName)), outputPath(std::move(outputPath)) {}
+    static constexpr NodeKind nodeKind = NodeKind::IMAGE_SAVE;
+    std::string_view imageName;
+    std::string_view outputPath;
+    ImageSaveStatement(std::string_view imageName, std::string_view outputPath)
+        : Statement(nodeKind), imageName(imageName), outputPath(outputPath) {}
     void accept(Visitor& visitor) override;
 };
 
+// The root of a parsed tree. Unlike the other nodes it is heap allocated, and it owns the
+// arena every statement below it lives in. backing keeps alive storage the tree's strings
+// point into when it is not the script itself, such as a mapped cache file.
 class Story : public Node {
 public:
-    std::vector<std::unique_ptr<Statement>> statements;
+    static constexpr NodeKind nodeKind = NodeKind::STORY;
+    std::shared_ptr<const void> backing;
+    Arena arena;
+    StringInterner names;
+    NodeList<Statement*> statements;
+    Story() : Node(nodeKind) {}
     void accept(Visitor& visitor) override;
 };
 
 class TellStatement : public Statement {
 public:
-    std::string message;
-    explicit TellStatement(std::string message) : message(std::move(message)) {}
+    static constexpr NodeKind nodeKind = NodeKind::TELL;
+    std::string_view message;
+    explicit TellStatement(std::string_view message) : Statement(nodeKind), message(message) {}
     void accept(Visitor& visitor) override;
 };
 
@@ -285,6 +527,120 @@ public:
     virtual void visit(TellStatement& node) = 0;
 };
 
+// Returns the node as a T when its kind says it is one, or nullptr otherwise.
+template <typename T>
+T* as(Node* node) {
+    return node && node->kind == T::nodeKind ? static_cast<T*>(node) : nullptr;
+}
+
+// Calls visitor.visit with the node's concrete type. The visitor only needs a visit overload
+// for every node type; it does not have to derive from Visitor, and a final visitor has every
+// call resolved statically, so a traversal built on this has no virtual calls left.
+template <typename V>
+decltype(auto) dispatch(Node& node, V&& visitor) {
+    switch (node.kind) {
+    case NodeKind::NARRATIVE: return visitor.visit(static_cast<NarrativeStatement&>(node));
+    case NodeKind::CONDITIONAL: return visitor.visit(static_cast<ConditionalStatement&>(node));
+    case NodeKind::INTERACTIVE: return visitor.visit(static_cast<InteractiveStatement&>(node));
+    case NodeKind::RANDOM: return visitor.visit(static_cast<RandomStatement&>(node));
+    case NodeKind::WHILE: return visitor.visit(static_cast<WhileStatement&>(node));
+    case NodeKind::FOR_EACH: return visitor.visit(static_cast<ForEachStatement&>(node));
+    case NodeKind::FOR_RANGE: return visitor.visit(static_cast<ForRangeStatement&>(node));
+    case NodeKind::FUNCTION_DECLARATION: return visitor.visit(static_cast<FunctionDeclaration&>(node));
+    case NodeKind::FUNCTION_CALL: return visitor.visit(static_cast<FunctionCall&>(node));
+    case NodeKind::RETURN: return visitor.visit(static_cast<ReturnStatement&>(node));
+    case NodeKind::COMMENT: return visitor.visit(static_cast<CommentStatement&>(node));
+    case NodeKind::STORY: return visitor.visit(static_cast<Story&>(node));
+    case NodeKind::VARIABLE_DECLARATION: return visitor.visit(static_cast<VariableDeclaration&>(node));
+    case NodeKind::VARIABLE_DECLARATION_BLOCK: return visitor.visit(static_cast<VariableDeclarationBlock&>(node));
+    case NodeKind::ARITHMETIC: return visitor.visit(static_cast<ArithmeticStatement&>(node));
+    case NodeKind::RECORD_DECLARATION: return visitor.visit(static_cast<RecordDeclaration&>(node));
+    case NodeKind::RECORD_INSTANCE: return visitor.visit(static_cast<RecordInstanceDeclaration&>(node));
+    case NodeKind::IMAGE_DECLARATION: return visitor.visit(static_cast<ImageDeclaration&>(node));
+    case NodeKind::PIXEL_WRITE: return visitor.visit(static_cast<PixelWriteStatement&>(node));
+    case NodeKind::IMAGE_FILL: return visitor.visit(static_cast<ImageFillStatement&>(node));
+    case NodeKind::RECTANGLE_PAINT: return visitor.visit(static_cast<RectanglePaintStatement&>(node));
+    case NodeKind::IMAGE_SAVE: return visitor.visit(static_cast<ImageSaveStatement&>(node));
+    case NodeKind::TELL: return visitor.visit(static_cast<TellStatement&>(node));
+    }
+    throw std::runtime_error("Unknown node kind");
+}
+
+template <typename V>
+void visitAll(NodeList<Statement*>& statements, V&& visitor) {
+    for (Statement* statement : statements) {
+        dispatch(*statement, visitor);
+    }
+}
+
+// Calls f on each direct child of the node, in source order.
+template <typename F>
+void forEachChild(Node& node, F&& f) {
+    switch (node.kind) {
+    case NodeKind::CONDITIONAL: {
+        auto& conditional = static_cast<ConditionalStatement&>(node);
+        for (Statement* statement : conditional.thenBranch) f(*statement);
+        for (Statement* statement : conditional.elseBranch) f(*statement);
+        break;
+    }
+    case NodeKind::WHILE:
+        for (Statement* statement : static_cast<WhileStatement&>(node).body) f(*statement);
+        break;
+    case NodeKind::FOR_EACH:
+        for (Statement* statement : static_cast<ForEachStatement&>(node).body) f(*statement);
+        break;
+    case NodeKind::FOR_RANGE:
+        for (Statement* statement : static_cast<ForRangeStatement&>(node).body) f(*statement);
+        break;
+    case NodeKind::FUNCTION_DECLARATION:
+        for (Statement* statement : static_cast<FunctionDeclaration&>(node).body) f(*statement);
+        break;
+    case NodeKind::STORY:
+        for (Statement* statement : static_cast<Story&>(node).statements) f(*statement);
+        break;
+    case NodeKind::VARIABLE_DECLARATION_BLOCK:
+        for (VariableDeclaration* declaration : static_cast<VariableDeclarationBlock&>(node).declarations) f(*declaration);
+        break;
+    default:
+        break;
+    }
+}
+
+// Calls f on the node and then on everything below it, in pre-order. When f returns a bool,
+// false skips the children of that node. Pending nodes are kept on a heap stack, so the
+// depth of the tree does not matter, and a walk over a node without children allocates nothing.
+template <typename F>
+void walk(Node& root, F&& f) {
+    std::vector<Node*> pending;
+    Node* node = &root;
+    for (;;) {
+        bool descend = true;
+        if constexpr (std::is_same_v<std::invoke_result_t<F&, Node&>, bool>) {
+            descend = f(*node);
+        } else {
+            f(*node);
+        }
+        if (descend) {
+            size_t first = pending.size();
+            forEachChild(*node, [&pending](Node& child) { pending.push_back(&child); });
+            std::reverse(pending.begin() + first, pending.end());
+        }
+        if (pending.empty()) {
+            return;
+        }
+        node = pending.back();
+        pending.pop_back();
+    }
+}
+
+// Returns the statement's fingerprint, computing it bottom-up for the statements below it
+// that do not have one cached yet. Nodes kept across an incremental edit keep theirs, so only
+// new statements are hashed again.
+Fingerprint fingerprint(Statement& statement);
+Fingerprint fingerprint(Story& story);
+// The same 128-bit hash over a text, such as the script a story was parsed from.
+Fingerprint fingerprint(std::string_view text);
+
 }
 
 #endif
@@ -3,16 +3,37 @@
 #define CODE_GENERATOR_HPP
 
 #include "ast.h"
+#include "code_output.h"
+#include "program_info.h"
+#include "string_interner.h"
 #include <map>
-#include <sstream>
+#include <ostream>
 #include <set>
 #include <string>
+#include <string_view>
+#include <unordered_set>
 #include <vector>
 
-class CodeGeneratorVisitor : public AST::Visitor {
+class CodeGeneratorVisitor final : public AST::Visitor {
 public:
     CodeGeneratorVisitor();
     std::string getGeneratedCode() const;
+    std::string takeGeneratedCode();
+
+    // Sends the generated code to output as it is produced instead of keeping it; call
+    // flushOutput once generation is done. getGeneratedCode then only holds what is pending.
+    void setOutput(std::ostream* output);
+    void flushOutput();
+
+    // Story generation in phases, so a driver can stream top-level statements instead of
+    // holding a whole AST::Story. Call beginStory with the interner the statements were parsed
+    // with, feed every statement to a ProgramAnalyzer, pass its ProgramInfo to beginStoryMain,
+    // emit each statement, and finish with endStory.
+    void beginStory(StringInterner& names);
+    void beginStoryMain(const ProgramInfo& program);
+    void emitStoryStatement(AST::Statement& statement);
+    void endStory();
+
     void visit(AST::NarrativeStatement& node) override;
     void visit(AST::ConditionalStatement& node) override;
     void visit(AST::InteractiveStatement& node) override;
@@ -41,50 +62,143 @@ private:
         std::string sourceName;
         std::string cppName;
         std::string typeName;
+        SymbolId sourceKey;
+        SymbolId cppKey;
+    };
+
+    struct RecordType {
+        bool declared = false;
+        std::vector<RecordField> fields;
+    };
+
+    enum class SymbolKind : uint8_t { NONE, STRING, BOOL, NUMBER, COLLECTION, RECORD };
+
+    // A numeric variable or field of the story main: its C++ type, and its value while that is
+    // known at the point being emitted.
+    struct KnownNumber {
+        enum class Type : char { UNKNOWN, INTEGER, NUMBER };
+        Type type = Type::UNKNOWN;
+        bool known = false;
+        double value = 0;
+    };
+
+    // What a loop assigns, by C++ id, and which story states it may write. Filled on first use.
+    struct LoopSummary {
+        bool summarized = false;
+        std::map<SymbolId, int> assignments;
+        std::set<SymbolId> storyWrites;
+        bool callsFunctions = false;
     };
 
-    std::ostringstream oss;
+    CodeOutput out;
     int indentLevel;
+    mutable std::string indentation;
     std::set<std::string> collectionsUsed;
     std::set<std::string> declaredCollections;
-    std::map<std::string, std::string> symbols;
-    std::map<std::string, std::string> symbolKinds;
-    std::map<std::string, std::vector<RecordField>> recordTypes;
-    std::map<std::string, std::string> recordTypeAliases;
-    std::set<std::string> initializedSymbols;
+    StringInterner ownedNames;
+    StringInterner* names;
+    mutable std::vector<SymbolId> normalizedNames;
+    std::vector<SymbolId> symbols;
+    std::vector<SymbolKind> symbolKinds;
+    std::vector<RecordType> recordTypes;
+    std::vector<SymbolId> recordTypeAliases;
+    std::vector<char> initializedSymbols;
+    std::vector<char> readStoryKeys;
+    std::vector<KnownNumber> numbers;
     bool skipFunctionDeclarations;
     bool skipRecordDeclarations;
     bool imageRuntimeRequired;
+    bool storyReadsKnown;
+    bool foldingConstants;
     int tempCounter;
-    std::string indent() const;
+
+    struct OpenBlock {
+        AST::Statement* statement;
+        AST::Statement** next;
+        AST::Statement** end;
+        bool elseBranch;
+        bool previousSkip;
+    };
+    std::vector<OpenBlock> openBlocks;
+    std::set<const AST::Statement*> hoistedStatements;
+
+    // Top-level declarations of literal values, which reads are folded into. Each is written
+    // just before the first story statement that names it, and dropped if none does.
+    struct DeferredDeclaration {
+        std::string_view id;
+        std::string code;
+    };
+    std::vector<DeferredDeclaration> deferredDeclarations;
+    std::unordered_set<std::string_view> deferredIds;
+    CodeOutput statementOutput;
+    void deferDeclaration(SymbolId id, std::string code);
+    void writeDeferredDeclarations(std::string_view code);
+    void emitRecordInstance(AST::RecordInstanceDeclaration& node, SymbolId id, SymbolId typeId);
+    bool emittingBlocks;
+    void openBlock(AST::Statement& statement, AST::NodeList<AST::Statement*>& body, bool previousSkip = false);
+    void closeBlock();
+    std::string_view indent() const;
     void generateRandomizer();
-    void generateStoryStateHelpers();
+    void generateStoryStateHelpers(const std::set<std::string_view>& keys);
     void generateImageRuntime();
-    std::string sanitizeIdentifier(const std::string &s) const;
-    std::string sanitizeTypeName(const std::string& s) const;
-    std::string escapeString(const std::string& s) const;
-    std::string normalizeName(const std::string& s) const;
+    std::string sanitizeIdentifier(std::string_view s) const;
+    std::string sanitizeTypeName(std::string_view s) const;
+    std::string escapeString(std::string_view s) const;
+    std::string normalizeName(std::string_view s) const;
+    SymbolId normalizedId(std::string_view s) const;
+    SymbolId normalizedId(SymbolId raw) const;
+    SymbolId resolveId(std::string_view name) const;
+    void bindSymbol(SymbolId key, SymbolId id, SymbolKind kind);
+    bool isInitialized(SymbolId id) const;
+    void markInitialized(SymbolId id);
+    bool isStoryKeyRead(SymbolId key) const;
+    const RecordType* recordTypeFor(SymbolId typeId) const;
     std::string variableNameFor(const AST::VariableDeclaration& node) const;
+    std::string variableNameFor(std::string_view owner, std::string_view varName, bool collection) const;
     std::string variableNameFor(const AST::RecordInstanceDeclaration& node) const;
-    std::string resolveName(const std::string& name) const;
-    std::string translateCondition(const std::string& condition) const;
-    std::string numericExpression(const std::string& value) const;
-    std::string typedExpression(const std::string& value, const std::string& typeName) const;
-    std::string cppTypeFor(const std::string& typeName) const;
-    std::string cppDefaultValueFor(const std::string& typeName) const;
-    std::string kindForType(const std::string& typeName) const;
-    std::string fieldTypeFor(const std::string& recordType, const std::string& fieldName) const;
-    void registerDeclaration(const AST::VariableDeclaration& node);
-    void registerArithmeticTarget(const AST::ArithmeticStatement& node);
+    SymbolId declaredId(const AST::VariableDeclaration& node) const;
+    SymbolId declaredId(const AST::RecordInstanceDeclaration& node) const;
+    SymbolId declaredId(const AST::ForRangeStatement& node) const;
+    SymbolId assignedId(const AST::Operand& target) const;
+    std::string resolveName(std::string_view name) const;
+    AST::Operand resolved(const AST::Operand& operand) const;
+    AST::Operand bound(const AST::Operand& operand) const;
+    void resolve(AST::Operand& operand) const;
+    void resolve(AST::Condition& condition) const;
+    SymbolId storyKey(const AST::Operand& operand) const;
+    std::string storySlot(SymbolId key) const;
+    static std::string storySlotName(std::string_view key);
+    std::string translateCondition(const AST::Condition& condition) const;
+    bool knownValue(const AST::Operand& value, KnownNumber& number) const;
+    void setNumberType(SymbolId id, KnownNumber::Type type);
+    void assignNumber(SymbolId id, const KnownNumber* value);
+    void forgetAssignments(AST::Statement& statement);
+    static bool parseNumber(std::string_view text, KnownNumber& number);
+    static bool foldArithmetic(char op, const KnownNumber& left, const KnownNumber& right, KnownNumber& result);
+    static std::string numberLiteral(const KnownNumber& number);
+    void summarizeLoop(AST::Statement& loop, LoopSummary& summary) const;
+    void addOperandReads(AST::Node& node, std::set<SymbolId>& reads) const;
+    bool isLoopInvariant(const AST::Operand& value, const LoopSummary& summary,
+                         const std::set<SymbolId>& hoistedTargets) const;
+    bool mayBeInteger(const AST::Operand& value) const;
+    void hoistInvariants(AST::Statement& loop, AST::NodeList<AST::Statement*>& body, LoopSummary& summary);
+    void emitArithmetic(AST::ArithmeticStatement& node);
+    std::string numericExpression(std::string_view value) const;
+    std::string numericExpression(const AST::Operand& value) const;
+    std::string typedExpression(const AST::Operand& value, const std::string& typeName) const;
+    std::string cppTypeFor(std::string_view typeName) const;
+    std::string cppDefaultValueFor(std::string_view typeName) const;
+    SymbolKind kindForType(std::string_view typeName) const;
+    std::string fieldTypeFor(SymbolId recordType, std::string_view fieldName) const;
+    void registerDeclaration(const ProgramInfo& program, const ProgramInfo::Declaration& declaration);
+    void registerVariable(std::string_view owner, std::string_view varName, bool collection, bool numeric);
+    void registerArithmeticTarget(std::string_view target);
     void registerRecordType(const AST::RecordDeclaration& node);
-    void registerRecordInstance(const AST::RecordInstanceDeclaration& node);
+    void registerRecordInstance(std::string_view name, std::string_view typeName);
     void registerRecordFieldSymbols(const std::string& sourcePrefix, const std::string& cppPrefix,
-                                    const std::string& recordType, int depth);
-    void collectDeclarations(AST::Node* node);
-    void collectCollections(AST::Node* node);
-    void collectRecords(AST::Node* node, std::vector<AST::RecordDeclaration*>& records);
-    void collectFunctions(AST::Node* node, std::vector<AST::FunctionDeclaration*>& functions);
-    void collectImageUsage(AST::Node* node);
+                                    SymbolId recordType, int depth);
+    void resolveOperands(AST::Node* root) const;
+    bool resolveOwnOperands(AST::Node* node) const;
 };
 
 #endif
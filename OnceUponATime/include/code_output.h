@@ -0,0 +1,59 @@
+// code_output.hpp
+#ifndef CODE_OUTPUT_HPP
+#define CODE_OUTPUT_HPP
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Where generated code goes. Text is appended to fixed-size chunks, so the output is never
+// moved once written. Without a target the chunks are kept until the code is taken; with one,
+// every full chunk is written to it and its storage is reused for the next.
+class CodeOutput {
+public:
+    static constexpr size_t defaultChunkSize = 64 * 1024;
+
+    explicit CodeOutput(size_t chunkSize = defaultChunkSize);
+
+    // Writes what is buffered to the previous target before switching; without a previous
+    // target it is kept for the new one.
+    void setTarget(std::ostream* output);
+    void flush();
+
+    CodeOutput& operator<<(std::string_view text);
+    CodeOutput& operator<<(const std::string& text) { return *this << std::string_view(text); }
+    CodeOutput& operator<<(const char* text) { return *this << std::string_view(text); }
+    CodeOutput& operator<<(char c);
+
+    template <typename T, typename = std::enable_if_t<std::is_integral<T>::value && !std::is_same<T, char>::value>>
+    CodeOutput& operator<<(T value) {
+        if constexpr (std::is_same<T, bool>::value) {
+            return *this << (value ? "1" : "0");
+        } else if constexpr (std::is_signed<T>::value) {
+            return appendInteger(static_cast<long long>(value));
+        } else {
+            return appendInteger(static_cast<unsigned long long>(value));
+        }
+    }
+
+    // The text appended since the output was created or last taken, not counting what was
+    // already written to a target.
+    size_t size() const;
+    std::string str() const;
+    std::string take();
+    void writeTo(std::ostream& output) const;
+
+private:
+    size_t chunkSize;
+    std::vector<std::string> chunks;
+    std::ostream* target;
+
+    std::string& current();
+    CodeOutput& appendInteger(long long value);
+    CodeOutput& appendInteger(unsigned long long value);
+};
+
+#endif
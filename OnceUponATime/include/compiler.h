@@ -0,0 +1,17 @@
+// compiler.hpp
+#ifndef COMPILER_HPP
+#define COMPILER_HPP
+
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include "ast.h"
+
+std::unique_ptr<AST::Story> parseStory(std::string_view source);
+std::string compileStory(AST::Story& story);
+void compileStory(AST::Story& story, std::ostream& output);
+std::string compileStory(std::string_view source);
+void compileStoryStreaming(std::string_view source, std::ostream& output);
+
+#endif
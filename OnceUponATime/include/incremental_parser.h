@@ -0,0 +1,54 @@
+// incremental_parser.hpp
+#ifndef INCREMENTAL_PARSER_HPP
+#define INCREMENTAL_PARSER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "ast.h"
+
+// Keeps a story parsed while its text is edited. The text is held as the prologue, one
+// sentence per top-level statement (with the blank lines and comments before it) and the
+// epilogue. An edit re-lexes and re-parses only the sentences it touches, extended up to the
+// next sentence boundary where the blocks it opens are closed again, and splices the new
+// statements into story().statements. A re-parsed sentence whose text did not change keeps
+// its node. Old nodes stay in the story arena until enough of them pile up that a full
+// parse is cheaper to keep around; that replaces story() with a new tree.
+class IncrementalParser {
+public:
+    // statements[first, first + removed) were replaced by statements[first, first + inserted).
+    struct EditResult {
+        size_t first = 0;
+        size_t removed = 0;
+        size_t inserted = 0;
+        size_t reused = 0;
+        size_t reparsedBytes = 0;
+    };
+
+    explicit IncrementalParser(std::string_view source);
+
+    // Replaces removedLength characters at offset with insertedText. Throws if the edited text
+    // does not parse, in which case the story and its text are left as they were.
+    EditResult edit(size_t offset, size_t removedLength, std::string_view insertedText);
+
+    AST::Story& story();
+    std::string text() const;
+    size_t size() const;
+
+private:
+    std::unique_ptr<AST::Story> parsed;
+    std::string_view prologue;
+    std::vector<std::string_view> sentences;
+    std::vector<uint64_t> hashes;
+    std::vector<size_t> ends;
+    std::string_view epilogue;
+    size_t discardedBytes;
+
+    EditResult rebuild(std::string_view source);
+    void appendText(std::string& output, size_t from, size_t to) const;
+};
+
+#endif
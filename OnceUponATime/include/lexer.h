@@ -3,32 +3,44 @@
 #ifndef LEXER_HPP
 #define LEXER_HPP
 
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <unordered_map>
 #include "token.h"
+#include "string_interner.h"
+#include "token_stream.h"
 
 class Lexer {
 public:
-    explicit Lexer(const std::string& source);
+    explicit Lexer(std::string_view source);
     std::vector<Token> tokenize();
+    TokenStream tokenizeStream();
+    TokenStream tokenizeParallel(size_t chunkSize = 1 << 20);
+    Token next();
+    std::string_view input() const;
+    // The interner holding the word ids of the tokens read so far.
+    const StringInterner& interner() const;
 
 private:
-    std::string source;
+    Lexer(std::string_view source, int line, int column, StringInterner& words);
+
+    std::string_view source;
     size_t pos;
     int line;
     int column;
-    static const std::unordered_map<std::string, TokenType> keywordMap; 
+    std::unique_ptr<StringInterner> ownedWords;
+    StringInterner* words;
 
     bool isAtEnd() const;
     char peek() const;
     char advance();
     void skipWhitespace();
-    Token makeToken(TokenType type, const std::string& lexeme, int tokenStartColumn);
+    Token makeToken(TokenType type, std::string_view lexeme, int tokenStartColumn);
     Token readWord();
     Token readNumber();
     Token readString();
-    std::string peekAhead() const;
+    std::string_view peekAhead() const;
 };
 
 #endif // LEXER_HPP
\ No newline at end of file
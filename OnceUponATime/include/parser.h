@@ -6,49 +6,83 @@
 #include <string>
 #include <memory>
 #include "token.h"
+#include "token_stream.h"
 #include "ast.h"
 
+class Lexer;
+
 class Parser {
 public:
+    // Identifies the trees the parser builds. Bump it with any change that makes it build a
+    // different tree for some script, so story caches written by older builds are not reused.
+    static constexpr uint32_t outputVersion = 1;
+
     explicit Parser(const std::vector<Token>& tokens);
+    explicit Parser(const TokenStream& tokens);
+    explicit Parser(Lexer& lexer);
     std::unique_ptr<AST::Story> parseStory();
+    void beginStory();
+    // Parses the next top-level statement into arena, interning its names into names.
+    AST::Statement* nextStatement(AST::Arena& arena, StringInterner& names);
+    // Whether the next statement starts a record or function declaration.
+    bool atDeclaration() const;
+    // Just past the last character consumed so far, for drivers that map statements back to
+    // the source they were parsed from.
+    const char* consumedEnd() const;
 private:
-    const std::vector<Token>& tokens;
+    mutable TokenStream ownedTokens;
+    AST::Arena* arena;
+    StringInterner* names;
+    const TokenStream* tokens;
+    Lexer* lexer;
+    mutable bool lexerExhausted;
     size_t current;
+    // A compound statement whose block is still being parsed. block is the list the next
+    // nested statement goes to, or null once the statement only waits for its terminator.
+    struct OpenBlock {
+        AST::Statement* statement;
+        AST::NodeList<AST::Statement*>* block;
+        bool consumeEndMarker;
+    };
+    std::vector<OpenBlock> openBlocks;
+    bool hasToken(size_t index) const;
+    Token tokenAt(size_t index) const;
+    SymbolId wordAt(size_t index) const;
+    void releaseConsumedTokens();
     bool isAtEnd() const;
-    const Token& peek() const;
-    const Token& previous() const;
-    const Token& advance();
+    Token peek() const;
+    Token previous() const;
+    Token advance();
     bool check(TokenType expected) const;
     bool match(TokenType expected);
-    const Token& consume(TokenType type, const std::string& errorMessage);
-    const Token& lookAhead(size_t offset) const;
+    Token consume(TokenType type, const std::string& errorMessage);
+    Token lookAhead(size_t offset) const;
     bool checkEndMarker() const;
-    bool isKeyword(const std::string& word, const std::string& keyword) const;
-    std::unique_ptr<AST::Statement> parseStatement();
-    std::unique_ptr<AST::Statement> parseNarrativeStatement();
-    std::unique_ptr<AST::Statement> parseConditionalStatement();
-    std::unique_ptr<AST::Statement> parseConditionalStatement(bool consumeEndMarker);
-    std::unique_ptr<AST::Statement> parseInteractiveStatement();
-    std::unique_ptr<AST::Statement> parseRandomStatement();
-    std::unique_ptr<AST::Statement> parseWhileStatement();
-    std::unique_ptr<AST::Statement> parseForEachStatement();
-    std::unique_ptr<AST::Statement> parseForRangeStatement();
-    std::unique_ptr<AST::Statement> parseFunctionDeclaration();
-    std::unique_ptr<AST::Statement> parseFunctionCall();
-    std::unique_ptr<AST::Statement> parseReturnStatement();
-    std::unique_ptr<AST::Statement> parseCommentStatement();
-    std::unique_ptr<AST::Statement> parseArithmeticStatement(const std::vector<Token>& tokensInSentence);
-    std::unique_ptr<AST::Statement> parseRecordDeclaration();
-    std::unique_ptr<AST::Statement> parseRecordInstanceDeclaration(const std::vector<Token>& tokensInSentence);
-    std::unique_ptr<AST::Statement> parseImageDeclaration(const std::vector<Token>& tokensInSentence);
-    std::unique_ptr<AST::Statement> parsePixelWriteStatement(const std::vector<Token>& tokensInSentence);
-    std::unique_ptr<AST::Statement> parseImageFillStatement(const std::vector<Token>& tokensInSentence);
-    std::unique_ptr<AST::Statement> parseRectanglePaintStatement(const std::vector<Token>& tokensInSentence);
-    std::unique_ptr<AST::Statement> parseImageSaveStatement(const std::vector<Token>& tokensInSentence);
-    std::unique_ptr<AST::Statement> parseVariableDeclarationBlock(const std::vector<Token>& tokensInSentence);
-    std::unique_ptr<AST::Statement> parseOutputStatement();
-    std::vector<std::unique_ptr<AST::Statement>> parseBlock();
+    AST::Statement* parseStatement();
+    AST::Statement* openStatement();
+    bool atBlockEnd() const;
+    void closeBlock();
+    AST::Statement* parseNarrativeStatement();
+    AST::Statement* openConditionalStatement(bool consumeEndMarker);
+    AST::Statement* parseInteractiveStatement();
+    AST::Statement* parseRandomStatement();
+    AST::Statement* openWhileStatement();
+    AST::Statement* openForEachStatement();
+    AST::Statement* openForRangeStatement();
+    AST::Statement* openFunctionDeclaration();
+    AST::Statement* parseFunctionCall();
+    AST::Statement* parseReturnStatement();
+    AST::Statement* parseCommentStatement();
+    AST::Statement* parseArithmeticStatement(const TokenSpan& tokensInSentence);
+    AST::Statement* parseRecordDeclaration();
+    AST::Statement* parseRecordInstanceDeclaration(const TokenSpan& tokensInSentence);
+    AST::Statement* parseImageDeclaration(const TokenSpan& tokensInSentence);
+    AST::Statement* parsePixelWriteStatement(const TokenSpan& tokensInSentence);
+    AST::Statement* parseImageFillStatement(const TokenSpan& tokensInSentence);
+    AST::Statement* parseRectanglePaintStatement(const TokenSpan& tokensInSentence);
+    AST::Statement* parseImageSaveStatement(const TokenSpan& tokensInSentence);
+    AST::Statement* parseVariableDeclarationBlock(const TokenSpan& tokensInSentence);
+    AST::Statement* parseOutputStatement();
 };
 
 #endif
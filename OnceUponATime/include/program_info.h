@@ -0,0 +1,79 @@
+// program_info.hpp
+#ifndef PROGRAM_INFO_HPP
+#define PROGRAM_INFO_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <set>
+#include <string>
+#include <vector>
+#include "ast.h"
+
+// What the code generator has to know about a whole story before it emits the story main.
+struct ProgramInfo {
+    // A statement that binds a name, in story order. The names are copied out of the tree, so a
+    // streaming driver may drop a statement as soon as it has been analyzed.
+    struct Declaration {
+        enum class Kind : uint8_t { VARIABLE, RECORD_TYPE, RECORD_INSTANCE, ARITHMETIC_TARGET, RANGE_ITERATOR };
+        Kind kind = Kind::VARIABLE;
+        std::string owner;
+        std::string name;
+        bool collection = false;
+        bool numeric = false;
+        size_t record = 0;
+    };
+
+    bool usesImages = false;
+    std::vector<AST::RecordDeclaration*> records;
+    std::vector<AST::FunctionDeclaration*> functions;
+    std::vector<Declaration> declarations;
+    std::set<std::string, std::less<>> collections;
+    // What the emitted code may look up in storyStates at run time: the subjects of flag
+    // conditions always, and other condition subjects, numeric operands and record field values
+    // unless they name a variable. A story state no one reads need not be written.
+    std::set<std::string, std::less<>> storyFlags;
+    std::set<std::string, std::less<>> storyOperands;
+};
+
+// Builds a ProgramInfo in a single traversal of each statement it is given. The traversal is
+// driven by analyze; each visit only looks at its own node.
+class ProgramAnalyzer final : public AST::Visitor {
+public:
+    // Returns true when the statement declares a record or a function. The info points into such
+    // statements, so they must stay alive as long as it is used.
+    bool analyze(AST::Statement& statement);
+    ProgramInfo finish();
+
+    void visit(AST::NarrativeStatement& node) override;
+    void visit(AST::ConditionalStatement& node) override;
+    void visit(AST::InteractiveStatement& node) override;
+    void visit(AST::RandomStatement& node) override;
+    void visit(AST::WhileStatement& node) override;
+    void visit(AST::ForEachStatement& node) override;
+    void visit(AST::ForRangeStatement& node) override;
+    void visit(AST::FunctionDeclaration& node) override;
+    void visit(AST::FunctionCall& node) override;
+    void visit(AST::ReturnStatement& node) override;
+    void visit(AST::CommentStatement& node) override;
+    void visit(AST::Story& node) override;
+    void visit(AST::VariableDeclaration& node) override;
+    void visit(AST::VariableDeclarationBlock& node) override;
+    void visit(AST::ArithmeticStatement& node) override;
+    void visit(AST::RecordDeclaration& node) override;
+    void visit(AST::RecordInstanceDeclaration& node) override;
+    void visit(AST::ImageDeclaration& node) override;
+    void visit(AST::PixelWriteStatement& node) override;
+    void visit(AST::ImageFillStatement& node) override;
+    void visit(AST::RectanglePaintStatement& node) override;
+    void visit(AST::ImageSaveStatement& node) override;
+    void visit(AST::TellStatement& node) override;
+
+private:
+    ProgramInfo info;
+
+    void addStoryRead(const AST::Operand& operand);
+    void addStoryRead(const AST::Condition& condition);
+};
+
+#endif
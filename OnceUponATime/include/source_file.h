@@ -0,0 +1,32 @@
+// source_file.hpp
+#ifndef SOURCE_FILE_HPP
+#define SOURCE_FILE_HPP
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+// Read-only view of a script on disk. Regular files are memory-mapped for sequential
+// access; pipes and other unmappable inputs are read into an owned buffer instead.
+class SourceFile {
+public:
+    explicit SourceFile(const std::filesystem::path& path);
+    ~SourceFile();
+    SourceFile(const SourceFile&) = delete;
+    SourceFile& operator=(const SourceFile&) = delete;
+
+    std::string_view text() const;
+    bool isMapped() const;
+
+private:
+    const char* data;
+    size_t size;
+    void* mapping;
+    std::string buffer;
+
+    bool map(const std::filesystem::path& path);
+    void read(const std::filesystem::path& path);
+};
+
+#endif
@@ -0,0 +1,34 @@
+// story_cache.hpp
+#ifndef STORY_CACHE_HPP
+#define STORY_CACHE_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include "ast.h"
+
+// A parsed story saved next to its script, so an unchanged script is not lexed and parsed
+// again. The image holds a header with a format identity, which covers the encoding, the
+// parser and the node layout, and the length and 128-bit fingerprint of the script it was
+// parsed from; then a table of the distinct strings of the tree, the statements as a
+// pre-order stream of 32-bit words, and the string bytes. Strings are referenced by index, and every record starts with its length,
+// the relative offset of the record that follows its subtree.
+// Loading maps the file and builds the nodes with their strings pointing into the mapping.
+uint64_t storyContentHash(std::string_view source);
+std::string serializeStory(const AST::Story& story, std::string_view source);
+
+// Returns nullptr when the image was written in another format, by another parser, or for
+// another script; throws when it is damaged. The image must outlive the story.
+std::unique_ptr<AST::Story> deserializeStory(std::string_view image, std::string_view source);
+
+std::filesystem::path storyCachePath(const std::filesystem::path& scriptPath);
+
+// Returns nullptr on any kind of miss, including an unreadable or damaged cache file.
+std::unique_ptr<AST::Story> loadCachedStory(const std::filesystem::path& scriptPath, std::string_view source);
+
+// Returns false when the cache file could not be written; the cache is only an optimization.
+bool saveCachedStory(const std::filesystem::path& scriptPath, std::string_view source, const AST::Story& story);
+
+#endif
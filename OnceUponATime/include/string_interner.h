@@ -0,0 +1,92 @@
+// string_interner.hpp
+#ifndef STRING_INTERNER_HPP
+#define STRING_INTERNER_HPP
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+using SymbolId = uint32_t;
+
+constexpr SymbolId noSymbol = 0xFFFFFFFFu;
+
+// Words the parser and code generator test for. Every interner is seeded with them in this
+// order, so comparing a folded word against one of them is an integer compare.
+enum KnownWord : SymbolId {
+    WORD_A,
+    WORD_AN,
+    WORD_THE,
+    WORD_OF,
+    WORD_IS,
+    WORD_HAS,
+    WORD_EQUALS,
+    WORD_WITH,
+    WORD_AT,
+    WORD_FROM,
+    WORD_TO,
+    WORD_AND,
+    WORD_OR,
+    WORD_AS,
+    WORD_ON,
+    WORD_RECORD,
+    WORD_FUNCTION,
+    WORD_IMAGE,
+    WORD_CREATE,
+    WORD_PAINT,
+    WORD_SET,
+    WORD_FILL,
+    WORD_RECTANGLE,
+    WORD_SAVE,
+    WORD_WIDTH,
+    WORD_HEIGHT,
+    WORD_STORY,
+    WORD_ENDS,
+    WORD_LEANS,
+    WORD_TOWARDS,
+    WORD_CHOOSE,
+    WORD_INPUT,
+    WORD_ELSE,
+    WORD_END,
+    WORD_ENDIF,
+    WORD_ENDWHILE,
+    WORD_ENDFOR,
+    WORD_ENDFUNCTION,
+    WORD_NOT,
+    WORD_GREATER,
+    WORD_LESS,
+    WORD_THAN,
+    WORD_LEAST,
+    WORD_MOST,
+    WORD_ADD,
+    WORD_SUBTRACT,
+    WORD_MULTIPLY,
+    WORD_DIVIDE,
+    KNOWN_WORD_COUNT
+};
+
+// Maps each distinct string to a dense id, starting at zero. An interner is not thread-safe;
+// each story owns the one its names are interned into, and each lexer its own for words.
+class StringInterner {
+public:
+    StringInterner();
+    StringInterner(const StringInterner&) = delete;
+    StringInterner& operator=(const StringInterner&) = delete;
+
+    SymbolId intern(std::string_view text);
+    SymbolId internFolded(std::string_view word);
+    SymbolId findFolded(std::string_view word) const;
+    std::string_view text(SymbolId id) const;
+    size_t size() const;
+
+    // The KnownWord a word folds to, or noSymbol if it is not one of them.
+    static SymbolId knownWord(std::string_view word);
+
+private:
+    std::deque<std::string> strings;
+    std::unordered_map<std::string_view, SymbolId> ids;
+    std::string folded;
+};
+
+#endif
@@ -4,7 +4,11 @@
 #define TOKEN_HPP
 
 #include <string>
+#include <string_view>
 #include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include "string_interner.h"
 
 enum class TokenType {
     KW_ONCE,
@@ -131,9 +135,34 @@ inline std::string tokenTypeToString(TokenType type) {
 
 struct Token {
     TokenType type;
-    std::string lexeme;
+    std::string_view lexeme;
     int line;
     int column;
+    SymbolId word = noSymbol;
+    bool integral = false;
+    int64_t integer = 0;
+    double real = 0.0;
 };
 
+inline bool isNumberLiteral(std::string_view value) {
+    if (value.empty()) {
+        return false;
+    }
+    size_t start = value[0] == '-' ? 1 : 0;
+    if (start == value.size()) {
+        return false;
+    }
+    bool seenDecimalPoint = false;
+    for (size_t i = start; i < value.size(); ++i) {
+        if (value[i] == '.' && !seenDecimalPoint) {
+            seenDecimalPoint = true;
+            continue;
+        }
+        if (!std::isdigit(static_cast<unsigned char>(value[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
 #endif
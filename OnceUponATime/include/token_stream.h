@@ -0,0 +1,80 @@
+// token_stream.hpp
+#ifndef TOKEN_STREAM_HPP
+#define TOKEN_STREAM_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "token.h"
+
+struct NumberValue {
+    int64_t integer;
+    double real;
+    bool integral;
+};
+
+// Tokens stored as parallel arrays of type, source offset, length and a payload holding the
+// word id of words or the index of a number's value. Line and column are not stored; they are
+// derived from the offset through a line-start index that is only built when first asked for.
+class TokenStream {
+public:
+    explicit TokenStream(std::string_view source);
+    explicit TokenStream(const std::vector<Token>& tokens);
+
+    size_t size() const;
+    TokenType type(size_t index) const;
+    std::string_view lexeme(size_t index) const;
+    SymbolId word(size_t index) const;
+    const NumberValue& number(size_t index) const;
+    int line(size_t index) const;
+    int column(size_t index) const;
+
+    // Materializes a token. Positions are left at zero; use line() and column() for those.
+    Token at(size_t index) const;
+
+    void append(const Token& token);
+    void discardFront(size_t count);
+    void resize(size_t tokenCount, size_t numberCount);
+    void copyFrom(const TokenStream& part, size_t tokenCount, size_t tokenOffset, size_t numberOffset,
+                  const std::vector<SymbolId>& wordRemap);
+    size_t numberCount() const;
+
+private:
+    std::string_view source;
+    std::string ownedText;
+    bool owned;
+    std::vector<uint8_t> types;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> lengths;
+    std::vector<uint32_t> payloads;
+    std::vector<NumberValue> numbers;
+    std::vector<int> explicitLines;
+    std::vector<int> explicitColumns;
+    mutable std::vector<uint32_t> lineStarts;
+
+    const char* base() const;
+    size_t positionOf(size_t index, bool end) const;
+    size_t lineIndexOf(size_t position) const;
+};
+
+// A non-owning view of the tokens [begin, end) of a stream. Indices passed to the accessors are
+// relative to the start of the span.
+class TokenSpan {
+public:
+    TokenSpan(const TokenStream& tokens, size_t begin, size_t end);
+
+    size_t size() const;
+    bool empty() const;
+    TokenType type(size_t index) const;
+    std::string_view lexeme(size_t index) const;
+    SymbolId word(size_t index) const;
+    TokenSpan subspan(size_t start, size_t end) const;
+
+private:
+    const TokenStream* tokens;
+    size_t begin;
+    size_t end;
+};
+
+#endif
@@ -1,8 +1,306 @@
 // ast.cpp
 #include "ast.h"
+#include <cstring>
+#include <utility>
+#include <vector>
 
 namespace AST {
 
+Arena::Arena()
+    : firstBlock(new std::byte[firstBlockSize]), resource(firstBlock.get(), firstBlockSize) {}
+
+void* Arena::allocate(size_t size, size_t alignment) {
+    return resource.allocate(size, alignment);
+}
+
+std::string_view Arena::copy(std::string_view text) {
+    if (text.empty()) {
+        return std::string_view();
+    }
+    char* storage = static_cast<char*>(resource.allocate(text.size(), 1));
+    std::memcpy(storage, text.data(), text.size());
+    return std::string_view(storage, text.size());
+}
+
+void Arena::release() {
+    resource.release();
+}
+
+namespace {
+
+// Two independently seeded 64-bit lanes, each a multiply-rotate chain over the words fed in.
+class FingerprintBuilder {
+public:
+    FingerprintBuilder() : low(0x9E3779B185EBCA87ull), high(0xC2B2AE3D27D4EB4Full) {}
+
+    explicit FingerprintBuilder(NodeKind kind) : FingerprintBuilder() {
+        add(static_cast<uint64_t>(kind));
+    }
+
+    void add(uint64_t word) {
+        low = rotateLeft(low ^ (word * 0xC2B2AE3D27D4EB4Full), 31) * 0x9E3779B185EBCA87ull;
+        high = rotateLeft(high + (word * 0x165667B19E3779F9ull), 27) * 0xD6E8FEB86659FD93ull;
+    }
+
+    void add(std::string_view text) {
+        add(static_cast<uint64_t>(text.size()));
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= text.size(); i += sizeof(uint64_t)) {
+            uint64_t word;
+            std::memcpy(&word, text.data() + i, sizeof(word));
+            add(word);
+        }
+        uint64_t rest = 0;
+        for (size_t shift = 0; i < text.size(); ++i, shift += 8) {
+            rest |= static_cast<uint64_t>(static_cast<unsigned char>(text[i])) << shift;
+        }
+        add(rest);
+    }
+
+    void add(const Operand& operand) {
+        add(static_cast<uint64_t>(operand.kind));
+        add(operand.text);
+    }
+
+    void add(const Condition& condition) {
+        add(static_cast<uint64_t>(condition.kind) | static_cast<uint64_t>(condition.op) << 8);
+        add(condition.left);
+        add(condition.right);
+    }
+
+    void add(const NodeList<Statement*>& statements) {
+        add(static_cast<uint64_t>(statements.size()));
+        for (const Statement* statement : statements) {
+            add(statement->fingerprint.low);
+            add(statement->fingerprint.high);
+        }
+    }
+
+    Fingerprint finish() const {
+        Fingerprint result{mix(low ^ rotateLeft(high, 17)), mix(high ^ rotateLeft(low, 41))};
+        if (result.empty()) {
+            result.low = 1;
+        }
+        return result;
+    }
+
+private:
+    uint64_t low;
+    uint64_t high;
+
+    static uint64_t rotateLeft(uint64_t value, int bits) {
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    static uint64_t mix(uint64_t value) {
+        value ^= value >> 33;
+        value *= 0xFF51AFD7ED558CCDull;
+        value ^= value >> 33;
+        value *= 0xC4CEB9FE1A85EC53ull;
+        value ^= value >> 33;
+        return value;
+    }
+};
+
+// Hashes the statement itself; the statements below it already have their fingerprints.
+Fingerprint ownFingerprint(Statement& statement) {
+    FingerprintBuilder builder(statement.kind);
+    switch (statement.kind) {
+    case NodeKind::NARRATIVE:
+        builder.add(static_cast<NarrativeStatement&>(statement).text);
+        break;
+    case NodeKind::CONDITIONAL: {
+        auto& node = static_cast<ConditionalStatement&>(statement);
+        builder.add(node.condition);
+        builder.add(node.test);
+        builder.add(node.thenBranch);
+        builder.add(node.elseBranch);
+        break;
+    }
+    case NodeKind::INTERACTIVE:
+        builder.add(static_cast<InteractiveStatement&>(statement).prompt);
+        break;
+    case NodeKind::RANDOM: {
+        auto& node = static_cast<RandomStatement&>(statement);
+        builder.add(node.subject);
+        builder.add(node.randomStates.first);
+        builder.add(node.randomStates.second);
+        break;
+    }
+    case NodeKind::WHILE: {
+        auto& node = static_cast<WhileStatement&>(statement);
+        builder.add(node.condition);
+        builder.add(node.test);
+        builder.add(node.body);
+        break;
+    }
+    case NodeKind::FOR_EACH: {
+        auto& node = static_cast<ForEachStatement&>(statement);
+        builder.add(node.iterator);
+        builder.add(node.collection);
+        builder.add(node.body);
+        break;
+    }
+    case NodeKind::FOR_RANGE: {
+        auto& node = static_cast<ForRangeStatement&>(statement);
+        builder.add(node.iterator);
+        builder.add(node.start);
+        builder.add(node.end);
+        builder.add(node.body);
+        break;
+    }
+    case NodeKind::FUNCTION_DECLARATION: {
+        auto& node = static_cast<FunctionDeclaration&>(statement);
+        builder.add(node.name);
+        builder.add(node.body);
+        break;
+    }
+    case NodeKind::FUNCTION_CALL:
+        builder.add(static_cast<FunctionCall&>(statement).name);
+        break;
+    case NodeKind::RETURN:
+        break;
+    case NodeKind::COMMENT:
+        builder.add(static_cast<CommentStatement&>(statement).comment);
+        break;
+    case NodeKind::VARIABLE_DECLARATION: {
+        auto& node = static_cast<VariableDeclaration&>(statement);
+        builder.add(node.owner);
+        builder.add(node.varName);
+        builder.add(node.value);
+        builder.add(static_cast<uint64_t>(node.values.size()));
+        for (std::string_view value : node.values) {
+            builder.add(value);
+        }
+        break;
+    }
+    case NodeKind::VARIABLE_DECLARATION_BLOCK: {
+        auto& node = static_cast<VariableDeclarationBlock&>(statement);
+        builder.add(static_cast<uint64_t>(node.declarations.size()));
+        for (const VariableDeclaration* declaration : node.declarations) {
+            builder.add(declaration->fingerprint.low);
+            builder.add(declaration->fingerprint.high);
+        }
+        break;
+    }
+    case NodeKind::ARITHMETIC: {
+        auto& node = static_cast<ArithmeticStatement&>(statement);
+        builder.add(node.left);
+        builder.add(node.operation);
+        builder.add(node.right);
+        builder.add(node.target);
+        break;
+    }
+    case NodeKind::RECORD_DECLARATION: {
+        auto& node = static_cast<RecordDeclaration&>(statement);
+        builder.add(node.name);
+        builder.add(static_cast<uint64_t>(node.fields.size()));
+        for (const Field& field : node.fields) {
+            builder.add(field.first);
+            builder.add(field.second);
+        }
+        break;
+    }
+    case NodeKind::RECORD_INSTANCE: {
+        auto& node = static_cast<RecordInstanceDeclaration&>(statement);
+        builder.add(node.name);
+        builder.add(node.typeName);
+        builder.add(static_cast<uint64_t>(node.fieldValues.size()));
+        for (const FieldValue& value : node.fieldValues) {
+            builder.add(value.first);
+            builder.add(value.second);
+        }
+        break;
+    }
+    case NodeKind::IMAGE_DECLARATION: {
+        auto& node = static_cast<ImageDeclaration&>(statement);
+        builder.add(node.name);
+        builder.add(node.width);
+        builder.add(node.height);
+        break;
+    }
+    case NodeKind::PIXEL_WRITE: {
+        auto& node = static_cast<PixelWriteStatement&>(statement);
+        builder.add(node.imageName);
+        for (const Operand* operand : {&node.x, &node.y, &node.red, &node.green, &node.blue}) {
+            builder.add(*operand);
+        }
+        break;
+    }
+    case NodeKind::IMAGE_FILL: {
+        auto& node = static_cast<ImageFillStatement&>(statement);
+        builder.add(node.imageName);
+        for (const Operand* operand : {&node.red, &node.green, &node.blue}) {
+            builder.add(*operand);
+        }
+        break;
+    }
+    case NodeKind::RECTANGLE_PAINT: {
+        auto& node = static_cast<RectanglePaintStatement&>(statement);
+        builder.add(node.imageName);
+        for (const Operand* operand : {&node.left, &node.bottom, &node.right, &node.top,
+                                       &node.red, &node.green, &node.blue}) {
+            builder.add(*operand);
+        }
+        break;
+    }
+    case NodeKind::IMAGE_SAVE: {
+        auto& node = static_cast<ImageSaveStatement&>(statement);
+        builder.add(node.imageName);
+        builder.add(node.outputPath);
+        break;
+    }
+    case NodeKind::TELL:
+        builder.add(static_cast<TellStatement&>(statement).message);
+        break;
+    case NodeKind::STORY:
+        throw std::runtime_error("A story has no statement fingerprint");
+    }
+    return builder.finish();
+}
+
+}
+
+Fingerprint fingerprint(Statement& statement) {
+    if (!statement.fingerprint.empty()) {
+        return statement.fingerprint;
+    }
+    // Post-order with an explicit stack: a statement is hashed on its second visit, once
+    // everything below it has been.
+    std::vector<std::pair<Statement*, bool>> pending{{&statement, false}};
+    while (!pending.empty()) {
+        auto [node, expanded] = pending.back();
+        if (expanded) {
+            pending.pop_back();
+            node->fingerprint = ownFingerprint(*node);
+            continue;
+        }
+        pending.back().second = true;
+        forEachChild(*node, [&pending](Node& child) {
+            auto& nested = static_cast<Statement&>(child);
+            if (nested.fingerprint.empty()) {
+                pending.emplace_back(&nested, false);
+            }
+        });
+    }
+    return statement.fingerprint;
+}
+
+Fingerprint fingerprint(Story& story) {
+    FingerprintBuilder builder(story.kind);
+    for (Statement* statement : story.statements) {
+        fingerprint(*statement);
+    }
+    builder.add(story.statements);
+    return builder.finish();
+}
+
+Fingerprint fingerprint(std::string_view text) {
+    FingerprintBuilder builder;
+    builder.add(text);
+    return builder.finish();
+}
+
 void NarrativeStatement::accept(Visitor& visitor) {
     visitor.visit(*this);
 }
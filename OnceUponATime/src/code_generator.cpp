@@ -1,96 +1,148 @@
 // code_generator.cpp
 #include "code_generator.h"
+#include "token.h"
 #include <algorithm>
 #include <cctype>
+#include <charconv>
+#include <climits>
+#include <cmath>
 #include <cstdlib>
 #include <ctime>
 #include <iostream>
 #include <sstream>
 #include <stdexcept>
 
-static bool isNumberLiteral(const std::string& value) {
-    if (value.empty()) {
-        return false;
-    }
-    size_t start = value[0] == '-' ? 1 : 0;
-    if (start == value.size()) {
-        return false;
+template <typename T>
+static T& growTo(std::vector<T>& table, SymbolId id, T fill = T()) {
+    if (id >= table.size()) {
+        table.resize(static_cast<size_t>(id) + 1, fill);
     }
-    bool seenDecimalPoint = false;
-    for (size_t i = start; i < value.size(); ++i) {
-        unsigned char c = static_cast<unsigned char>(value[i]);
-        if (value[i] == '.' && !seenDecimalPoint) {
-            seenDecimalPoint = true;
-            continue;
-        }
-        if (!std::isdigit(c)) {
-            return false;
-        }
-    }
-    return true;
+    return table[id];
 }
 
-static std::vector<std::string> splitWords(const std::string& value) {
-    std::istringstream iss(value);
-    std::vector<std::string> words;
-    std::string word;
-    while (iss >> word) {
-        words.push_back(word);
-    }
-    return words;
+template <typename T>
+static T lookup(const std::vector<T>& table, SymbolId id, T missing = T()) {
+    return id < table.size() ? table[id] : missing;
 }
 
-static std::string joinWords(const std::vector<std::string>& words, size_t start, size_t end) {
-    if (end > words.size()) {
-        end = words.size();
-    }
-    std::ostringstream oss;
-    for (size_t i = start; i < end; ++i) {
-        if (i > start) {
-            oss << " ";
-        }
-        oss << words[i];
+static std::string joinName(std::string_view first, std::string_view second) {
+    std::string name;
+    name.reserve(first.size() + second.size() + 1);
+    name.append(first).append(" ").append(second);
+    return name;
+}
+
+static bool compareNumbers(AST::ComparisonOperator op, double left, double right) {
+    switch (op) {
+        case AST::ComparisonOperator::EQUAL: return left == right;
+        case AST::ComparisonOperator::NOT_EQUAL: return left != right;
+        case AST::ComparisonOperator::GREATER: return left > right;
+        case AST::ComparisonOperator::LESS: return left < right;
+        case AST::ComparisonOperator::AT_LEAST: return left >= right;
+        default: return left <= right;
     }
-    return oss.str();
 }
 
 CodeGeneratorVisitor::CodeGeneratorVisitor()
     : indentLevel(0),
+      names(&ownedNames),
       skipFunctionDeclarations(false),
       skipRecordDeclarations(false),
       imageRuntimeRequired(false),
-      tempCounter(0) {}
-
-std::string CodeGeneratorVisitor::indent() const {
-    return std::string(indentLevel * 4, ' ');
+      storyReadsKnown(false),
+      foldingConstants(false),
+      tempCounter(0),
+      statementOutput(4096),
+      emittingBlocks(false) {}
+
+std::string_view CodeGeneratorVisitor::indent() const {
+    size_t width = static_cast<size_t>(indentLevel) * 4;
+    if (indentation.size() < width) {
+        indentation.resize(std::max(width, indentation.size() * 2), ' ');
+    }
+    return std::string_view(indentation.data(), width);
 }
 
 void CodeGeneratorVisitor::generateRandomizer() {
-    oss << "bool getRandomBool() {\n";
-    oss << "    return std::rand() % 2 == 0;\n";
-    oss << "}\n\n";
-}
-
-void CodeGeneratorVisitor::generateStoryStateHelpers() {
-    oss << "std::unordered_map<std::string, std::string> storyStates;\n\n";
-    oss << "std::string getStoryState(const std::string& name) {\n";
-    oss << "    auto it = storyStates.find(name);\n";
-    oss << "    return it == storyStates.end() ? \"\" : it->second;\n";
-    oss << "}\n\n";
-    oss << "double getStoryNumber(const std::string& name) {\n";
-    oss << "    try {\n";
-    oss << "        return std::stod(getStoryState(name));\n";
-    oss << "    } catch (...) {\n";
-    oss << "        return 0;\n";
-    oss << "    }\n";
-    oss << "}\n\n";
-    oss << "bool storyCondition(const std::string& condition) {\n";
-    oss << "    return getStoryState(condition) == \"true\";\n";
-    oss << "}\n\n";
+    out << "bool getRandomBool() {\n";
+    out << "    return std::rand() % 2 == 0;\n";
+    out << "}\n\n";
+}
+
+// Story states live in a fixed table with one slot per key the story reads, indexed by a
+// StoryKey. A text value is parsed as a number and tested as a condition when it is stored,
+// so reads never touch the string; a number is only formatted when it is read as text.
+void CodeGeneratorVisitor::generateStoryStateHelpers(const std::set<std::string_view>& keys) {
+    out << "enum class StoryKey {";
+    const char* separator = " ";
+    for (std::string_view key : keys) {
+        out << separator << storySlotName(key);
+        separator = ", ";
+    }
+    out << " };\n\n";
+    out << R"cpp(struct StoryState {
+    enum class Kind { UNSET, TEXT, INTEGER, NUMBER };
+    Kind kind = Kind::UNSET;
+    bool flag = false;
+    bool formatted = true;
+    double number = 0;
+    std::string text;
+};
+
+)cpp";
+    out << "StoryState storyStates[" << keys.size() << "];\n\n";
+    out << R"cpp(void setStoryState(StoryKey key, const std::string& value) {
+    StoryState& state = storyStates[static_cast<int>(key)];
+    const char* begin = value.c_str();
+    char* end = nullptr;
+    errno = 0;
+    double number = std::strtod(begin, &end);
+    state.kind = StoryState::Kind::TEXT;
+    state.flag = value == "true";
+    state.formatted = true;
+    state.number = end == begin || errno == ERANGE ? 0 : number;
+    state.text = value;
+}
+
+void setStoryNumber(StoryKey key, StoryState::Kind kind, double value) {
+    StoryState& state = storyStates[static_cast<int>(key)];
+    state.kind = kind;
+    state.flag = false;
+    state.formatted = false;
+    state.number = value;
+}
+
+void setStoryState(StoryKey key, int value) {
+    setStoryNumber(key, StoryState::Kind::INTEGER, value);
+}
+
+void setStoryState(StoryKey key, double value) {
+    setStoryNumber(key, StoryState::Kind::NUMBER, value);
+}
+
+const std::string& getStoryState(StoryKey key) {
+    StoryState& state = storyStates[static_cast<int>(key)];
+    if (!state.formatted) {
+        state.text = state.kind == StoryState::Kind::INTEGER ? std::to_string(static_cast<int>(state.number))
+                                                             : std::to_string(state.number);
+        state.formatted = true;
+    }
+    return state.text;
+}
+
+double getStoryNumber(StoryKey key) {
+    return storyStates[static_cast<int>(key)].number;
+}
+
+bool storyCondition(StoryKey key) {
+    return storyStates[static_cast<int>(key)].flag;
+}
+
+)cpp";
 }
 
 void CodeGeneratorVisitor::generateImageRuntime() {
-    oss << R"cpp(
+    out << R"cpp(
 struct OuatPixel {
     double red;
     double green;
@@ -178,10 +230,22 @@ void saveImageAsPpm(const OuatImage& image, const std::string& outputPath) {
 }
 
 std::string CodeGeneratorVisitor::getGeneratedCode() const {
-    return oss.str();
+    return out.str();
+}
+
+std::string CodeGeneratorVisitor::takeGeneratedCode() {
+    return out.take();
+}
+
+void CodeGeneratorVisitor::setOutput(std::ostream* output) {
+    out.setTarget(output);
+}
+
+void CodeGeneratorVisitor::flushOutput() {
+    out.flush();
 }
 
-std::string CodeGeneratorVisitor::escapeString(const std::string& s) const {
+std::string CodeGeneratorVisitor::escapeString(std::string_view s) const {
     std::string result;
     for (char c : s) {
         switch (c) {
@@ -196,7 +260,7 @@ std::string CodeGeneratorVisitor::escapeString(const std::string& s) const {
     return result;
 }
 
-std::string CodeGeneratorVisitor::sanitizeIdentifier(const std::string& s) const {
+std::string CodeGeneratorVisitor::sanitizeIdentifier(std::string_view s) const {
     std::vector<std::string> words;
     std::string current;
     for (char c : s) {
@@ -233,7 +297,7 @@ std::string CodeGeneratorVisitor::sanitizeIdentifier(const std::string& s) const
     return result;
 }
 
-std::string CodeGeneratorVisitor::sanitizeTypeName(const std::string& s) const {
+std::string CodeGeneratorVisitor::sanitizeTypeName(std::string_view s) const {
     std::vector<std::string> words;
     std::string current;
     for (char c : s) {
@@ -264,136 +328,620 @@ std::string CodeGeneratorVisitor::sanitizeTypeName(const std::string& s) const {
     return result;
 }
 
-std::string CodeGeneratorVisitor::normalizeName(const std::string& s) const {
-    return sanitizeIdentifier(s);
+std::string CodeGeneratorVisitor::normalizeName(std::string_view s) const {
+    return std::string(names->text(normalizedId(s)));
+}
+
+SymbolId CodeGeneratorVisitor::normalizedId(std::string_view s) const {
+    return normalizedId(names->intern(s));
+}
+
+SymbolId CodeGeneratorVisitor::normalizedId(SymbolId raw) const {
+    SymbolId normalized = lookup(normalizedNames, raw, noSymbol);
+    if (normalized == noSymbol) {
+        normalized = names->intern(sanitizeIdentifier(names->text(raw)));
+        growTo(normalizedNames, raw, noSymbol) = normalized;
+    }
+    return normalized;
+}
+
+SymbolId CodeGeneratorVisitor::resolveId(std::string_view name) const {
+    return lookup(symbols, normalizedId(name), noSymbol);
+}
+
+void CodeGeneratorVisitor::bindSymbol(SymbolId key, SymbolId id, SymbolKind kind) {
+    growTo(symbols, key, noSymbol) = id;
+    growTo(symbolKinds, id, SymbolKind::NONE) = kind;
+}
+
+bool CodeGeneratorVisitor::isInitialized(SymbolId id) const {
+    return lookup(initializedSymbols, id, char(0)) != 0;
+}
+
+void CodeGeneratorVisitor::markInitialized(SymbolId id) {
+    growTo(initializedSymbols, id, char(0)) = 1;
+}
+
+// Without a ProgramInfo, as when single statements are emitted, every story state is kept.
+bool CodeGeneratorVisitor::isStoryKeyRead(SymbolId key) const {
+    return !storyReadsKnown || lookup(readStoryKeys, key, char(0)) != 0;
+}
+
+const CodeGeneratorVisitor::RecordType* CodeGeneratorVisitor::recordTypeFor(SymbolId typeId) const {
+    return typeId < recordTypes.size() && recordTypes[typeId].declared ? &recordTypes[typeId] : nullptr;
 }
 
 std::string CodeGeneratorVisitor::variableNameFor(const AST::VariableDeclaration& node) const {
-    std::string owner = sanitizeIdentifier(node.owner);
-    std::string variable = sanitizeIdentifier(node.varName);
-    if (node.isCollection() &&
+    return variableNameFor(node.owner, node.varName, node.isCollection());
+}
+
+std::string CodeGeneratorVisitor::variableNameFor(std::string_view ownerName, std::string_view varName,
+                                                  bool collection) const {
+    std::string_view owner = names->text(normalizedId(ownerName));
+    std::string_view variable = names->text(normalizedId(varName));
+    if (collection &&
         (variable == "members" || variable == "member" ||
          variable == "items" || variable == "item" ||
          variable == "elements" || variable == "element")) {
-        return owner;
+        return std::string(owner);
     }
     if (owner.empty() || owner == "value") {
-        return variable;
+        return std::string(variable);
     }
     if (variable.empty() || variable == "value" || owner == variable) {
-        return owner;
+        return std::string(owner);
     }
-    return owner + "_" + variable;
+    std::string name;
+    name.reserve(owner.size() + variable.size() + 1);
+    name.append(owner).append("_").append(variable);
+    return name;
 }
 
 std::string CodeGeneratorVisitor::variableNameFor(const AST::RecordInstanceDeclaration& node) const {
     return sanitizeIdentifier(node.name);
 }
 
-std::string CodeGeneratorVisitor::resolveName(const std::string& name) const {
-    std::string normalized = normalizeName(name);
-    auto it = symbols.find(normalized);
-    if (it != symbols.end()) {
-        return it->second;
+// Declarations outside a resolved statement, such as ones emitted on their own, have no id yet.
+SymbolId CodeGeneratorVisitor::declaredId(const AST::VariableDeclaration& node) const {
+    return node.symbol != noSymbol ? node.symbol : names->intern(variableNameFor(node));
+}
+
+SymbolId CodeGeneratorVisitor::declaredId(const AST::RecordInstanceDeclaration& node) const {
+    return node.symbol != noSymbol ? node.symbol : names->intern(variableNameFor(node));
+}
+
+SymbolId CodeGeneratorVisitor::declaredId(const AST::ForRangeStatement& node) const {
+    return node.symbol != noSymbol ? node.symbol : names->intern(sanitizeIdentifier(node.iterator));
+}
+
+// The variable an arithmetic statement assigns: the one its target is bound to, or else one
+// named after it.
+SymbolId CodeGeneratorVisitor::assignedId(const AST::Operand& target) const {
+    AST::Operand operand = bound(target);
+    return operand.symbol != noSymbol ? operand.symbol : names->intern(sanitizeIdentifier(operand.text));
+}
+
+std::string CodeGeneratorVisitor::resolveName(std::string_view name) const {
+    SymbolId id = resolveId(name);
+    return id == noSymbol ? "" : std::string(names->text(id));
+}
+
+AST::Operand CodeGeneratorVisitor::resolved(const AST::Operand& operand) const {
+    AST::Operand result = operand;
+    if (operand.kind != AST::Operand::Kind::NAME) {
+        result.binding = AST::Operand::Binding::LITERAL;
+        return result;
+    }
+    if (result.name == noSymbol) {
+        result.name = names->intern(operand.text);
+    }
+    result.key = normalizedId(result.name);
+    result.symbol = lookup(symbols, result.key, noSymbol);
+    if (result.symbol == noSymbol) {
+        result.binding = AST::Operand::Binding::STORY_STATE;
+    } else if (names->text(result.symbol).find('.') != std::string_view::npos) {
+        result.binding = AST::Operand::Binding::FIELD;
+    } else {
+        result.binding = AST::Operand::Binding::SYMBOL;
     }
-    return "";
+    return result;
 }
 
-std::string CodeGeneratorVisitor::translateCondition(const std::string& condition) const {
-    std::vector<std::string> words = splitWords(condition);
-    if (words.empty()) {
-        return "false";
+AST::Operand CodeGeneratorVisitor::bound(const AST::Operand& operand) const {
+    return operand.binding == AST::Operand::Binding::UNRESOLVED ? resolved(operand) : operand;
+}
+
+void CodeGeneratorVisitor::resolve(AST::Operand& operand) const {
+    operand = resolved(operand);
+}
+
+void CodeGeneratorVisitor::resolve(AST::Condition& condition) const {
+    if (condition.kind != AST::Condition::Kind::NEVER) {
+        resolve(condition.left);
+    }
+    if (condition.kind == AST::Condition::Kind::COMPARISON) {
+        resolve(condition.right);
     }
+}
 
-    auto conditionKey = normalizeName(condition);
-    auto makeStateLookup = [&](const std::string& name) {
-        return "getStoryState(\"" + escapeString(normalizeName(name)) + "\")";
-    };
-    auto makeNumberLookup = [&](const std::string& name) {
-        return "getStoryNumber(\"" + escapeString(normalizeName(name)) + "\")";
-    };
+SymbolId CodeGeneratorVisitor::storyKey(const AST::Operand& operand) const {
+    return operand.key != noSymbol ? operand.key : normalizedId(operand.text);
+}
 
-    for (size_t i = 0; i < words.size(); ++i) {
-        std::string op = normalizeName(words[i]);
-        if (op != "is" && op != "equals") {
-            continue;
+// Keys are sanitized identifiers already; only the words C++ reserves, or that the C library
+// defines as macros, need to be set apart.
+std::string CodeGeneratorVisitor::storySlotName(std::string_view key) {
+    static const std::string_view reserved[] = {
+        "alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand", "bitor", "bool", "break", "case",
+        "catch", "char", "char16_t", "char32_t", "char8_t", "class", "co_await", "co_return", "co_yield",
+        "compl", "concept", "const", "const_cast", "consteval", "constexpr", "constinit", "continue",
+        "decltype", "default", "delete", "do", "double", "dynamic_cast", "else", "enum", "errno",
+        "explicit", "export", "extern", "false", "float", "for", "friend", "goto", "if", "inline", "int",
+        "linux", "long", "mutable", "namespace", "new", "noexcept", "not", "not_eq", "nullptr", "operator",
+        "or", "or_eq", "private", "protected", "public", "register", "reinterpret_cast", "requires",
+        "return", "short", "signed", "sizeof", "static", "static_assert", "static_cast", "struct",
+        "switch", "template", "this", "thread_local", "throw", "true", "try", "typedef", "typeid",
+        "typename", "union", "unix", "unsigned", "using", "virtual", "void", "volatile", "wchar_t",
+        "while", "xor", "xor_eq"};
+    std::string name(key);
+    if (std::binary_search(std::begin(reserved), std::end(reserved), key)) {
+        name.push_back('_');
+    }
+    return name;
+}
+
+std::string CodeGeneratorVisitor::storySlot(SymbolId key) const {
+    return "StoryKey::" + storySlotName(names->text(key));
+}
+
+std::string CodeGeneratorVisitor::translateCondition(const AST::Condition& condition) const {
+    if (condition.kind == AST::Condition::Kind::NEVER) {
+        return "false";
+    }
+    AST::Operand left = bound(condition.left);
+    if (condition.kind == AST::Condition::Kind::FLAG) {
+        return "storyCondition(" + storySlot(storyKey(left)) + ")";
+    }
+
+    static const char* const operators[] = {"==", "!=", ">", "<", ">=", "<="};
+    std::string cppOp = operators[static_cast<size_t>(condition.op)];
+    AST::Operand right = bound(condition.right);
+    // A quoted number is compared as the number it spells.
+    for (AST::Operand* operand : {&left, &right}) {
+        if (operand->kind == AST::Operand::Kind::TEXT && isNumberLiteral(operand->text)) {
+            operand->kind = AST::Operand::Kind::NUMBER;
+        }
+    }
+    bool leftResolved = left.symbol != noSymbol;
+    bool rightResolved = right.symbol != noSymbol;
+    std::string rightExpr = rightResolved ? std::string(names->text(right.symbol))
+                                          : "\"" + escapeString(right.text) + "\"";
+
+    bool numericComparison = condition.op != AST::ComparisonOperator::EQUAL &&
+                             condition.op != AST::ComparisonOperator::NOT_EQUAL;
+    if (numericComparison || right.kind == AST::Operand::Kind::NUMBER) {
+        KnownNumber leftValue;
+        KnownNumber rightValue;
+        bool leftKnown = leftResolved && knownValue(left, leftValue);
+        bool rightKnown = knownValue(right, rightValue);
+        if (leftKnown && rightKnown) {
+            return compareNumbers(condition.op, leftValue.value, rightValue.value) ? "true" : "false";
+        }
+        std::string leftExpr = leftKnown      ? numberLiteral(leftValue)
+                               : leftResolved ? std::string(names->text(left.symbol))
+                                              : "getStoryNumber(" + storySlot(storyKey(left)) + ")";
+        if (rightResolved && rightKnown) {
+            rightExpr = numberLiteral(rightValue);
+        } else if (!rightResolved && right.kind != AST::Operand::Kind::TEXT) {
+            rightExpr = std::string(right.text);
         }
+        return leftExpr + " " + cppOp + " " + rightExpr;
+    }
 
-        std::string leftRaw = joinWords(words, 0, i);
-        if (leftRaw.empty()) {
-            return "false";
+    std::string leftExpr = leftResolved ? std::string(names->text(left.symbol))
+                                        : "getStoryState(" + storySlot(storyKey(left)) + ")";
+    return leftExpr + " " + cppOp + " " + rightExpr;
+}
+
+std::string CodeGeneratorVisitor::numericExpression(std::string_view value) const {
+    return numericExpression(AST::Operand(value));
+}
+
+std::string CodeGeneratorVisitor::numericExpression(const AST::Operand& value) const {
+    AST::Operand operand = bound(value);
+    switch (operand.binding) {
+        case AST::Operand::Binding::SYMBOL:
+        case AST::Operand::Binding::FIELD: {
+            KnownNumber number;
+            return knownValue(operand, number) ? numberLiteral(number) : std::string(names->text(operand.symbol));
         }
+        case AST::Operand::Binding::STORY_STATE:
+            return "getStoryNumber(" + storySlot(storyKey(operand)) + ")";
+        default:
+            return std::string(operand.text);
+    }
+}
 
-        size_t rhsStart = i + 1;
-        std::string cppOp = "==";
-        if (op == "is" && rhsStart < words.size()) {
-            std::string first = normalizeName(words[rhsStart]);
-            std::string second = rhsStart + 1 < words.size() ? normalizeName(words[rhsStart + 1]) : "";
-            if (first == "not") {
-                cppOp = "!=";
-                rhsStart++;
-            } else if (first == "greater" && second == "than") {
-                cppOp = ">";
-                rhsStart += 2;
-            } else if (first == "less" && second == "than") {
-                cppOp = "<";
-                rhsStart += 2;
-            } else if (first == "at" && second == "least") {
-                cppOp = ">=";
-                rhsStart += 2;
-            } else if (first == "at" && second == "most") {
-                cppOp = "<=";
-                rhsStart += 2;
+// Values are only learned in the story main, from statements outside any block; a compound
+// statement forgets every variable its body assigns before it is emitted, so what is still
+// known inside holds on every pass through it. Function bodies are emitted before that.
+bool CodeGeneratorVisitor::knownValue(const AST::Operand& value, KnownNumber& number) const {
+    AST::Operand operand = bound(value);
+    switch (operand.binding) {
+        case AST::Operand::Binding::SYMBOL:
+        case AST::Operand::Binding::FIELD:
+            if (!foldingConstants || operand.symbol >= numbers.size() || !numbers[operand.symbol].known) {
+                return false;
             }
+            number = numbers[operand.symbol];
+            return true;
+        case AST::Operand::Binding::LITERAL:
+            return operand.kind == AST::Operand::Kind::NUMBER && parseNumber(operand.text, number);
+        default:
+            return false;
+    }
+}
+
+void CodeGeneratorVisitor::setNumberType(SymbolId id, KnownNumber::Type type) {
+    KnownNumber& number = growTo(numbers, id);
+    number.type = type;
+    number.known = false;
+}
+
+// Keeps the value converted to the variable's type. Fields of nested records are never kept,
+// since copying the record they belong to replaces them.
+void CodeGeneratorVisitor::assignNumber(SymbolId id, const KnownNumber* value) {
+    KnownNumber& number = growTo(numbers, id);
+    number.known = false;
+    if (value == nullptr || !foldingConstants || !openBlocks.empty() || number.type == KnownNumber::Type::UNKNOWN) {
+        return;
+    }
+    std::string_view text = names->text(id);
+    if (text.find('.') != text.rfind('.')) {
+        return;
+    }
+    double converted = value->value;
+    if (number.type == KnownNumber::Type::INTEGER && value->type == KnownNumber::Type::NUMBER) {
+        converted = std::trunc(converted);
+        if (converted < INT_MIN || converted > INT_MAX) {
+            return;
         }
+    }
+    number.known = true;
+    number.value = converted;
+}
 
-        std::string rightRaw = joinWords(words, rhsStart, words.size());
-        if (rightRaw.empty()) {
-            return "false";
+void CodeGeneratorVisitor::forgetAssignments(AST::Statement& statement) {
+    AST::walk(statement, [this](AST::Node& node) {
+        switch (node.kind) {
+        case AST::NodeKind::ARITHMETIC:
+            assignNumber(assignedId(static_cast<AST::ArithmeticStatement&>(node).target), nullptr);
+            break;
+        case AST::NodeKind::VARIABLE_DECLARATION:
+            assignNumber(declaredId(static_cast<AST::VariableDeclaration&>(node)), nullptr);
+            break;
+        case AST::NodeKind::RECORD_INSTANCE: {
+            auto& instance = static_cast<AST::RecordInstanceDeclaration&>(node);
+            std::string id(names->text(declaredId(instance)));
+            for (const auto& fieldValue : instance.fieldValues) {
+                assignNumber(names->intern(id + "." + sanitizeIdentifier(fieldValue.first)), nullptr);
+            }
+            break;
+        }
+        case AST::NodeKind::FOR_RANGE:
+            assignNumber(declaredId(static_cast<AST::ForRangeStatement&>(node)), nullptr);
+            break;
+        case AST::NodeKind::FUNCTION_DECLARATION:
+            return false;
+        default:
+            break;
         }
+        return true;
+    });
+}
+
+void CodeGeneratorVisitor::summarizeLoop(AST::Statement& loop, LoopSummary& summary) const {
+    if (summary.summarized) {
+        return;
+    }
+    summary.summarized = true;
+    auto assign = [&summary](SymbolId id) { summary.assignments[id]++; };
+    AST::walk(loop, [&](AST::Node& node) {
+        switch (node.kind) {
+        case AST::NodeKind::ARITHMETIC: {
+            AST::Operand target = bound(static_cast<AST::ArithmeticStatement&>(node).target);
+            assign(assignedId(target));
+            summary.storyWrites.insert(storyKey(target));
+            break;
+        }
+        case AST::NodeKind::VARIABLE_DECLARATION: {
+            auto& declaration = static_cast<AST::VariableDeclaration&>(node);
+            assign(declaredId(declaration));
+            summary.storyWrites.insert(normalizedId(declaration.owner));
+            summary.storyWrites.insert(normalizedId(joinName(declaration.owner, declaration.varName)));
+            break;
+        }
+        case AST::NodeKind::RECORD_INSTANCE: {
+            auto& instance = static_cast<AST::RecordInstanceDeclaration&>(node);
+            SymbolId instanceId = declaredId(instance);
+            assign(instanceId);
+            std::string id(names->text(instanceId));
+            for (const auto& fieldValue : instance.fieldValues) {
+                assign(names->intern(id + "." + sanitizeIdentifier(fieldValue.first)));
+            }
+            break;
+        }
+        case AST::NodeKind::RANDOM: {
+            auto& random = static_cast<AST::RandomStatement&>(node);
+            assign(names->intern(sanitizeIdentifier(joinName(random.subject, "state random"))));
+            summary.storyWrites.insert(normalizedId(random.subject));
+            break;
+        }
+        case AST::NodeKind::FOR_RANGE: {
+            auto& range = static_cast<AST::ForRangeStatement&>(node);
+            assign(declaredId(range));
+            summary.storyWrites.insert(normalizedId(range.iterator));
+            break;
+        }
+        case AST::NodeKind::FOR_EACH: {
+            std::string_view iterator = static_cast<AST::ForEachStatement&>(node).iterator;
+            assign(names->intern(sanitizeIdentifier(iterator)));
+            summary.storyWrites.insert(normalizedId(iterator));
+            break;
+        }
+        case AST::NodeKind::FUNCTION_CALL:
+            summary.callsFunctions = true;
+            break;
+        default:
+            break;
+        }
+    });
+}
 
-        std::string leftId = resolveName(leftRaw);
-        std::string rightId = resolveName(rightRaw);
-        bool numericComparison = cppOp == ">" || cppOp == "<" || cppOp == ">=" || cppOp == "<=" ||
-                                 isNumberLiteral(rightRaw);
+void CodeGeneratorVisitor::addOperandReads(AST::Node& node, std::set<SymbolId>& reads) const {
+    auto read = [this, &reads](const AST::Operand& value) {
+        AST::Operand operand = bound(value);
+        if (operand.symbol != noSymbol) {
+            reads.insert(operand.symbol);
+        }
+    };
+    auto readCondition = [&read](const AST::Condition& condition) {
+        if (condition.kind != AST::Condition::Kind::NEVER) {
+            read(condition.left);
+        }
+        if (condition.kind == AST::Condition::Kind::COMPARISON) {
+            read(condition.right);
+        }
+    };
+    switch (node.kind) {
+    case AST::NodeKind::ARITHMETIC: {
+        auto& arithmetic = static_cast<AST::ArithmeticStatement&>(node);
+        read(arithmetic.left);
+        read(arithmetic.right);
+        break;
+    }
+    case AST::NodeKind::CONDITIONAL:
+        readCondition(static_cast<AST::ConditionalStatement&>(node).test);
+        break;
+    case AST::NodeKind::WHILE:
+        readCondition(static_cast<AST::WhileStatement&>(node).test);
+        break;
+    case AST::NodeKind::FOR_RANGE: {
+        auto& range = static_cast<AST::ForRangeStatement&>(node);
+        read(range.start);
+        read(range.end);
+        break;
+    }
+    case AST::NodeKind::RECORD_INSTANCE:
+        for (const auto& fieldValue : static_cast<AST::RecordInstanceDeclaration&>(node).fieldValues) {
+            read(fieldValue.second);
+        }
+        break;
+    case AST::NodeKind::IMAGE_DECLARATION: {
+        auto& image = static_cast<AST::ImageDeclaration&>(node);
+        read(image.width);
+        read(image.height);
+        break;
+    }
+    case AST::NodeKind::PIXEL_WRITE: {
+        auto& pixel = static_cast<AST::PixelWriteStatement&>(node);
+        read(pixel.x);
+        read(pixel.y);
+        read(pixel.red);
+        read(pixel.green);
+        read(pixel.blue);
+        break;
+    }
+    case AST::NodeKind::IMAGE_FILL: {
+        auto& fill = static_cast<AST::ImageFillStatement&>(node);
+        read(fill.red);
+        read(fill.green);
+        read(fill.blue);
+        break;
+    }
+    case AST::NodeKind::RECTANGLE_PAINT: {
+        auto& rectangle = static_cast<AST::RectanglePaintStatement&>(node);
+        read(rectangle.left);
+        read(rectangle.bottom);
+        read(rectangle.right);
+        read(rectangle.top);
+        read(rectangle.red);
+        read(rectangle.green);
+        read(rectangle.blue);
+        break;
+    }
+    default:
+        break;
+    }
+}
 
-        if (numericComparison) {
-            std::string leftExpr = leftId.empty() ? makeNumberLookup(leftRaw) : leftId;
-            std::string rightExpr = rightId.empty() ? rightRaw : rightId;
-            return leftExpr + " " + cppOp + " " + rightExpr;
+// A field is only invariant when neither it nor any record it belongs to is assigned.
+bool CodeGeneratorVisitor::isLoopInvariant(const AST::Operand& value, const LoopSummary& summary,
+                                           const std::set<SymbolId>& hoistedTargets) const {
+    AST::Operand operand = bound(value);
+    switch (operand.binding) {
+        case AST::Operand::Binding::SYMBOL:
+        case AST::Operand::Binding::FIELD: {
+            std::string id(names->text(operand.symbol));
+            for (size_t dot = id.find('.');; dot = id.find('.', dot + 1)) {
+                SymbolId prefix = dot == std::string::npos ? operand.symbol : names->intern(id.substr(0, dot));
+                if (summary.assignments.count(prefix) != 0 && hoistedTargets.count(prefix) == 0) {
+                    return false;
+                }
+                if (dot == std::string::npos) {
+                    return true;
+                }
+            }
         }
+        case AST::Operand::Binding::STORY_STATE:
+            return !summary.callsFunctions && summary.storyWrites.count(storyKey(operand)) == 0;
+        default:
+            return true;
+    }
+}
 
-        std::string leftKind = leftId.empty() ? "" : symbolKinds.at(leftId);
-        if (!leftId.empty() && leftKind == "string") {
-            std::string rightExpr = rightId.empty()
-                ? "\"" + escapeString(rightRaw) + "\""
-                : rightId;
-            return leftId + " " + cppOp + " " + rightExpr;
+bool CodeGeneratorVisitor::mayBeInteger(const AST::Operand& value) const {
+    AST::Operand operand = bound(value);
+    switch (operand.binding) {
+        case AST::Operand::Binding::SYMBOL:
+        case AST::Operand::Binding::FIELD:
+            return lookup(numbers, operand.symbol, KnownNumber()).type != KnownNumber::Type::NUMBER;
+        case AST::Operand::Binding::STORY_STATE:
+            return false;
+        default:
+            return operand.text.find('.') == std::string_view::npos;
+    }
+}
+
+// Emits, in front of the loop, the arithmetic in its body that computes the same value on
+// every pass. Only statements directly in the body qualify, so they run whenever a pass does,
+// and only ones that declare their target there, that are the only assignment to it in the
+// loop, that nothing in the loop reads it before, and that do not mirror it into a story
+// state. Running such a statement when the loop makes no pass then has no visible effect,
+// except for an int division, which is only moved when its divisor is known and nonzero.
+void CodeGeneratorVisitor::hoistInvariants(AST::Statement& loop, AST::NodeList<AST::Statement*>& body,
+                                           LoopSummary& summary) {
+    if (!storyReadsKnown ||
+        std::none_of(body.begin(), body.end(),
+                     [](AST::Statement* statement) { return statement->kind == AST::NodeKind::ARITHMETIC; })) {
+        return;
+    }
+    summarizeLoop(loop, summary);
+    std::set<SymbolId> reads;
+    addOperandReads(loop, reads);
+    std::set<SymbolId> hoistedTargets;
+    for (AST::Statement* statement : body) {
+        if (statement->kind == AST::NodeKind::ARITHMETIC) {
+            auto& arithmetic = static_cast<AST::ArithmeticStatement&>(*statement);
+            AST::Operand target = bound(arithmetic.target);
+            auto assignments = summary.assignments.find(target.symbol);
+            bool hoist = target.binding == AST::Operand::Binding::SYMBOL &&
+                         !isInitialized(target.symbol) &&
+                         reads.count(target.symbol) == 0 &&
+                         assignments != summary.assignments.end() && assignments->second == 1 &&
+                         !isStoryKeyRead(storyKey(target)) &&
+                         isLoopInvariant(arithmetic.left, summary, hoistedTargets) &&
+                         isLoopInvariant(arithmetic.right, summary, hoistedTargets);
+            if (hoist && arithmetic.operation == "divide" && mayBeInteger(arithmetic.left) &&
+                mayBeInteger(arithmetic.right)) {
+                KnownNumber divisor;
+                hoist = knownValue(arithmetic.right, divisor) && divisor.value != 0 && divisor.value != -1;
+            }
+            if (hoist) {
+                emitArithmetic(arithmetic);
+                hoistedStatements.insert(statement);
+                hoistedTargets.insert(target.symbol);
+                continue;
+            }
         }
+        AST::walk(*statement, [this, &reads](AST::Node& node) { addOperandReads(node, reads); });
+    }
+}
 
-        std::string leftExpr = leftId.empty() ? makeStateLookup(leftRaw) : leftId;
-        std::string rightExpr = rightId.empty()
-            ? "\"" + escapeString(rightRaw) + "\""
-            : rightId;
-        return leftExpr + " " + cppOp + " " + rightExpr;
+// Reads a literal the way the C++ compiler will: an int without a decimal point, a double
+// with one. Ints with a leading zero, which C++ reads as octal, or outside int are not kept.
+bool CodeGeneratorVisitor::parseNumber(std::string_view text, KnownNumber& number) {
+    if (!isNumberLiteral(text)) {
+        return false;
     }
+    std::string literal(text);
+    if (literal.find('.') != std::string::npos) {
+        char* end = nullptr;
+        double value = std::strtod(literal.c_str(), &end);
+        if (end != literal.c_str() + literal.size() || !std::isfinite(value)) {
+            return false;
+        }
+        number = KnownNumber{KnownNumber::Type::NUMBER, true, value};
+        return true;
+    }
+    size_t digits = literal[0] == '-' ? 1 : 0;
+    if (literal.size() - digits > 10 || (literal.size() - digits > 1 && literal[digits] == '0')) {
+        return false;
+    }
+    long long value = std::stoll(literal);
+    if (value < -INT_MAX || value > INT_MAX) {
+        return false;
+    }
+    number = KnownNumber{KnownNumber::Type::INTEGER, true, static_cast<double>(value)};
+    return true;
+}
 
-    return "storyCondition(\"" + escapeString(conditionKey) + "\")";
+// Folds the way the emitted expression would be evaluated: in int when both sides are ints,
+// otherwise in double. Results the program would not compute the same way at run time, such as
+// a division by zero or an overflow, are left to it.
+bool CodeGeneratorVisitor::foldArithmetic(char op, const KnownNumber& left, const KnownNumber& right,
+                                          KnownNumber& result) {
+    if (left.type == KnownNumber::Type::INTEGER && right.type == KnownNumber::Type::INTEGER) {
+        long long a = static_cast<long long>(left.value);
+        long long b = static_cast<long long>(right.value);
+        long long value = 0;
+        switch (op) {
+            case '+': value = a + b; break;
+            case '-': value = a - b; break;
+            case '*': value = a * b; break;
+            default:
+                if (b == 0) {
+                    return false;
+                }
+                value = a / b;
+                break;
+        }
+        if (value < INT_MIN || value > INT_MAX) {
+            return false;
+        }
+        result = KnownNumber{KnownNumber::Type::INTEGER, true, static_cast<double>(value)};
+        return true;
+    }
+    double value = 0;
+    switch (op) {
+        case '+': value = left.value + right.value; break;
+        case '-': value = left.value - right.value; break;
+        case '*': value = left.value * right.value; break;
+        default: value = left.value / right.value; break;
+    }
+    if (!std::isfinite(value)) {
+        return false;
+    }
+    result = KnownNumber{KnownNumber::Type::NUMBER, true, value};
+    return true;
 }
 
-std::string CodeGeneratorVisitor::numericExpression(const std::string& value) const {
-    if (isNumberLiteral(value)) {
-        return value;
+std::string CodeGeneratorVisitor::numberLiteral(const KnownNumber& number) {
+    if (number.type == KnownNumber::Type::INTEGER) {
+        return std::to_string(static_cast<int>(number.value));
     }
-    std::string id = resolveName(value);
-    if (!id.empty()) {
-        return id;
+    char digits[32];
+    auto result = std::to_chars(digits, digits + sizeof(digits), number.value);
+    std::string literal(digits, result.ptr);
+    if (literal.find_first_of(".e") == std::string::npos) {
+        literal += ".0";
     }
-    return "getStoryNumber(\"" + escapeString(normalizeName(value)) + "\")";
+    return literal;
 }
 
-std::string CodeGeneratorVisitor::cppTypeFor(const std::string& typeName) const {
-    std::string normalized = normalizeName(typeName);
+std::string CodeGeneratorVisitor::cppTypeFor(std::string_view typeName) const {
+    SymbolId normalizedKey = normalizedId(typeName);
+    std::string_view normalized = names->text(normalizedKey);
     if (normalized == "number" || normalized == "numeric" ||
         normalized == "decimal" || normalized == "double" || normalized == "float") {
         return "double";
@@ -408,14 +956,14 @@ std::string CodeGeneratorVisitor::cppTypeFor(const std::string& typeName) const
         return "bool";
     }
 
-    auto it = recordTypeAliases.find(normalized);
-    if (it != recordTypeAliases.end()) {
-        return it->second;
+    SymbolId alias = lookup(recordTypeAliases, normalizedKey, noSymbol);
+    if (alias != noSymbol) {
+        return std::string(names->text(alias));
     }
     return sanitizeTypeName(typeName);
 }
 
-std::string CodeGeneratorVisitor::cppDefaultValueFor(const std::string& typeName) const {
+std::string CodeGeneratorVisitor::cppDefaultValueFor(std::string_view typeName) const {
     std::string cppType = cppTypeFor(typeName);
     if (cppType == "std::string") {
         return "\"\"";
@@ -429,49 +977,50 @@ std::string CodeGeneratorVisitor::cppDefaultValueFor(const std::string& typeName
     return "{}";
 }
 
-std::string CodeGeneratorVisitor::kindForType(const std::string& typeName) const {
+CodeGeneratorVisitor::SymbolKind CodeGeneratorVisitor::kindForType(std::string_view typeName) const {
     std::string cppType = cppTypeFor(typeName);
     if (cppType == "std::string") {
-        return "string";
+        return SymbolKind::STRING;
     }
     if (cppType == "bool") {
-        return "bool";
+        return SymbolKind::BOOL;
     }
     if (cppType == "int" || cppType == "double") {
-        return "number";
+        return SymbolKind::NUMBER;
     }
-    return "record:" + cppType;
+    return SymbolKind::RECORD;
 }
 
-std::string CodeGeneratorVisitor::fieldTypeFor(const std::string& recordType, const std::string& fieldName) const {
-    auto it = recordTypes.find(recordType);
-    if (it == recordTypes.end()) {
+std::string CodeGeneratorVisitor::fieldTypeFor(SymbolId recordType, std::string_view fieldName) const {
+    const RecordType* type = recordTypeFor(recordType);
+    if (type == nullptr) {
         return "";
     }
-    std::string normalizedField = normalizeName(fieldName);
-    for (const auto& field : it->second) {
-        if (normalizeName(field.sourceName) == normalizedField || normalizeName(field.cppName) == normalizedField) {
+    SymbolId normalizedField = normalizedId(fieldName);
+    for (const auto& field : type->fields) {
+        if (field.sourceKey == normalizedField || field.cppKey == normalizedField) {
             return field.typeName;
         }
     }
     return "";
 }
 
-std::string CodeGeneratorVisitor::typedExpression(const std::string& value, const std::string& typeName) const {
+std::string CodeGeneratorVisitor::typedExpression(const AST::Operand& value, const std::string& typeName) const {
     std::string cppType = cppTypeFor(typeName);
-    std::string resolved = resolveName(value);
+    AST::Operand operand = bound(value);
+    std::string resolved = operand.symbol != noSymbol ? std::string(names->text(operand.symbol)) : "";
 
     if (cppType == "double" || cppType == "int") {
-        return numericExpression(value);
+        return numericExpression(operand);
     }
     if (cppType == "std::string") {
         if (!resolved.empty()) {
             return resolved;
         }
-        return "\"" + escapeString(value) + "\"";
+        return "\"" + escapeString(operand.text) + "\"";
     }
     if (cppType == "bool") {
-        std::string normalized = normalizeName(value);
+        std::string_view normalized = operand.key != noSymbol ? names->text(operand.key) : std::string_view();
         if (normalized == "true" || normalized == "yes" || normalized == "right") {
             return "true";
         }
@@ -486,134 +1035,203 @@ std::string CodeGeneratorVisitor::typedExpression(const std::string& value, cons
     if (!resolved.empty()) {
         return resolved;
     }
-    return sanitizeIdentifier(value);
+    return sanitizeIdentifier(operand.text);
 }
 
-void CodeGeneratorVisitor::registerDeclaration(const AST::VariableDeclaration& node) {
-    std::string id = variableNameFor(node);
-    std::string kind = node.isCollection() ? "collection" : (isNumberLiteral(node.value) ? "number" : "string");
-    symbolKinds[id] = kind;
+void CodeGeneratorVisitor::registerDeclaration(const ProgramInfo& program, const ProgramInfo::Declaration& declaration) {
+    switch (declaration.kind) {
+        case ProgramInfo::Declaration::Kind::VARIABLE:
+            registerVariable(declaration.owner, declaration.name, declaration.collection, declaration.numeric);
+            break;
+        case ProgramInfo::Declaration::Kind::RECORD_TYPE:
+            registerRecordType(*program.records[declaration.record]);
+            break;
+        case ProgramInfo::Declaration::Kind::RECORD_INSTANCE:
+            registerRecordInstance(declaration.owner, declaration.name);
+            break;
+        case ProgramInfo::Declaration::Kind::ARITHMETIC_TARGET:
+            registerArithmeticTarget(declaration.owner);
+            break;
+        case ProgramInfo::Declaration::Kind::RANGE_ITERATOR:
+            bindSymbol(normalizedId(declaration.owner), names->intern(sanitizeIdentifier(declaration.owner)),
+                       SymbolKind::NUMBER);
+            break;
+    }
+}
 
-    symbols[normalizeName(node.owner + " " + node.varName)] = id;
-    symbols[normalizeName(node.varName)] = id;
-    if (node.varName == "state" || node.isCollection()) {
-        symbols[normalizeName(node.owner)] = id;
+void CodeGeneratorVisitor::registerVariable(std::string_view owner, std::string_view varName, bool collection,
+                                            bool numeric) {
+    SymbolId id = names->intern(variableNameFor(owner, varName, collection));
+    SymbolKind kind = collection ? SymbolKind::COLLECTION : (numeric ? SymbolKind::NUMBER : SymbolKind::STRING);
+
+    bindSymbol(normalizedId(joinName(owner, varName)), id, kind);
+    bindSymbol(normalizedId(varName), id, kind);
+    if (varName == "state" || collection) {
+        bindSymbol(normalizedId(owner), id, kind);
     }
-    if (node.isCollection()) {
-        declaredCollections.insert(id);
+    if (collection) {
+        declaredCollections.emplace(names->text(id));
     }
 }
 
-void CodeGeneratorVisitor::registerArithmeticTarget(const AST::ArithmeticStatement& node) {
-    std::string normalized = normalizeName(node.target);
-    if (symbols.find(normalized) != symbols.end()) {
+void CodeGeneratorVisitor::registerArithmeticTarget(std::string_view target) {
+    SymbolId normalized = normalizedId(target);
+    if (lookup(symbols, normalized, noSymbol) != noSymbol) {
         return;
     }
-    std::string id = sanitizeIdentifier(node.target);
-    symbols[normalized] = id;
-    symbolKinds[id] = "number";
+    bindSymbol(normalized, names->intern(sanitizeIdentifier(target)), SymbolKind::NUMBER);
 }
 
 void CodeGeneratorVisitor::registerRecordType(const AST::RecordDeclaration& node) {
     std::string typeId = sanitizeTypeName(node.name);
-    recordTypeAliases[normalizeName(node.name)] = typeId;
+    growTo(recordTypeAliases, normalizedId(node.name), noSymbol) = names->intern(typeId);
 
     std::vector<RecordField> fields;
     for (const auto& field : node.fields) {
-        fields.push_back(RecordField{field.first, sanitizeIdentifier(field.first), field.second});
+        std::string cppName = sanitizeIdentifier(field.first);
+        fields.push_back(RecordField{std::string(field.first), cppName, std::string(field.second),
+                                     normalizedId(field.first), normalizedId(cppName)});
     }
-    recordTypes[typeId] = fields;
+    RecordType& type = growTo(recordTypes, names->intern(typeId));
+    type.declared = true;
+    type.fields = std::move(fields);
 }
 
-void CodeGeneratorVisitor::registerRecordInstance(const AST::RecordInstanceDeclaration& node) {
-    std::string id = variableNameFor(node);
-    std::string typeId = cppTypeFor(node.typeName);
-    symbols[normalizeName(node.name)] = id;
-    symbolKinds[id] = "record:" + typeId;
+void CodeGeneratorVisitor::registerRecordInstance(std::string_view name, std::string_view typeName) {
+    std::string id = sanitizeIdentifier(name);
+    bindSymbol(normalizedId(name), names->intern(id), SymbolKind::RECORD);
 
-    registerRecordFieldSymbols(node.name, id, typeId, 0);
+    registerRecordFieldSymbols(std::string(name), id, names->intern(cppTypeFor(typeName)), 0);
 }
 
 void CodeGeneratorVisitor::registerRecordFieldSymbols(const std::string& sourcePrefix,
                                                        const std::string& cppPrefix,
-                                                       const std::string& recordType,
+                                                       SymbolId recordType,
                                                        int depth) {
     if (depth > 4) {
         return;
     }
 
-    auto typeIt = recordTypes.find(recordType);
-    if (typeIt == recordTypes.end()) {
+    const RecordType* type = recordTypeFor(recordType);
+    if (type == nullptr) {
         return;
     }
-    for (const auto& field : typeIt->second) {
+    for (const auto& field : type->fields) {
         std::string fieldAccess = cppPrefix + "." + field.cppName;
-        symbols[normalizeName(sourcePrefix + " " + field.sourceName)] = fieldAccess;
-        symbolKinds[fieldAccess] = kindForType(field.typeName);
+        bindSymbol(normalizedId(sourcePrefix + " " + field.sourceName), names->intern(fieldAccess),
+                   kindForType(field.typeName));
 
-        std::string nestedType = cppTypeFor(field.typeName);
-        if (recordTypes.find(nestedType) != recordTypes.end()) {
+        SymbolId nestedType = names->intern(cppTypeFor(field.typeName));
+        if (recordTypeFor(nestedType) != nullptr) {
             registerRecordFieldSymbols(sourcePrefix + " " + field.sourceName, fieldAccess, nestedType, depth + 1);
         }
     }
 }
 
-void CodeGeneratorVisitor::visit(AST::NarrativeStatement& node) {
-    oss << indent() << "std::cout << \"" << escapeString(node.text) << "\" << std::endl;\n";
+// Compound statements push their body here instead of visiting it. The outermost one emits
+// every open body in turn, so the call depth stays the same however deep the story nests.
+void CodeGeneratorVisitor::openBlock(AST::Statement& statement, AST::NodeList<AST::Statement*>& body,
+                                     bool previousSkip) {
+    openBlocks.push_back({&statement, body.begin(), body.end(), false, previousSkip});
+    if (emittingBlocks) {
+        return;
+    }
+    emittingBlocks = true;
+    try {
+        while (!openBlocks.empty()) {
+            OpenBlock& open = openBlocks.back();
+            if (open.next != open.end) {
+                AST::dispatch(**open.next++, *this);
+            } else {
+                closeBlock();
+            }
+        }
+    } catch (...) {
+        openBlocks.clear();
+        emittingBlocks = false;
+        throw;
+    }
+    emittingBlocks = false;
 }
 
-void CodeGeneratorVisitor::visit(AST::ConditionalStatement& node) {
-    oss << indent() << "if (" << translateCondition(node.condition) << ") {\n";
-    indentLevel++;
-    for (auto& stmt : node.thenBranch) {
-        stmt->accept(*this);
-    }
+void CodeGeneratorVisitor::closeBlock() {
+    OpenBlock& open = openBlocks.back();
     indentLevel--;
-    oss << indent() << "}";
-    if (!node.elseBranch.empty()) {
-        oss << " else {\n";
-        indentLevel++;
-        for (auto& stmt : node.elseBranch) {
-            stmt->accept(*this);
+    switch (open.statement->kind) {
+    case AST::NodeKind::CONDITIONAL: {
+        auto& node = static_cast<AST::ConditionalStatement&>(*open.statement);
+        if (open.elseBranch) {
+            out << indent() << "}\n";
+        } else if (!node.elseBranch.empty()) {
+            out << indent() << "} else {\n";
+            indentLevel++;
+            open.next = node.elseBranch.begin();
+            open.end = node.elseBranch.end();
+            open.elseBranch = true;
+            return;
+        } else {
+            out << indent() << "}\n";
         }
-        indentLevel--;
-        oss << indent() << "}\n";
-    } else {
-        oss << "\n";
+        break;
     }
+    case AST::NodeKind::FUNCTION_DECLARATION:
+        skipFunctionDeclarations = open.previousSkip;
+        out << "}\n\n";
+        break;
+    default:
+        out << indent() << "}\n";
+        break;
+    }
+    openBlocks.pop_back();
+}
+
+void CodeGeneratorVisitor::visit(AST::NarrativeStatement& node) {
+    out << indent() << "std::cout << \"" << escapeString(node.text) << "\" << std::endl;\n";
+}
+
+void CodeGeneratorVisitor::visit(AST::ConditionalStatement& node) {
+    out << indent() << "if (" << translateCondition(node.test) << ") {\n";
+    if (foldingConstants && openBlocks.empty()) {
+        forgetAssignments(node);
+    }
+    indentLevel++;
+    openBlock(node, node.thenBranch);
 }
 
 void CodeGeneratorVisitor::visit(AST::InteractiveStatement& node) {
     int inputId = tempCounter++;
-    oss << indent() << "{\n";
+    out << indent() << "{\n";
     indentLevel++;
-    oss << indent() << "std::cout << \"" << escapeString(node.prompt) << " \";\n";
-    oss << indent() << "std::string userInput" << inputId << ";\n";
-    oss << indent() << "std::getline(std::cin, userInput" << inputId << ");\n";
+    out << indent() << "std::cout << \"" << escapeString(node.prompt) << " \";\n";
+    out << indent() << "std::string userInput" << inputId << ";\n";
+    out << indent() << "std::getline(std::cin, userInput" << inputId << ");\n";
     indentLevel--;
-    oss << indent() << "}\n";
+    out << indent() << "}\n";
 }
 
 void CodeGeneratorVisitor::visit(AST::RandomStatement& node) {
-    std::string subjectKey = normalizeName(node.subject);
-    std::string stateName = sanitizeIdentifier(node.subject + " state random");
-    oss << indent() << "bool randomChoice = getRandomBool();\n";
-    oss << indent() << "std::string " << stateName << " = randomChoice ? \""
+    SymbolId subjectKey = normalizedId(node.subject);
+    std::string stateName = sanitizeIdentifier(joinName(node.subject, "state random"));
+    out << indent() << "bool randomChoice = getRandomBool();\n";
+    out << indent() << "std::string " << stateName << " = randomChoice ? \""
         << escapeString(node.randomStates.first) << "\" : \""
         << escapeString(node.randomStates.second) << "\";\n";
-    oss << indent() << "storyStates[\"" << escapeString(subjectKey) << "\"] = " << stateName << ";\n";
-    oss << indent() << "std::cout << \"The " << escapeString(node.subject) << " was \" << "
+    if (isStoryKeyRead(subjectKey)) {
+        out << indent() << "setStoryState(" << storySlot(subjectKey) << ", " << stateName << ");\n";
+    }
+    out << indent() << "std::cout << \"The " << escapeString(node.subject) << " was \" << "
         << stateName << " << \".\" << std::endl;\n";
 }
 
 void CodeGeneratorVisitor::visit(AST::WhileStatement& node) {
-    oss << indent() << "while (" << translateCondition(node.condition) << ") {\n";
-    indentLevel++;
-    for (auto& stmt : node.body) {
-        stmt->accept(*this);
+    if (foldingConstants && openBlocks.empty()) {
+        forgetAssignments(node);
     }
-    indentLevel--;
-    oss << indent() << "}\n";
+    LoopSummary summary;
+    hoistInvariants(node, node.body, summary);
+    out << indent() << "while (" << translateCondition(node.test) << ") {\n";
+    indentLevel++;
+    openBlock(node, node.body);
 }
 
 void CodeGeneratorVisitor::visit(AST::ForEachStatement& node) {
@@ -623,31 +1241,48 @@ void CodeGeneratorVisitor::visit(AST::ForEachStatement& node) {
     }
     std::string iteratorName = sanitizeIdentifier(node.iterator);
     collectionsUsed.insert(collectionName);
-    oss << indent() << "for (const auto& " << iteratorName << " : " << collectionName << ") {\n";
-    indentLevel++;
-    for (auto& stmt : node.body) {
-        stmt->accept(*this);
+    if (foldingConstants && openBlocks.empty()) {
+        forgetAssignments(node);
     }
-    indentLevel--;
-    oss << indent() << "}\n";
+    out << indent() << "for (const auto& " << iteratorName << " : " << collectionName << ") {\n";
+    indentLevel++;
+    openBlock(node, node.body);
 }
 
 void CodeGeneratorVisitor::visit(AST::ForRangeStatement& node) {
-    std::string iteratorName = sanitizeIdentifier(node.iterator);
+    SymbolId iteratorId = declaredId(node);
+    std::string_view iteratorName = names->text(iteratorId);
     std::string startExpr = numericExpression(node.start);
+    if (foldingConstants && openBlocks.empty()) {
+        forgetAssignments(node);
+    }
+    LoopSummary summary;
+    hoistInvariants(node, node.body, summary);
+
+    // A bound that no pass can change is converted once, in the loop header.
     std::string endExpr = numericExpression(node.end);
-    oss << indent() << "for (int " << iteratorName << " = static_cast<int>(" << startExpr
-        << "); " << iteratorName << " < static_cast<int>(" << endExpr << "); ++"
-        << iteratorName << ") {\n";
-    indentLevel++;
-    initializedSymbols.insert(iteratorName);
-    symbols[normalizeName(node.iterator)] = iteratorName;
-    symbolKinds[iteratorName] = "number";
-    for (auto& stmt : node.body) {
-        stmt->accept(*this);
+    KnownNumber endValue;
+    bool hoistEnd = false;
+    if (storyReadsKnown && bound(node.end).binding != AST::Operand::Binding::LITERAL &&
+        !knownValue(node.end, endValue)) {
+        summarizeLoop(node, summary);
+        hoistEnd = isLoopInvariant(node.end, summary, {});
+    }
+    if (hoistEnd) {
+        std::string endName = "rangeEnd" + std::to_string(tempCounter++);
+        out << indent() << "for (int " << iteratorName << " = static_cast<int>(" << startExpr << "), "
+            << endName << " = static_cast<int>(" << endExpr << "); " << iteratorName << " < " << endName
+            << "; ++" << iteratorName << ") {\n";
+    } else {
+        out << indent() << "for (int " << iteratorName << " = static_cast<int>(" << startExpr
+            << "); " << iteratorName << " < static_cast<int>(" << endExpr << "); ++"
+            << iteratorName << ") {\n";
     }
-    indentLevel--;
-    oss << indent() << "}\n";
+    indentLevel++;
+    markInitialized(iteratorId);
+    setNumberType(iteratorId, KnownNumber::Type::INTEGER);
+    bindSymbol(normalizedId(node.iterator), iteratorId, SymbolKind::NUMBER);
+    openBlock(node, node.body);
 }
 
 void CodeGeneratorVisitor::visit(AST::FunctionDeclaration& node) {
@@ -655,181 +1290,322 @@ void CodeGeneratorVisitor::visit(AST::FunctionDeclaration& node) {
         return;
     }
 
-    oss << "void " << node.name << "() {\n";
+    out << "void " << node.name << "() {\n";
     indentLevel++;
     bool previousSkip = skipFunctionDeclarations;
     skipFunctionDeclarations = true;
-    for (auto& stmt : node.body) {
-        stmt->accept(*this);
-    }
-    skipFunctionDeclarations = previousSkip;
-    indentLevel--;
-    oss << "}\n\n";
+    openBlock(node, node.body, previousSkip);
 }
 
 void CodeGeneratorVisitor::visit(AST::FunctionCall& node) {
-    oss << indent() << node.name << "();\n";
+    out << indent() << node.name << "();\n";
 }
 
 void CodeGeneratorVisitor::visit(AST::ReturnStatement& node) {
-    oss << indent() << "return;\n";
+    out << indent() << "return;\n";
 }
 
 void CodeGeneratorVisitor::visit(AST::CommentStatement& node) {
 }
 
 void CodeGeneratorVisitor::visit(AST::Story& node) {
-    imageRuntimeRequired = false;
-    collectImageUsage(&node);
+    beginStory(node.names);
+    ProgramAnalyzer analyzer;
+    for (auto& stmt : node.statements) {
+        analyzer.analyze(*stmt);
+    }
+    beginStoryMain(analyzer.finish());
+    for (auto& stmt : node.statements) {
+        emitStoryStatement(*stmt);
+    }
+    endStory();
+}
 
+void CodeGeneratorVisitor::beginStory(StringInterner& names) {
+    this->names = &names;
+    normalizedNames.clear();
+    imageRuntimeRequired = false;
     recordTypes.clear();
     recordTypeAliases.clear();
-    std::vector<AST::RecordDeclaration*> records;
-    collectRecords(&node, records);
-    for (auto* record : records) {
+    collectionsUsed.clear();
+    declaredCollections.clear();
+    symbols.clear();
+    symbolKinds.clear();
+    initializedSymbols.clear();
+    readStoryKeys.clear();
+    storyReadsKnown = false;
+    numbers.clear();
+    hoistedStatements.clear();
+    deferredDeclarations.clear();
+    deferredIds.clear();
+    foldingConstants = false;
+}
+
+void CodeGeneratorVisitor::beginStoryMain(const ProgramInfo& program) {
+    imageRuntimeRequired = program.usesImages;
+    for (auto* record : program.records) {
         registerRecordType(*record);
     }
+    for (const auto& declaration : program.declarations) {
+        registerDeclaration(program, declaration);
+    }
+    std::set<std::string_view> storyKeys;
+    for (const auto& flag : program.storyFlags) {
+        SymbolId key = normalizedId(flag);
+        growTo(readStoryKeys, key, char(0)) = 1;
+        storyKeys.insert(names->text(key));
+    }
+    for (const auto& operand : program.storyOperands) {
+        SymbolId key = normalizedId(operand);
+        if (lookup(symbols, key, noSymbol) == noSymbol) {
+            growTo(readStoryKeys, key, char(0)) = 1;
+            storyKeys.insert(names->text(key));
+        }
+    }
+    storyReadsKnown = true;
+
+    for (const auto& collection : program.collections) {
+        std::string collectionName = resolveName(collection);
+        if (collectionName.empty()) {
+            collectionName = sanitizeIdentifier(collection);
+        }
+        collectionsUsed.insert(collectionName);
+    }
 
-    oss << "#include <iostream>\n";
-    oss << "#include <string>\n";
-    oss << "#include <vector>\n";
-    oss << "#include <cstdlib>\n";
-    oss << "#include <ctime>\n";
-    oss << "#include <unordered_map>\n";
+    out << "#include <iostream>\n";
+    out << "#include <string>\n";
+    out << "#include <vector>\n";
+    out << "#include <cstdlib>\n";
+    out << "#include <ctime>\n";
+    if (!storyKeys.empty()) {
+        out << "#include <cerrno>\n";
+    }
     if (imageRuntimeRequired) {
-        oss << "#include <algorithm>\n";
-        oss << "#include <filesystem>\n";
-        oss << "#include <fstream>\n";
+        out << "#include <algorithm>\n";
+        out << "#include <filesystem>\n";
+        out << "#include <fstream>\n";
     }
-    oss << "\n";
+    out << "\n";
 
     generateRandomizer();
-    generateStoryStateHelpers();
+    if (!storyKeys.empty()) {
+        generateStoryStateHelpers(storyKeys);
+    }
     if (imageRuntimeRequired) {
         generateImageRuntime();
     }
 
-    if (!records.empty()) {
+    if (!program.records.empty()) {
         skipRecordDeclarations = false;
-        for (auto* record : records) {
-            record->accept(*this);
+        for (auto* record : program.records) {
+            visit(*record);
         }
     }
 
-    collectionsUsed.clear();
-    declaredCollections.clear();
-    symbols.clear();
-    symbolKinds.clear();
-    initializedSymbols.clear();
-    collectDeclarations(&node);
-    collectCollections(&node);
-
-    std::vector<AST::FunctionDeclaration*> functions;
-    collectFunctions(&node, functions);
-    for (auto* function : functions) {
-        oss << "void " << function->name << "();\n";
+    for (auto* function : program.functions) {
+        out << "void " << function->name << "();\n";
     }
-    if (!functions.empty()) {
-        oss << "\n";
+    if (!program.functions.empty()) {
+        out << "\n";
         skipFunctionDeclarations = false;
-        for (auto* function : functions) {
-            function->accept(*this);
+        for (auto* function : program.functions) {
+            for (auto& stmt : function->body) {
+                resolveOperands(stmt);
+            }
+            visit(*function);
         }
     }
 
-    oss << "int main() {\n";
+    out << "int main() {\n";
     indentLevel++;
-    oss << indent() << "std::srand(static_cast<unsigned int>(std::time(nullptr)));\n\n";
+    out << indent() << "std::srand(static_cast<unsigned int>(std::time(nullptr)));\n\n";
 
     for (const auto& col : collectionsUsed) {
         if (declaredCollections.find(col) == declaredCollections.end()) {
-            oss << indent() << "std::vector<std::string> " << col << " = {};\n";
+            out << indent() << "std::vector<std::string> " << col << " = {};\n";
         }
     }
     if (!collectionsUsed.empty()) {
-        oss << "\n";
+        out << "\n";
     }
 
     skipFunctionDeclarations = true;
     skipRecordDeclarations = true;
-    for (auto& stmt : node.statements) {
-        stmt->accept(*this);
+    foldingConstants = true;
+}
+
+void CodeGeneratorVisitor::emitStoryStatement(AST::Statement& statement) {
+    resolveOperands(&statement);
+    // The statement is written after the deferred declarations it names, including any it
+    // made itself.
+    std::swap(out, statementOutput);
+    try {
+        AST::dispatch(statement, *this);
+    } catch (...) {
+        std::swap(out, statementOutput);
+        statementOutput.take();
+        throw;
+    }
+    std::swap(out, statementOutput);
+    std::string code = statementOutput.take();
+    if (!deferredDeclarations.empty()) {
+        writeDeferredDeclarations(code);
+    }
+    out << code;
+}
+
+void CodeGeneratorVisitor::deferDeclaration(SymbolId id, std::string code) {
+    std::string_view name = names->text(id);
+    deferredDeclarations.push_back({name, std::move(code)});
+    deferredIds.insert(name);
+}
+
+// Writes the deferred declarations the code names, in the order they were made. Names reached
+// through '.' or '::' are members, not the variables of the story main.
+void CodeGeneratorVisitor::writeDeferredDeclarations(std::string_view code) {
+    auto isIdentifierChar = [](char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_'; };
+    std::unordered_set<std::string_view> named;
+    for (size_t i = 0; i < code.size();) {
+        if (!isIdentifierChar(code[i])) {
+            ++i;
+            continue;
+        }
+        size_t start = i;
+        while (i < code.size() && isIdentifierChar(code[i])) {
+            ++i;
+        }
+        std::string_view word = code.substr(start, i - start);
+        bool member = start > 0 && (code[start - 1] == '.' || code[start - 1] == ':');
+        if (!member && deferredIds.count(word) != 0) {
+            named.insert(word);
+        }
+    }
+    if (named.empty()) {
+        return;
+    }
+    std::vector<DeferredDeclaration> remaining;
+    for (auto& declaration : deferredDeclarations) {
+        if (named.count(declaration.id) != 0) {
+            out << declaration.code;
+        } else {
+            remaining.push_back(std::move(declaration));
+        }
     }
+    deferredDeclarations = std::move(remaining);
+    for (std::string_view id : named) {
+        deferredIds.erase(id);
+    }
+}
+
+void CodeGeneratorVisitor::endStory() {
     skipRecordDeclarations = false;
     skipFunctionDeclarations = false;
+    foldingConstants = false;
+    deferredDeclarations.clear();
+    deferredIds.clear();
 
-    oss << "\n" << indent() << "return 0;\n";
+    out << "\n" << indent() << "return 0;\n";
     indentLevel--;
-    oss << "}\n";
+    out << "}\n";
 }
 
 void CodeGeneratorVisitor::visit(AST::VariableDeclaration& node) {
-    std::string id = variableNameFor(node);
+    SymbolId symbol = declaredId(node);
+    std::string_view id = names->text(symbol);
     if (node.isCollection()) {
-        oss << indent() << "std::vector<std::string> " << id << " = {";
+        out << indent() << "std::vector<std::string> " << id << " = {";
         for (size_t i = 0; i < node.values.size(); ++i) {
             if (i > 0) {
-                oss << ", ";
+                out << ", ";
             }
-            oss << "\"" << escapeString(node.values[i]) << "\"";
+            out << "\"" << escapeString(node.values[i]) << "\"";
         }
-        oss << "};\n";
+        out << "};\n";
         return;
     }
 
-    if (isNumberLiteral(node.value)) {
-        std::string type = node.value.find('.') == std::string::npos ? "int" : "double";
-        oss << indent() << type << " " << id << " = " << node.value << ";\n";
-        initializedSymbols.insert(id);
-        oss << indent() << "storyStates[\"" << escapeString(normalizeName(node.owner + " " + node.varName))
-            << "\"] = std::to_string(" << id << ");\n";
-    } else {
-        oss << indent() << "std::string " << id << " = \"" << escapeString(node.value) << "\";\n";
-        initializedSymbols.insert(id);
-        if (node.varName == "state") {
-            oss << indent() << "storyStates[\"" << escapeString(normalizeName(node.owner)) << "\"] = " << id << ";\n";
+    bool numeric = isNumberLiteral(node.value);
+    SymbolId key = !numeric && node.varName == "state" ? normalizedId(node.owner)
+                                                       : normalizedId(joinName(node.owner, node.varName));
+    if (numeric) {
+        bool integer = node.value.find('.') == std::string::npos;
+        std::string declaration =
+            std::string(indent()) + (integer ? "int " : "double ") + std::string(id) + " = " + std::string(node.value) + ";\n";
+        if (foldingConstants && openBlocks.empty() && !isStoryKeyRead(key)) {
+            deferDeclaration(symbol, std::move(declaration));
         } else {
-            oss << indent() << "storyStates[\"" << escapeString(normalizeName(node.owner + " " + node.varName))
-                << "\"] = " << id << ";\n";
+            out << declaration;
         }
+        setNumberType(symbol, integer ? KnownNumber::Type::INTEGER : KnownNumber::Type::NUMBER);
+        KnownNumber value;
+        assignNumber(symbol, parseNumber(node.value, value) ? &value : nullptr);
+    } else {
+        out << indent() << "std::string " << id << " = \"" << escapeString(node.value) << "\";\n";
+        setNumberType(symbol, KnownNumber::Type::UNKNOWN);
+    }
+    markInitialized(symbol);
+
+    if (isStoryKeyRead(key)) {
+        out << indent() << "setStoryState(" << storySlot(key) << ", " << id << ");\n";
     }
 }
 
 void CodeGeneratorVisitor::visit(AST::VariableDeclarationBlock& node) {
-    for (auto& decl : node.declarations) {
-        decl->accept(*this);
+    for (auto* decl : node.declarations) {
+        visit(*decl);
     }
 }
 
 void CodeGeneratorVisitor::visit(AST::ArithmeticStatement& node) {
-    std::string targetId = resolveName(node.target);
-    if (targetId.empty()) {
-        targetId = sanitizeIdentifier(node.target);
+    if (!hoistedStatements.empty() && hoistedStatements.erase(&node) != 0) {
+        return;
     }
+    emitArithmetic(node);
+}
 
-    std::string cppOperator;
+void CodeGeneratorVisitor::emitArithmetic(AST::ArithmeticStatement& node) {
+    AST::Operand target = bound(node.target);
+    SymbolId targetSymbol = assignedId(target);
+    std::string_view targetId = names->text(targetSymbol);
+
+    char cppOperator;
     if (node.operation == "add") {
-        cppOperator = "+";
+        cppOperator = '+';
     } else if (node.operation == "subtract") {
-        cppOperator = "-";
+        cppOperator = '-';
     } else if (node.operation == "multiply") {
-        cppOperator = "*";
+        cppOperator = '*';
     } else if (node.operation == "divide") {
-        cppOperator = "/";
+        cppOperator = '/';
     } else {
-        throw std::runtime_error("Unsupported arithmetic operation: " + node.operation);
-    }
-
-    std::string expr = numericExpression(node.left) + " " + cppOperator + " " + numericExpression(node.right);
-    bool targetsField = targetId.find('.') != std::string::npos;
-    if (!targetsField && initializedSymbols.find(targetId) == initializedSymbols.end()) {
-        oss << indent() << "double " << targetId << " = " << expr << ";\n";
-        initializedSymbols.insert(targetId);
+        throw std::runtime_error("Unsupported arithmetic operation: " + std::string(node.operation));
+    }
+
+    KnownNumber left;
+    KnownNumber right;
+    KnownNumber result;
+    bool folded = knownValue(node.left, left) && knownValue(node.right, right) &&
+                  foldArithmetic(cppOperator, left, right, result);
+    std::string expr = folded ? numberLiteral(result)
+                              : numericExpression(node.left) + " " + cppOperator + " " + numericExpression(node.right);
+    bool targetsField = target.binding == AST::Operand::Binding::FIELD;
+    SymbolId key = storyKey(target);
+    if (!targetsField && !isInitialized(targetSymbol)) {
+        std::string declaration = std::string(indent()) + "double " + std::string(targetId) + " = " + expr + ";\n";
+        if (folded && foldingConstants && openBlocks.empty() && !isStoryKeyRead(key)) {
+            deferDeclaration(targetSymbol, std::move(declaration));
+        } else {
+            out << declaration;
+        }
+        markInitialized(targetSymbol);
+        setNumberType(targetSymbol, KnownNumber::Type::NUMBER);
     } else {
-        oss << indent() << targetId << " = " << expr << ";\n";
+        out << indent() << targetId << " = " << expr << ";\n";
+    }
+    assignNumber(targetSymbol, folded ? &result : nullptr);
+    if (isStoryKeyRead(key)) {
+        out << indent() << "setStoryState(" << storySlot(key) << ", " << targetId << ");\n";
     }
-    oss << indent() << "storyStates[\"" << escapeString(normalizeName(node.target))
-        << "\"] = std::to_string(" << targetId << ");\n";
 }
 
 void CodeGeneratorVisitor::visit(AST::RecordDeclaration& node) {
@@ -839,38 +1615,70 @@ void CodeGeneratorVisitor::visit(AST::RecordDeclaration& node) {
 
     registerRecordType(node);
     std::string typeId = sanitizeTypeName(node.name);
-    oss << "struct " << typeId << " {\n";
+    out << "struct " << typeId << " {\n";
     for (const auto& field : node.fields) {
-        oss << "    " << cppTypeFor(field.second) << " " << sanitizeIdentifier(field.first)
+        out << "    " << cppTypeFor(field.second) << " " << sanitizeIdentifier(field.first)
             << " = " << cppDefaultValueFor(field.second) << ";\n";
     }
-    oss << "};\n\n";
+    out << "};\n\n";
 }
 
 void CodeGeneratorVisitor::visit(AST::RecordInstanceDeclaration& node) {
-    std::string id = variableNameFor(node);
-    std::string typeId = cppTypeFor(node.typeName);
-    if (initializedSymbols.find(id) == initializedSymbols.end()) {
-        oss << indent() << typeId << " " << id << "{};\n";
-        initializedSymbols.insert(id);
+    SymbolId id = declaredId(node);
+    SymbolId typeId = names->intern(cppTypeFor(node.typeName));
+    bool literal = std::all_of(node.fieldValues.begin(), node.fieldValues.end(), [](const AST::FieldValue& value) {
+        return value.second.kind == AST::Operand::Kind::NUMBER;
+    });
+    if (foldingConstants && openBlocks.empty() && literal && !isInitialized(id)) {
+        CodeOutput declaration(256);
+        std::swap(out, declaration);
+        emitRecordInstance(node, id, typeId);
+        std::swap(out, declaration);
+        deferDeclaration(id, declaration.take());
+        return;
+    }
+    emitRecordInstance(node, id, typeId);
+}
+
+void CodeGeneratorVisitor::emitRecordInstance(AST::RecordInstanceDeclaration& node, SymbolId id,
+                                              SymbolId typeId) {
+    std::string name(names->text(id));
+    if (!isInitialized(id)) {
+        out << indent() << names->text(typeId) << " " << name << "{};\n";
+        markInitialized(id);
+        if (const RecordType* type = recordTypeFor(typeId)) {
+            KnownNumber zero{KnownNumber::Type::INTEGER, true, 0};
+            for (const auto& field : type->fields) {
+                std::string cppType = cppTypeFor(field.typeName);
+                SymbolId fieldId = names->intern(name + "." + field.cppName);
+                setNumberType(fieldId, cppType == "int"      ? KnownNumber::Type::INTEGER
+                                       : cppType == "double" ? KnownNumber::Type::NUMBER
+                                                             : KnownNumber::Type::UNKNOWN);
+                assignNumber(fieldId, &zero);
+            }
+        }
     }
 
     for (const auto& fieldValue : node.fieldValues) {
-        std::string fieldName = fieldValue.first;
+        std::string_view fieldName = fieldValue.first;
         std::string fieldType = fieldTypeFor(typeId, fieldName);
-        oss << indent() << id << "." << sanitizeIdentifier(fieldName) << " = "
-            << typedExpression(fieldValue.second, fieldType) << ";\n";
+        std::string fieldId = name + "." + sanitizeIdentifier(fieldName);
+        out << indent() << fieldId << " = " << typedExpression(fieldValue.second, fieldType) << ";\n";
+        std::string cppType = cppTypeFor(fieldType);
+        KnownNumber value;
+        bool known = (cppType == "int" || cppType == "double") && knownValue(fieldValue.second, value);
+        assignNumber(names->intern(fieldId), known ? &value : nullptr);
     }
 }
 
 void CodeGeneratorVisitor::visit(AST::ImageDeclaration& node) {
     std::string imageId = sanitizeIdentifier(node.name);
-    oss << indent() << "OuatImage " << imageId << " = makeImage(static_cast<int>("
+    out << indent() << "OuatImage " << imageId << " = makeImage(static_cast<int>("
         << numericExpression(node.width) << "), static_cast<int>(" << numericExpression(node.height) << "));\n";
 }
 
 void CodeGeneratorVisitor::visit(AST::PixelWriteStatement& node) {
-    oss << indent() << "paintPixel(" << sanitizeIdentifier(node.imageName)
+    out << indent() << "paintPixel(" << sanitizeIdentifier(node.imageName)
         << ", static_cast<int>(" << numericExpression(node.x)
         << "), static_cast<int>(" << numericExpression(node.y)
         << "), " << numericExpression(node.red)
@@ -880,7 +1688,7 @@ void CodeGeneratorVisitor::visit(AST::PixelWriteStatement& node) {
 }
 
 void CodeGeneratorVisitor::visit(AST::ImageFillStatement& node) {
-    oss << indent() << "fillImage(" << sanitizeIdentifier(node.imageName)
+    out << indent() << "fillImage(" << sanitizeIdentifier(node.imageName)
         << ", " << numericExpression(node.red)
         << ", " << numericExpression(node.green)
         << ", " << numericExpression(node.blue)
@@ -888,7 +1696,7 @@ void CodeGeneratorVisitor::visit(AST::ImageFillStatement& node) {
 }
 
 void CodeGeneratorVisitor::visit(AST::RectanglePaintStatement& node) {
-    oss << indent() << "paintRectangle(" << sanitizeIdentifier(node.imageName)
+    out << indent() << "paintRectangle(" << sanitizeIdentifier(node.imageName)
         << ", static_cast<int>(" << numericExpression(node.left)
         << "), static_cast<int>(" << numericExpression(node.bottom)
         << "), static_cast<int>(" << numericExpression(node.right)
@@ -900,205 +1708,90 @@ void CodeGeneratorVisitor::visit(AST::RectanglePaintStatement& node) {
 }
 
 void CodeGeneratorVisitor::visit(AST::ImageSaveStatement& node) {
-    oss << indent() << "saveImageAsPpm(" << sanitizeIdentifier(node.imageName)
+    out << indent() << "saveImageAsPpm(" << sanitizeIdentifier(node.imageName)
         << ", \"" << escapeString(node.outputPath) << "\");\n";
 }
 
-void CodeGeneratorVisitor::collectDeclarations(AST::Node* node) {
-    if (auto variable = dynamic_cast<AST::VariableDeclaration*>(node)) {
-        registerDeclaration(*variable);
-    } else if (auto block = dynamic_cast<AST::VariableDeclarationBlock*>(node)) {
-        for (auto& decl : block->declarations) {
-            registerDeclaration(*decl);
-        }
-    } else if (auto record = dynamic_cast<AST::RecordDeclaration*>(node)) {
-        registerRecordType(*record);
-    } else if (auto recordInstance = dynamic_cast<AST::RecordInstanceDeclaration*>(node)) {
-        registerRecordInstance(*recordInstance);
-    } else if (auto arithmetic = dynamic_cast<AST::ArithmeticStatement*>(node)) {
-        registerArithmeticTarget(*arithmetic);
-    }
-
-    if (auto story = dynamic_cast<AST::Story*>(node)) {
-        for (auto& stmt : story->statements) {
-            collectDeclarations(stmt.get());
-        }
-    } else if (auto cond = dynamic_cast<AST::ConditionalStatement*>(node)) {
-        for (auto& stmt : cond->thenBranch) {
-            collectDeclarations(stmt.get());
-        }
-        for (auto& stmt : cond->elseBranch) {
-            collectDeclarations(stmt.get());
-        }
-    } else if (auto whileStmt = dynamic_cast<AST::WhileStatement*>(node)) {
-        for (auto& stmt : whileStmt->body) {
-            collectDeclarations(stmt.get());
-        }
-    } else if (auto forEach = dynamic_cast<AST::ForEachStatement*>(node)) {
-        for (auto& stmt : forEach->body) {
-            collectDeclarations(stmt.get());
-        }
-    } else if (auto forRange = dynamic_cast<AST::ForRangeStatement*>(node)) {
-        symbols[normalizeName(forRange->iterator)] = sanitizeIdentifier(forRange->iterator);
-        symbolKinds[sanitizeIdentifier(forRange->iterator)] = "number";
-        for (auto& stmt : forRange->body) {
-            collectDeclarations(stmt.get());
-        }
-    } else if (auto funcDecl = dynamic_cast<AST::FunctionDeclaration*>(node)) {
-        for (auto& stmt : funcDecl->body) {
-            collectDeclarations(stmt.get());
-        }
-    }
+// Decides what every operand below the node refers to, so emitting it only reads the result.
+// Function bodies are left to beginStoryMain, which emits them.
+void CodeGeneratorVisitor::resolveOperands(AST::Node* root) const {
+    AST::walk(*root, [this](AST::Node& node) { return resolveOwnOperands(&node); });
 }
 
-void CodeGeneratorVisitor::collectCollections(AST::Node* node) {
-    if (auto fe = dynamic_cast<AST::ForEachStatement*>(node)) {
-        std::string collectionName = resolveName(fe->collection);
-        if (collectionName.empty()) {
-            collectionName = sanitizeIdentifier(fe->collection);
-        }
-        collectionsUsed.insert(collectionName);
-    }
-
-    if (auto story = dynamic_cast<AST::Story*>(node)) {
-        for (auto& stmt : story->statements) {
-            collectCollections(stmt.get());
-        }
-    } else if (auto cond = dynamic_cast<AST::ConditionalStatement*>(node)) {
-        for (auto& stmt : cond->thenBranch) {
-            collectCollections(stmt.get());
-        }
-        for (auto& stmt : cond->elseBranch) {
-            collectCollections(stmt.get());
-        }
-    } else if (auto whileStmt = dynamic_cast<AST::WhileStatement*>(node)) {
-        for (auto& stmt : whileStmt->body) {
-            collectCollections(stmt.get());
-        }
-    } else if (auto forEach = dynamic_cast<AST::ForEachStatement*>(node)) {
-        for (auto& stmt : forEach->body) {
-            collectCollections(stmt.get());
-        }
-    } else if (auto forRange = dynamic_cast<AST::ForRangeStatement*>(node)) {
-        for (auto& stmt : forRange->body) {
-            collectCollections(stmt.get());
-        }
-    } else if (auto funcDecl = dynamic_cast<AST::FunctionDeclaration*>(node)) {
-        for (auto& stmt : funcDecl->body) {
-            collectCollections(stmt.get());
-        }
-    }
-}
-
-void CodeGeneratorVisitor::collectRecords(AST::Node* node, std::vector<AST::RecordDeclaration*>& records) {
-    if (auto record = dynamic_cast<AST::RecordDeclaration*>(node)) {
-        records.push_back(record);
-    }
-
-    if (auto story = dynamic_cast<AST::Story*>(node)) {
-        for (auto& stmt : story->statements) {
-            collectRecords(stmt.get(), records);
-        }
-    } else if (auto cond = dynamic_cast<AST::ConditionalStatement*>(node)) {
-        for (auto& stmt : cond->thenBranch) {
-            collectRecords(stmt.get(), records);
-        }
-        for (auto& stmt : cond->elseBranch) {
-            collectRecords(stmt.get(), records);
-        }
-    } else if (auto whileStmt = dynamic_cast<AST::WhileStatement*>(node)) {
-        for (auto& stmt : whileStmt->body) {
-            collectRecords(stmt.get(), records);
-        }
-    } else if (auto forEach = dynamic_cast<AST::ForEachStatement*>(node)) {
-        for (auto& stmt : forEach->body) {
-            collectRecords(stmt.get(), records);
-        }
-    } else if (auto forRange = dynamic_cast<AST::ForRangeStatement*>(node)) {
-        for (auto& stmt : forRange->body) {
-            collectRecords(stmt.get(), records);
-        }
-    } else if (auto funcDecl = dynamic_cast<AST::FunctionDeclaration*>(node)) {
-        for (auto& stmt : funcDecl->body) {
-            collectRecords(stmt.get(), records);
-        }
-    }
-}
-
-void CodeGeneratorVisitor::collectFunctions(AST::Node* node, std::vector<AST::FunctionDeclaration*>& functions) {
-    if (auto funcDecl = dynamic_cast<AST::FunctionDeclaration*>(node)) {
-        functions.push_back(funcDecl);
-    }
-
-    if (auto story = dynamic_cast<AST::Story*>(node)) {
-        for (auto& stmt : story->statements) {
-            collectFunctions(stmt.get(), functions);
-        }
-    } else if (auto cond = dynamic_cast<AST::ConditionalStatement*>(node)) {
-        for (auto& stmt : cond->thenBranch) {
-            collectFunctions(stmt.get(), functions);
-        }
-        for (auto& stmt : cond->elseBranch) {
-            collectFunctions(stmt.get(), functions);
-        }
-    } else if (auto whileStmt = dynamic_cast<AST::WhileStatement*>(node)) {
-        for (auto& stmt : whileStmt->body) {
-            collectFunctions(stmt.get(), functions);
-        }
-    } else if (auto forEach = dynamic_cast<AST::ForEachStatement*>(node)) {
-        for (auto& stmt : forEach->body) {
-            collectFunctions(stmt.get(), functions);
-        }
-    } else if (auto forRange = dynamic_cast<AST::ForRangeStatement*>(node)) {
-        for (auto& stmt : forRange->body) {
-            collectFunctions(stmt.get(), functions);
-        }
-    } else if (auto funcDecl = dynamic_cast<AST::FunctionDeclaration*>(node)) {
-        for (auto& stmt : funcDecl->body) {
-            collectFunctions(stmt.get(), functions);
-        }
-    }
-}
-
-void CodeGeneratorVisitor::collectImageUsage(AST::Node* node) {
-    if (dynamic_cast<AST::ImageDeclaration*>(node) ||
-        dynamic_cast<AST::PixelWriteStatement*>(node) ||
-        dynamic_cast<AST::ImageFillStatement*>(node) ||
-        dynamic_cast<AST::RectanglePaintStatement*>(node) ||
-        dynamic_cast<AST::ImageSaveStatement*>(node)) {
-        imageRuntimeRequired = true;
-    }
-
-    if (auto story = dynamic_cast<AST::Story*>(node)) {
-        for (auto& stmt : story->statements) {
-            collectImageUsage(stmt.get());
-        }
-    } else if (auto cond = dynamic_cast<AST::ConditionalStatement*>(node)) {
-        for (auto& stmt : cond->thenBranch) {
-            collectImageUsage(stmt.get());
-        }
-        for (auto& stmt : cond->elseBranch) {
-            collectImageUsage(stmt.get());
-        }
-    } else if (auto whileStmt = dynamic_cast<AST::WhileStatement*>(node)) {
-        for (auto& stmt : whileStmt->body) {
-            collectImageUsage(stmt.get());
-        }
-    } else if (auto forEach = dynamic_cast<AST::ForEachStatement*>(node)) {
-        for (auto& stmt : forEach->body) {
-            collectImageUsage(stmt.get());
-        }
-    } else if (auto forRange = dynamic_cast<AST::ForRangeStatement*>(node)) {
-        for (auto& stmt : forRange->body) {
-            collectImageUsage(stmt.get());
-        }
-    } else if (auto funcDecl = dynamic_cast<AST::FunctionDeclaration*>(node)) {
-        for (auto& stmt : funcDecl->body) {
-            collectImageUsage(stmt.get());
-        }
+bool CodeGeneratorVisitor::resolveOwnOperands(AST::Node* node) const {
+    switch (node->kind) {
+    case AST::NodeKind::ARITHMETIC: {
+        auto& arithmetic = static_cast<AST::ArithmeticStatement&>(*node);
+        resolve(arithmetic.left);
+        resolve(arithmetic.right);
+        resolve(arithmetic.target);
+        break;
+    }
+    case AST::NodeKind::RECORD_INSTANCE: {
+        auto& instance = static_cast<AST::RecordInstanceDeclaration&>(*node);
+        instance.symbol = names->intern(variableNameFor(instance));
+        for (auto& fieldValue : instance.fieldValues) {
+            resolve(fieldValue.second);
+        }
+        break;
+    }
+    case AST::NodeKind::VARIABLE_DECLARATION: {
+        auto& declaration = static_cast<AST::VariableDeclaration&>(*node);
+        declaration.symbol = names->intern(variableNameFor(declaration));
+        break;
+    }
+    case AST::NodeKind::FOR_RANGE: {
+        auto& range = static_cast<AST::ForRangeStatement&>(*node);
+        range.symbol = names->intern(sanitizeIdentifier(range.iterator));
+        break;
+    }
+    case AST::NodeKind::IMAGE_DECLARATION: {
+        auto& image = static_cast<AST::ImageDeclaration&>(*node);
+        resolve(image.width);
+        resolve(image.height);
+        break;
+    }
+    case AST::NodeKind::PIXEL_WRITE: {
+        auto& pixel = static_cast<AST::PixelWriteStatement&>(*node);
+        resolve(pixel.x);
+        resolve(pixel.y);
+        resolve(pixel.red);
+        resolve(pixel.green);
+        resolve(pixel.blue);
+        break;
+    }
+    case AST::NodeKind::IMAGE_FILL: {
+        auto& fill = static_cast<AST::ImageFillStatement&>(*node);
+        resolve(fill.red);
+        resolve(fill.green);
+        resolve(fill.blue);
+        break;
+    }
+    case AST::NodeKind::RECTANGLE_PAINT: {
+        auto& rectangle = static_cast<AST::RectanglePaintStatement&>(*node);
+        resolve(rectangle.left);
+        resolve(rectangle.bottom);
+        resolve(rectangle.right);
+        resolve(rectangle.top);
+        resolve(rectangle.red);
+        resolve(rectangle.green);
+        resolve(rectangle.blue);
+        break;
+    }
+    case AST::NodeKind::CONDITIONAL:
+        resolve(static_cast<AST::ConditionalStatement&>(*node).test);
+        break;
+    case AST::NodeKind::WHILE:
+        resolve(static_cast<AST::WhileStatement&>(*node).test);
+        break;
+    case AST::NodeKind::FUNCTION_DECLARATION:
+        return false;
+    default:
+        break;
     }
+    return true;
 }
 
 void CodeGeneratorVisitor::visit(AST::TellStatement& node) {
-    oss << indent() << "std::cout << \"" << escapeString(node.message) << "\" << std::endl;\n";
+    out << indent() << "std::cout << \"" << escapeString(node.message) << "\" << std::endl;\n";
 }
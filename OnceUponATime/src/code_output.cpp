@@ -0,0 +1,93 @@
+// code_output.cpp
+#include "code_output.h"
+#include <algorithm>
+#include <charconv>
+#include <utility>
+
+CodeOutput::CodeOutput(size_t chunkSize) : chunkSize(std::max<size_t>(chunkSize, 1)), target(nullptr) {}
+
+void CodeOutput::setTarget(std::ostream* output) {
+    flush();
+    target = output;
+}
+
+void CodeOutput::flush() {
+    if (target == nullptr) {
+        return;
+    }
+    writeTo(*target);
+    chunks.resize(std::min<size_t>(chunks.size(), 1));
+    if (!chunks.empty()) {
+        chunks.back().clear();
+    }
+}
+
+std::string& CodeOutput::current() {
+    if (!chunks.empty() && chunks.back().size() < chunkSize) {
+        return chunks.back();
+    }
+    if (target != nullptr && !chunks.empty()) {
+        target->write(chunks.back().data(), static_cast<std::streamsize>(chunks.back().size()));
+        chunks.back().clear();
+        return chunks.back();
+    }
+    chunks.emplace_back();
+    chunks.back().reserve(chunkSize);
+    return chunks.back();
+}
+
+CodeOutput& CodeOutput::operator<<(std::string_view text) {
+    while (!text.empty()) {
+        std::string& chunk = current();
+        size_t taken = std::min(text.size(), chunkSize - chunk.size());
+        chunk.append(text.data(), taken);
+        text.remove_prefix(taken);
+    }
+    return *this;
+}
+
+CodeOutput& CodeOutput::operator<<(char c) {
+    current().push_back(c);
+    return *this;
+}
+
+CodeOutput& CodeOutput::appendInteger(long long value) {
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    return *this << std::string_view(digits, result.ptr - digits);
+}
+
+CodeOutput& CodeOutput::appendInteger(unsigned long long value) {
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    return *this << std::string_view(digits, result.ptr - digits);
+}
+
+size_t CodeOutput::size() const {
+    size_t total = 0;
+    for (const auto& chunk : chunks) {
+        total += chunk.size();
+    }
+    return total;
+}
+
+std::string CodeOutput::str() const {
+    std::string result;
+    result.reserve(size());
+    for (const auto& chunk : chunks) {
+        result.append(chunk);
+    }
+    return result;
+}
+
+std::string CodeOutput::take() {
+    std::string result = chunks.size() == 1 ? std::move(chunks.front()) : str();
+    chunks.clear();
+    return result;
+}
+
+void CodeOutput::writeTo(std::ostream& output) const {
+    for (const auto& chunk : chunks) {
+        output.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+    }
+}
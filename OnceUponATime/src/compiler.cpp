@@ -0,0 +1,84 @@
+// compiler.cpp
+#include "compiler.h"
+#include "lexer.h"
+#include "parser.h"
+#include "code_generator.h"
+#include <memory>
+#include <vector>
+
+std::unique_ptr<AST::Story> parseStory(std::string_view source) {
+    Lexer lexer(source);
+    TokenStream tokens = lexer.tokenizeParallel();
+    Parser parser(tokens);
+    return parser.parseStory();
+}
+
+std::string compileStory(AST::Story& story) {
+    CodeGeneratorVisitor codeGen;
+    story.accept(codeGen);
+    return codeGen.takeGeneratedCode();
+}
+
+void compileStory(AST::Story& story, std::ostream& output) {
+    CodeGeneratorVisitor codeGen;
+    codeGen.setOutput(&output);
+    story.accept(codeGen);
+    codeGen.flushOutput();
+}
+
+std::string compileStory(std::string_view source) {
+    return compileStory(*parseStory(source));
+}
+
+void compileStoryStreaming(std::string_view source, std::ostream& output) {
+    // Both passes intern into one table, so the ids the analysis saw are the ones emitted.
+    StringInterner names;
+    CodeGeneratorVisitor codeGen;
+    codeGen.setOutput(&output);
+    codeGen.beginStory(names);
+
+    // Each statement is parsed into a scratch arena that is released once it has been analyzed.
+    // Record and function declarations, which the program info points into, are parsed into one
+    // arena kept until the story main begins; the rare declaration nested in another statement
+    // keeps the scratch arena it was parsed into.
+    AST::Arena declarations;
+    std::vector<std::unique_ptr<AST::Arena>> nestedDeclarations;
+    auto scratch = std::make_unique<AST::Arena>();
+    ProgramAnalyzer analyzer;
+    {
+        Lexer lexer(source);
+        Parser parser(lexer);
+        parser.beginStory();
+        while (true) {
+            AST::Arena& arena = parser.atDeclaration() ? declarations : *scratch;
+            AST::Statement* statement = parser.nextStatement(arena, names);
+            if (statement == nullptr) {
+                break;
+            }
+            bool declares = analyzer.analyze(*statement);
+            if (&arena == &declarations) {
+                continue;
+            }
+            if (declares) {
+                nestedDeclarations.push_back(std::move(scratch));
+                scratch = std::make_unique<AST::Arena>();
+            } else {
+                scratch->release();
+            }
+        }
+    }
+
+    codeGen.beginStoryMain(analyzer.finish());
+    nestedDeclarations.clear();
+    declarations.release();
+
+    Lexer lexer(source);
+    Parser parser(lexer);
+    parser.beginStory();
+    while (auto statement = parser.nextStatement(*scratch, names)) {
+        codeGen.emitStoryStatement(*statement);
+        scratch->release();
+    }
+    codeGen.endStory();
+    codeGen.flushOutput();
+}
@@ -0,0 +1,238 @@
+// incremental_parser.cpp
+#include "incremental_parser.h"
+#include "lexer.h"
+#include "parser.h"
+#include "story_cache.h"
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+namespace {
+
+// Closes a region that stops before the epilogue, so it parses like a whole story does.
+constexpr std::string_view regionEnd = "\nThe story ends.";
+constexpr size_t minimumDiscardBudget = 64 * 1024;
+
+bool isDigit(char c) {
+    return std::isdigit(static_cast<unsigned char>(c)) != 0;
+}
+
+// The lexer reads "5." followed by a digit as one number, so the boundary after the region
+// only holds when its final period is not squeezed between two digits.
+bool joinsNextSentence(std::string_view region, size_t regionSize, std::string_view next) {
+    return regionSize >= 2 && region[regionSize - 1] == '.' && isDigit(region[regionSize - 2]) &&
+           !next.empty() && isDigit(next.front());
+}
+
+template <typename T>
+void spliceInto(std::vector<T>& target, size_t first, size_t removed, const std::vector<T>& values) {
+    target.erase(target.begin() + first, target.begin() + first + removed);
+    target.insert(target.begin() + first, values.begin(), values.end());
+}
+
+}
+
+IncrementalParser::IncrementalParser(std::string_view source) : discardedBytes(0) {
+    rebuild(source);
+}
+
+AST::Story& IncrementalParser::story() {
+    return *parsed;
+}
+
+size_t IncrementalParser::size() const {
+    return (ends.empty() ? prologue.size() : ends.back()) + epilogue.size();
+}
+
+std::string IncrementalParser::text() const {
+    std::string result;
+    result.reserve(size());
+    appendText(result, 0, size());
+    return result;
+}
+
+void IncrementalParser::appendText(std::string& output, size_t from, size_t to) const {
+    while (from < to) {
+        std::string_view piece = epilogue;
+        size_t start = ends.empty() ? prologue.size() : ends.back();
+        if (from < prologue.size()) {
+            piece = prologue;
+            start = 0;
+        } else {
+            size_t index = std::upper_bound(ends.begin(), ends.end(), from) - ends.begin();
+            if (index < sentences.size()) {
+                piece = sentences[index];
+                start = ends[index] - piece.size();
+            }
+        }
+        size_t taken = std::min(to, start + piece.size()) - from;
+        if (taken == 0) {
+            break;
+        }
+        output.append(piece.substr(from - start, taken));
+        from += taken;
+    }
+}
+
+IncrementalParser::EditResult IncrementalParser::rebuild(std::string_view source) {
+    auto story = std::make_unique<AST::Story>();
+    std::string_view text = story->arena.copy(source);
+    Lexer lexer(text);
+    TokenStream tokens = lexer.tokenizeStream();
+    Parser parser(tokens);
+    parser.beginStory();
+    size_t previous = parser.consumedEnd() - text.data();
+    std::string_view newPrologue = text.substr(0, previous);
+    std::vector<std::string_view> newSentences;
+    std::vector<uint64_t> newHashes;
+    std::vector<size_t> newEnds;
+    while (auto statement = parser.nextStatement(story->arena, story->names)) {
+        size_t end = parser.consumedEnd() - text.data();
+        std::string_view sentence = text.substr(previous, end - previous);
+        story->statements.push_back(story->arena, statement);
+        newSentences.push_back(sentence);
+        newHashes.push_back(storyContentHash(sentence));
+        newEnds.push_back(end);
+        previous = end;
+    }
+
+    EditResult result;
+    result.removed = sentences.size();
+    result.inserted = newSentences.size();
+    result.reparsedBytes = text.size();
+    parsed = std::move(story);
+    prologue = newPrologue;
+    sentences = std::move(newSentences);
+    hashes = std::move(newHashes);
+    ends = std::move(newEnds);
+    epilogue = text.substr(previous);
+    discardedBytes = 0;
+    return result;
+}
+
+IncrementalParser::EditResult IncrementalParser::edit(size_t offset, size_t removedLength, std::string_view insertedText) {
+    size_t total = size();
+    if (offset > total || removedLength > total - offset) {
+        throw std::runtime_error("The edit is outside the story");
+    }
+    size_t editEnd = offset + removedLength;
+    if (offset < prologue.size()) {
+        std::string source;
+        appendText(source, 0, offset);
+        source.append(insertedText);
+        appendText(source, editEnd, total);
+        return rebuild(source);
+    }
+
+    // Sentences [first, last] are parsed again, last == count standing for the epilogue. The
+    // range grows until it parses on its own, which is when it ends at a statement boundary.
+    size_t count = sentences.size();
+    size_t first = std::upper_bound(ends.begin(), ends.end(), offset) - ends.begin();
+    size_t last = std::max<size_t>(first, std::upper_bound(ends.begin(), ends.end(), editEnd) - ends.begin());
+    EditResult result;
+    std::string region;
+    std::string_view copy;
+    std::vector<std::pair<AST::Statement*, size_t>> statements;
+    if (first > 0 && offset == ends[first - 1]) {
+        // Text inserted right after a period can turn the number before it into a decimal.
+        first--;
+        last = std::max(last, first);
+    }
+    size_t regionStart = first == 0 ? prologue.size() : ends[first - 1];
+    size_t regionStop = 0;
+    size_t regionSize = 0;
+    for (;;) {
+        bool throughEpilogue = last >= count;
+        regionStop = throughEpilogue ? total : ends[last];
+        region.clear();
+        appendText(region, regionStart, offset);
+        region.append(insertedText);
+        appendText(region, editEnd, regionStop);
+        regionSize = region.size();
+        if (!throughEpilogue) {
+            region.append(regionEnd);
+        }
+        copy = parsed->arena.copy(region);
+        discardedBytes += copy.size();
+        result.reparsedBytes += copy.size();
+
+        statements.clear();
+        bool closed = true;
+        try {
+            Lexer lexer(copy);
+            TokenStream tokens = lexer.tokenizeStream();
+            Parser parser(tokens);
+            while (auto statement = parser.nextStatement(parsed->arena, parsed->names)) {
+                size_t end = parser.consumedEnd() - copy.data();
+                if (end > regionSize) {
+                    closed = false;
+                    break;
+                }
+                statements.emplace_back(statement, end);
+            }
+        } catch (const std::runtime_error&) {
+            if (throughEpilogue) {
+                throw;
+            }
+            closed = false;
+        }
+        size_t trailing = statements.empty() ? 0 : statements.back().second;
+        if (closed && throughEpilogue) {
+            break;
+        }
+        std::string_view following = last + 1 < count ? sentences[last + 1] : epilogue;
+        if (closed && trailing == regionSize && !joinsNextSentence(region, regionSize, following)) {
+            break;
+        }
+        last = std::min(count, last + (last - first + 1));
+    }
+
+    size_t replacedEnd = std::min(last + 1, count);
+    std::unordered_map<uint64_t, size_t> replaced;
+    for (size_t i = first; i < replacedEnd; ++i) {
+        replaced.emplace(hashes[i], i);
+    }
+    std::vector<std::string_view> newSentences;
+    std::vector<uint64_t> newHashes;
+    std::vector<size_t> newEnds;
+    std::vector<AST::Statement*> newStatements;
+    size_t previous = 0;
+    for (auto [statement, end] : statements) {
+        std::string_view sentence = copy.substr(previous, end - previous);
+        uint64_t hash = storyContentHash(sentence);
+        auto unchanged = replaced.find(hash);
+        if (unchanged != replaced.end() && sentences[unchanged->second] == sentence) {
+            sentence = sentences[unchanged->second];
+            statement = parsed->statements[unchanged->second];
+            replaced.erase(unchanged);
+            result.reused++;
+        }
+        newSentences.push_back(sentence);
+        newHashes.push_back(hash);
+        newEnds.push_back(regionStart + end);
+        newStatements.push_back(statement);
+        previous = end;
+    }
+
+    parsed->statements.replace(parsed->arena, first, replacedEnd - first, newStatements.data(), newStatements.size());
+    spliceInto(sentences, first, replacedEnd - first, newSentences);
+    spliceInto(hashes, first, replacedEnd - first, newHashes);
+    spliceInto(ends, first, replacedEnd - first, newEnds);
+    for (size_t i = first + newEnds.size(); i < ends.size(); ++i) {
+        ends[i] = ends[i] + insertedText.size() - removedLength;
+    }
+    if (last >= count) {
+        epilogue = copy.substr(previous);
+    }
+    discardedBytes += regionStop - regionStart;
+    result.first = first;
+    result.removed = replacedEnd - first;
+    result.inserted = newStatements.size();
+
+    if (discardedBytes > 2 * std::max(size(), minimumDiscardBudget)) {
+        return rebuild(text());
+    }
+    return result;
+}
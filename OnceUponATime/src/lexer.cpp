@@ -4,10 +4,34 @@
 #include <sstream>
 #include <stdexcept>
 #include <algorithm>
+#include <array>
 #include <cassert>
-#include <unordered_map>
+#include <charconv>
+#include <cstdint>
+#include <exception>
+#include <atomic>
+#include <thread>
 
-const std::unordered_map<std::string, TokenType> Lexer::keywordMap = {
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define OUAT_LEXER_SIMD_WIDTH 32
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OUAT_LEXER_SIMD_WIDTH 16
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace {
+
+struct KeywordEntry {
+    std::string_view word;
+    TokenType type;
+};
+
+constexpr KeywordEntry keywords[] = {
     {"once", TokenType::KW_ONCE},
     {"upon", TokenType::KW_UPON},
     {"a", TokenType::KW_A},
@@ -61,8 +85,322 @@ const std::unordered_map<std::string, TokenType> Lexer::keywordMap = {
     {"of", TokenType::KW_OF},
 };
 
-Lexer::Lexer(const std::string& source)
-    : source(source), pos(0), line(1), column(1) {}
+constexpr size_t keywordCount = sizeof(keywords) / sizeof(keywords[0]);
+constexpr size_t keywordSlotCount = 512;
+constexpr size_t maxKeywordLength = 11;
+
+constexpr char foldCase(char c) {
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+constexpr uint32_t keywordHash(std::string_view word, uint32_t seed) {
+    uint32_t hash = seed ^ static_cast<uint32_t>(word.size());
+    for (char c : word) {
+        hash = (hash ^ static_cast<unsigned char>(foldCase(c))) * 16777619u;
+    }
+    return hash ^ (hash >> 15);
+}
+
+struct KeywordTable {
+    uint32_t seed = 0;
+    std::array<uint8_t, keywordSlotCount> slots{};
+};
+
+constexpr KeywordTable buildKeywordTable() {
+    for (uint32_t seed = 2166136261u;; seed += 0x9E3779B9u) {
+        KeywordTable table;
+        table.seed = seed;
+        bool collision = false;
+        for (size_t i = 0; i < keywordCount && !collision; ++i) {
+            size_t slot = keywordHash(keywords[i].word, seed) % keywordSlotCount;
+            if (table.slots[slot] != 0) {
+                collision = true;
+            } else {
+                table.slots[slot] = static_cast<uint8_t>(i + 1);
+            }
+        }
+        if (!collision) {
+            return table;
+        }
+    }
+}
+
+constexpr KeywordTable keywordTable = buildKeywordTable();
+
+static_assert(keywordCount < 255, "keyword slots store 8-bit indices");
+
+constexpr bool keywordsFitLengthLimit() {
+    for (const auto& entry : keywords) {
+        if (entry.word.size() > maxKeywordLength) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static_assert(keywordsFitLengthLimit(), "maxKeywordLength must cover every keyword");
+
+bool lookupKeyword(std::string_view word, TokenType& type) {
+    if (word.empty() || word.size() > maxKeywordLength) {
+        return false;
+    }
+    uint8_t slot = keywordTable.slots[keywordHash(word, keywordTable.seed) % keywordSlotCount];
+    if (slot == 0) {
+        return false;
+    }
+    const KeywordEntry& entry = keywords[slot - 1];
+    if (entry.word.size() != word.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < word.size(); ++i) {
+        if (foldCase(word[i]) != entry.word[i]) {
+            return false;
+        }
+    }
+    type = entry.type;
+    return true;
+}
+
+inline bool isSpaceByte(unsigned char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+inline bool isWordByte(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c > 127 ||
+           c == '_' || c == ':' || c == '?' || c == '!' || c == '-' || c == '\'';
+}
+
+inline int countBits(uint32_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcount(mask);
+#else
+    mask = mask - ((mask >> 1) & 0x55555555u);
+    mask = (mask & 0x33333333u) + ((mask >> 2) & 0x33333333u);
+    return static_cast<int>((((mask + (mask >> 4)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24);
+#endif
+}
+
+#ifdef OUAT_LEXER_SIMD_WIDTH
+
+inline int lowestBit(uint32_t mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+inline int highestBit(uint32_t mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanReverse(&index, mask);
+    return static_cast<int>(index);
+#else
+    return 31 - __builtin_clz(mask);
+#endif
+}
+
+#if OUAT_LEXER_SIMD_WIDTH == 32
+using Block = __m256i;
+inline Block loadBlock(const char* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+inline Block splat(char c) { return _mm256_set1_epi8(c); }
+inline Block equalBytes(Block a, Block b) { return _mm256_cmpeq_epi8(a, b); }
+inline Block eitherBytes(Block a, Block b) { return _mm256_or_si256(a, b); }
+inline Block subtractBytes(Block a, Block b) { return _mm256_sub_epi8(a, b); }
+inline Block minBytes(Block a, Block b) { return _mm256_min_epu8(a, b); }
+inline Block negativeBytes(Block a) { return _mm256_cmpgt_epi8(_mm256_setzero_si256(), a); }
+inline uint32_t blockMask(Block a) { return static_cast<uint32_t>(_mm256_movemask_epi8(a)); }
+constexpr uint32_t fullBlockMask = 0xFFFFFFFFu;
+#else
+using Block = __m128i;
+inline Block loadBlock(const char* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+inline Block splat(char c) { return _mm_set1_epi8(c); }
+inline Block equalBytes(Block a, Block b) { return _mm_cmpeq_epi8(a, b); }
+inline Block eitherBytes(Block a, Block b) { return _mm_or_si128(a, b); }
+inline Block subtractBytes(Block a, Block b) { return _mm_sub_epi8(a, b); }
+inline Block minBytes(Block a, Block b) { return _mm_min_epu8(a, b); }
+inline Block negativeBytes(Block a) { return _mm_cmplt_epi8(a, _mm_setzero_si128()); }
+inline uint32_t blockMask(Block a) { return static_cast<uint32_t>(_mm_movemask_epi8(a)); }
+constexpr uint32_t fullBlockMask = 0xFFFFu;
+#endif
+
+inline Block inRange(Block bytes, char low, char high) {
+    Block offset = subtractBytes(bytes, splat(low));
+    Block limit = splat(static_cast<char>(high - low));
+    return equalBytes(minBytes(offset, limit), offset);
+}
+
+#endif
+
+// Returns the first non-whitespace byte in [p, end). Newlines crossed are added to
+// newlines, and lineStart is moved just past the last of them.
+const char* skipSpaces(const char* p, const char* end, int& newlines, const char*& lineStart) {
+#ifdef OUAT_LEXER_SIMD_WIDTH
+    while (end - p >= OUAT_LEXER_SIMD_WIDTH) {
+        Block bytes = loadBlock(p);
+        uint32_t newlineMask = blockMask(equalBytes(bytes, splat('\n')));
+        uint32_t spaceMask = blockMask(eitherBytes(equalBytes(bytes, splat(' ')), inRange(bytes, '\t', '\r')));
+        uint32_t stopMask = ~spaceMask & fullBlockMask;
+        if (stopMask != 0) {
+            int stop = lowestBit(stopMask);
+            newlineMask &= (1u << stop) - 1u;
+            if (newlineMask != 0) {
+                newlines += countBits(newlineMask);
+                lineStart = p + highestBit(newlineMask) + 1;
+            }
+            return p + stop;
+        }
+        if (newlineMask != 0) {
+            newlines += countBits(newlineMask);
+            lineStart = p + highestBit(newlineMask) + 1;
+        }
+        p += OUAT_LEXER_SIMD_WIDTH;
+    }
+#endif
+    while (p < end && isSpaceByte(static_cast<unsigned char>(*p))) {
+        if (*p == '\n') {
+            newlines++;
+            lineStart = p + 1;
+        }
+        p++;
+    }
+    return p;
+}
+
+const char* findLineEnd(const char* p, const char* end) {
+#ifdef OUAT_LEXER_SIMD_WIDTH
+    while (end - p >= OUAT_LEXER_SIMD_WIDTH) {
+        uint32_t newlineMask = blockMask(equalBytes(loadBlock(p), splat('\n')));
+        if (newlineMask != 0) {
+            return p + lowestBit(newlineMask);
+        }
+        p += OUAT_LEXER_SIMD_WIDTH;
+    }
+#endif
+    while (p < end && *p != '\n') {
+        p++;
+    }
+    return p;
+}
+
+const char* findAnyOf(const char* p, const char* end, char first, char second, char third) {
+#ifdef OUAT_LEXER_SIMD_WIDTH
+    while (end - p >= OUAT_LEXER_SIMD_WIDTH) {
+        Block bytes = loadBlock(p);
+        uint32_t mask = blockMask(eitherBytes(eitherBytes(equalBytes(bytes, splat(first)), equalBytes(bytes, splat(second))),
+                                              equalBytes(bytes, splat(third))));
+        if (mask != 0) {
+            return p + lowestBit(mask);
+        }
+        p += OUAT_LEXER_SIMD_WIDTH;
+    }
+#endif
+    while (p < end && *p != first && *p != second && *p != third) {
+        p++;
+    }
+    return p;
+}
+
+const char* findWordEnd(const char* p, const char* end) {
+#ifdef OUAT_LEXER_SIMD_WIDTH
+    while (end - p >= OUAT_LEXER_SIMD_WIDTH) {
+        Block bytes = loadBlock(p);
+        Block letters = inRange(eitherBytes(bytes, splat(0x20)), 'a', 'z');
+        Block digits = inRange(bytes, '0', '9');
+        Block punctuation = eitherBytes(
+            eitherBytes(eitherBytes(equalBytes(bytes, splat('_')), equalBytes(bytes, splat(':'))),
+                        eitherBytes(equalBytes(bytes, splat('?')), equalBytes(bytes, splat('!')))),
+            eitherBytes(equalBytes(bytes, splat('-')), equalBytes(bytes, splat('\''))));
+        Block word = eitherBytes(eitherBytes(letters, digits), eitherBytes(punctuation, negativeBytes(bytes)));
+        uint32_t stopMask = ~blockMask(word) & fullBlockMask;
+        if (stopMask != 0) {
+            return p + lowestBit(stopMask);
+        }
+        p += OUAT_LEXER_SIMD_WIDTH;
+    }
+#endif
+    while (p < end && isWordByte(static_cast<unsigned char>(*p))) {
+        p++;
+    }
+    return p;
+}
+
+// Splits source after sentence-ending periods, roughly every chunkSize bytes. A period
+// only ends a sentence outside strings and comments, and when followed by whitespace,
+// which rules out decimals. The lexer state after such a period is the same as at the
+// start of a fresh lexer, so each chunk can be tokenized on its own.
+std::vector<size_t> findChunkBoundaries(std::string_view source, size_t chunkSize) {
+    std::vector<size_t> boundaries{0};
+    const char* begin = source.data();
+    const char* end = begin + source.size();
+    const char* target = begin + std::min(chunkSize, source.size());
+    const char* p = begin;
+    while (p < end) {
+        p = findAnyOf(p, end, '"', '#', '.');
+        if (p == end) {
+            break;
+        }
+        if (*p == '#') {
+            p = findLineEnd(p, end);
+        } else if (*p == '"') {
+            for (p++; p < end; ) {
+                p = findAnyOf(p, end, '"', '\\', '"');
+                if (p == end || *p == '"') {
+                    break;
+                }
+                p += end - p > 1 ? 2 : 1;
+            }
+            if (p < end) {
+                p++;
+            }
+        } else {
+            p++;
+            if (p >= target && p < end && isSpaceByte(static_cast<unsigned char>(*p))) {
+                boundaries.push_back(static_cast<size_t>(p - begin));
+                target = end - p > static_cast<ptrdiff_t>(chunkSize) ? p + chunkSize : end;
+            }
+        }
+    }
+    boundaries.push_back(source.size());
+    return boundaries;
+}
+
+template <typename Work>
+void runOnThreads(size_t taskCount, Work work) {
+    std::atomic<size_t> nextTask{0};
+    auto worker = [&]() {
+        for (size_t task = nextTask++; task < taskCount; task = nextTask++) {
+            work(task);
+        }
+    };
+    size_t threadCount = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), taskCount);
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < threadCount; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+}
+
+Lexer::Lexer(std::string_view source)
+    : source(source), pos(0), line(1), column(1), ownedWords(std::make_unique<StringInterner>()), words(ownedWords.get()) {}
+
+Lexer::Lexer(std::string_view source, int line, int column, StringInterner& words)
+    : source(source), pos(0), line(line), column(column), words(&words) {}
+
+std::string_view Lexer::input() const {
+    return source;
+}
+
+const StringInterner& Lexer::interner() const {
+    return *words;
+}
 
 bool Lexer::isAtEnd() const {
     return pos >= source.size();
@@ -86,47 +424,46 @@ char Lexer::advance() {
 }
 
 void Lexer::skipWhitespace() {
-    while (!isAtEnd()) {
-        char c = peek();
-        if (std::isspace(static_cast<unsigned char>(c))) {
-            advance();
-        } else if (c == '#') {
-            advance();
-            while (!isAtEnd() && peek() != '\n') {
-                advance();
-            }
+    const char* begin = source.data();
+    const char* end = begin + source.size();
+    const char* p = begin + pos;
+    while (p < end) {
+        int newlines = 0;
+        const char* lineStart = nullptr;
+        const char* next = skipSpaces(p, end, newlines, lineStart);
+        if (newlines > 0) {
+            line += newlines;
+            column = static_cast<int>(next - lineStart) + 1;
         } else {
+            column += static_cast<int>(next - p);
+        }
+        p = next;
+        if (p == end || *p != '#') {
             break;
         }
+        next = findLineEnd(p, end);
+        column += static_cast<int>(next - p);
+        p = next;
     }
+    pos = static_cast<size_t>(p - begin);
 }
 
-Token Lexer::makeToken(TokenType type, const std::string& lexeme, int tokenStartColumn) {
+Token Lexer::makeToken(TokenType type, std::string_view lexeme, int tokenStartColumn) {
     return Token{ type, lexeme, line, tokenStartColumn };
 }
 
-static bool isWordChar(char c) {
-    unsigned char uc = static_cast<unsigned char>(c);
-    return std::isalnum(uc) || uc > 127 || c == '_' || c == ':' || c == '?' || c == '!' || c == '-' || c == '\'';
-}
-
 Token Lexer::readWord() {
     int startColumn = column;
-    std::string word;
-    while (!isAtEnd() && !std::isspace(peek()) && peek() != '.' && peek() != '"') {
-        if (!isWordChar(peek())) {
-            break;
-        }
-        word += advance();
-    }
-    std::string lower = word;
-    std::transform(lower.begin(), lower.end(), lower.begin(),
-                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
-    auto it = keywordMap.find(lower);
-    if (it != keywordMap.end()) {
-        return makeToken(it->second, word, startColumn);
-    }
-    return makeToken(TokenType::IDENTIFIER, word, startColumn);
+    size_t start = pos;
+    const char* begin = source.data();
+    pos = static_cast<size_t>(findWordEnd(begin + pos, begin + source.size()) - begin);
+    column += static_cast<int>(pos - start);
+    std::string_view word = source.substr(start, pos - start);
+    TokenType type = TokenType::IDENTIFIER;
+    lookupKeyword(word, type);
+    Token token = makeToken(type, word, startColumn);
+    token.word = words->internFolded(word);
+    return token;
 }
 
 Token Lexer::readNumber() {
@@ -135,15 +472,26 @@ Token Lexer::readNumber() {
     while (!isAtEnd() && std::isdigit(static_cast<unsigned char>(peek()))) {
         advance();
     }
+    bool decimal = false;
     if (!isAtEnd() && peek() == '.' && pos + 1 < source.size() &&
         std::isdigit(static_cast<unsigned char>(source[pos + 1]))) {
+        decimal = true;
         advance();
         while (!isAtEnd() && std::isdigit(static_cast<unsigned char>(peek()))) {
             advance();
         }
     }
-    std::string number = source.substr(start, pos - start);
-    return makeToken(TokenType::NUMBER, number, startColumn);
+    std::string_view number = source.substr(start, pos - start);
+    Token token = makeToken(TokenType::NUMBER, number, startColumn);
+    const char* first = number.data();
+    const char* last = first + number.size();
+    if (!decimal && std::from_chars(first, last, token.integer).ec == std::errc()) {
+        token.integral = true;
+        token.real = static_cast<double>(token.integer);
+    } else {
+        std::from_chars(first, last, token.real);
+    }
+    return token;
 }
 
 Token Lexer::readString() {
@@ -161,22 +509,20 @@ Token Lexer::readString() {
     if (isAtEnd()) {
         throw std::runtime_error("Unterminated string at line " + std::to_string(line));
     }
-    std::string str = source.substr(start, pos - start);
+    std::string_view str = source.substr(start, pos - start);
     advance();
     return makeToken(TokenType::STRING, str, startColumn);
 }
 
-std::string Lexer::peekAhead() const {
+std::string_view Lexer::peekAhead() const {
     size_t tempPos = pos;
-    std::string result;
     while (tempPos < source.size() && std::isalnum(static_cast<unsigned char>(source[tempPos]))) {
-        result += source[tempPos++];
+        tempPos++;
     }
-    return result;
+    return source.substr(pos, tempPos - pos);
 }
 
-std::vector<Token> Lexer::tokenize() {
-    std::vector<Token> tokens;
+Token Lexer::next() {
     skipWhitespace();
     while (!isAtEnd()) {
         int tokenStartColumn = column;
@@ -186,30 +532,125 @@ std::vector<Token> Lexer::tokenize() {
             continue;
         }
         if (std::isdigit(static_cast<unsigned char>(current))) {
-            tokens.push_back(readNumber());
-        } else if (std::isalpha(static_cast<unsigned char>(current)) || static_cast<unsigned char>(current) > 127) {
-            tokens.push_back(readWord());
-        } else if (current == '.') {
-            advance();
-            tokens.push_back(makeToken(TokenType::PERIOD, ".", tokenStartColumn));
-        } else if (current == '"') {
-            tokens.push_back(readString());
+            return readNumber();
+        }
+        if (std::isalpha(static_cast<unsigned char>(current)) || static_cast<unsigned char>(current) > 127) {
+            return readWord();
+        }
+        if (current == '"') {
+            return readString();
+        }
+        TokenType type;
+        if (current == '.') {
+            type = TokenType::PERIOD;
         } else if (current == '[') {
-            advance();
-            tokens.push_back(makeToken(TokenType::LEFT_BRACKET, "[", tokenStartColumn));
+            type = TokenType::LEFT_BRACKET;
         } else if (current == ']') {
-            advance();
-            tokens.push_back(makeToken(TokenType::RIGHT_BRACKET, "]", tokenStartColumn));
-        } else if (current == ',') {  
-            advance();
-            tokens.push_back(makeToken(TokenType::COMMA, ",", tokenStartColumn));
+            type = TokenType::RIGHT_BRACKET;
+        } else if (current == ',') {
+            type = TokenType::COMMA;
         } else {
             std::ostringstream oss;
             oss << "Unexpected character '" << current << "' at line " << line << ", column " << column;
             throw std::runtime_error(oss.str());
         }
-        skipWhitespace();
+        advance();
+        return makeToken(type, source.substr(pos - 1, 1), tokenStartColumn);
     }
-    tokens.push_back(Token{TokenType::END_OF_FILE, "", line, column});
+    return Token{TokenType::END_OF_FILE, source.substr(source.size()), line, column};
+}
+
+std::vector<Token> Lexer::tokenize() {
+    std::vector<Token> tokens;
+    do {
+        tokens.push_back(next());
+    } while (tokens.back().type != TokenType::END_OF_FILE);
     return tokens;
 }
+
+TokenStream Lexer::tokenizeStream() {
+    TokenStream stream(source);
+    TokenType type;
+    do {
+        Token token = next();
+        stream.append(token);
+        type = token.type;
+    } while (type != TokenType::END_OF_FILE);
+    return stream;
+}
+
+TokenStream Lexer::tokenizeParallel(size_t chunkSize) {
+    std::string_view remaining = source.substr(pos);
+    std::vector<size_t> boundaries = findChunkBoundaries(remaining, std::max<size_t>(chunkSize, 1));
+    size_t chunkCount = boundaries.size() - 1;
+    if (chunkCount < 2) {
+        return tokenizeStream();
+    }
+
+    struct ChunkEnd {
+        int line;
+        int column;
+    };
+    std::vector<TokenStream> chunkStreams(chunkCount, TokenStream(source));
+    std::vector<StringInterner> chunkWords(chunkCount);
+    std::vector<ChunkEnd> chunkEnds(chunkCount);
+    std::vector<std::exception_ptr> chunkErrors(chunkCount);
+    runOnThreads(chunkCount, [&](size_t chunk) {
+        try {
+            Lexer chunkLexer(remaining.substr(boundaries[chunk], boundaries[chunk + 1] - boundaries[chunk]), 1, 1,
+                             chunkWords[chunk]);
+            TokenType type;
+            do {
+                Token token = chunkLexer.next();
+                chunkStreams[chunk].append(token);
+                type = token.type;
+            } while (type != TokenType::END_OF_FILE);
+            chunkEnds[chunk] = ChunkEnd{chunkLexer.line, chunkLexer.column};
+        } catch (...) {
+            chunkErrors[chunk] = std::current_exception();
+        }
+    });
+
+    int startLine = line;
+    int startColumn = column;
+    std::vector<size_t> tokenOffsets(chunkCount + 1);
+    std::vector<size_t> numberOffsets(chunkCount + 1);
+    std::vector<std::vector<SymbolId>> wordRemaps(chunkCount);
+    for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+        if (chunkErrors[chunk]) {
+            // A lexing error gives its position within the chunk; lexing the chunk again from
+            // where it starts in the source reports the right one. Any other failure, or one the
+            // second pass does not repeat, is passed on as it was.
+            try {
+                std::rethrow_exception(chunkErrors[chunk]);
+            } catch (const std::runtime_error&) {
+                Lexer(remaining.substr(boundaries[chunk], boundaries[chunk + 1] - boundaries[chunk]),
+                      startLine, startColumn, *words).tokenize();
+            }
+            std::rethrow_exception(chunkErrors[chunk]);
+        }
+        wordRemaps[chunk].resize(chunkWords[chunk].size());
+        for (SymbolId id = 0; id < wordRemaps[chunk].size(); ++id) {
+            wordRemaps[chunk][id] = words->intern(chunkWords[chunk].text(id));
+        }
+        const ChunkEnd& end = chunkEnds[chunk];
+        startColumn = end.line == 1 ? startColumn + end.column - 1 : end.column;
+        startLine += end.line - 1;
+        size_t tokenCount = chunkStreams[chunk].size() - (chunk + 1 == chunkCount ? 0 : 1);
+        tokenOffsets[chunk + 1] = tokenOffsets[chunk] + tokenCount;
+        numberOffsets[chunk + 1] = numberOffsets[chunk] + chunkStreams[chunk].numberCount();
+    }
+
+    TokenStream stream(source);
+    stream.resize(tokenOffsets[chunkCount], numberOffsets[chunkCount]);
+    runOnThreads(chunkCount, [&](size_t chunk) {
+        stream.copyFrom(chunkStreams[chunk], tokenOffsets[chunk + 1] - tokenOffsets[chunk], tokenOffsets[chunk],
+                        numberOffsets[chunk], wordRemaps[chunk]);
+        chunkStreams[chunk] = TokenStream(source);
+    });
+
+    pos = source.size();
+    line = startLine;
+    column = startColumn;
+    return stream;
+}
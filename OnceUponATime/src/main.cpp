@@ -1,17 +1,28 @@
 #include <iostream>
 #include <fstream>
-#include <sstream>
 #include <cstdlib>
 #include <filesystem>
-#include "lexer.h"
-#include "parser.h"
-#include "code_generator.h"
+#include "compiler.h"
+#include "source_file.h"
+#include "story_cache.h"
 
-int main() {
+int main(int argc, char* argv[]) {
     try {
         std::filesystem::path currentPath = std::filesystem::current_path();
         std::cout << "Current directory: " << currentPath.string() << std::endl;
         std::filesystem::path inputFilePath = currentPath / "examples" / "hero_tale.ouat";
+        bool streaming = false;
+        bool useCache = true;
+        for (int i = 1; i < argc; ++i) {
+            std::string argument = argv[i];
+            if (argument == "--stream") {
+                streaming = true;
+            } else if (argument == "--no-cache") {
+                useCache = false;
+            } else {
+                inputFilePath = argument;
+            }
+        }
         if (!std::filesystem::exists(inputFilePath)) {
             std::cerr << "Error: Input file " << inputFilePath.string() << " does not exist." << std::endl;
             return EXIT_FAILURE;
@@ -23,33 +34,38 @@ int main() {
         std::cout << "Output directory: " << outputDirPath.string() << std::endl;
         std::cout << "Generated file: " << outputFilePath.string() << std::endl;
         std::cout << "Executable: " << exePath.string() << std::endl;
-        std::ifstream inputFile(inputFilePath);
-        if (!inputFile) {
-            std::cerr << "Error: Unable to open " << inputFilePath.string() << std::endl;
-            return EXIT_FAILURE;
-        }
-        std::stringstream buffer;
-        buffer << inputFile.rdbuf();
-        std::string script = buffer.str();
-        Lexer lexer(script);
-        auto tokens = lexer.tokenize();
-        Parser parser(tokens);
-        auto story = parser.parseStory();
-        CodeGeneratorVisitor codeGen;
-        story->accept(codeGen);
-        std::string generatedCode = codeGen.getGeneratedCode();
-        std::cout << "Generated code:" << std::endl;
-        std::cout << "----------------------------------------" << std::endl;
-        std::cout << generatedCode << std::endl;
-        std::cout << "----------------------------------------" << std::endl;
+        SourceFile script(inputFilePath);
         std::filesystem::create_directories(outputDirPath);
         std::ofstream outFile(outputFilePath);
         if (!outFile) {
             std::cerr << "Error: Unable to open " << outputFilePath.string() << " for writing." << std::endl;
             return EXIT_FAILURE;
         }
-        outFile << generatedCode;
+        if (streaming) {
+            compileStoryStreaming(script.text(), outFile);
+        } else {
+            std::unique_ptr<AST::Story> story;
+            if (useCache) {
+                story = loadCachedStory(inputFilePath, script.text());
+            }
+            if (story) {
+                std::cout << "Parsed story loaded from " << storyCachePath(inputFilePath).string() << std::endl;
+            } else {
+                story = parseStory(script.text());
+                if (useCache && !saveCachedStory(inputFilePath, script.text(), *story)) {
+                    std::cerr << "Warning: unable to write " << storyCachePath(inputFilePath).string() << std::endl;
+                }
+            }
+            compileStory(*story, outFile);
+        }
         outFile.close();
+        if (!streaming) {
+            std::ifstream generatedCode(outputFilePath, std::ios::binary);
+            std::cout << "Generated code:" << std::endl;
+            std::cout << "----------------------------------------" << std::endl;
+            std::cout << generatedCode.rdbuf() << std::endl;
+            std::cout << "----------------------------------------" << std::endl;
+        }
         std::cout << "Generated code written to " << outputFilePath.string() << std::endl;
 
         std::string compileCommand = "cl /EHsc /std:c++17 /Fe:\"" + exePath.string() + "\" \"" + outputFilePath.string() + "\"";
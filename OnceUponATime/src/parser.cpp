@@ -1,29 +1,51 @@
 // parser.cpp
 #include "parser.h"
+#include "lexer.h"
 #include <algorithm>
-#include <cctype>
 #include <sstream>
 #include <stdexcept>
 
-static std::string toLower(const std::string& s) {
-    std::string res = s;
-    std::transform(res.begin(), res.end(), res.begin(),
-                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
-    return res;
+// Story caches hold the trees built here. A change to what any script parses into must bump
+// Parser::outputVersion.
+
+// Strings, numbers and punctuation never read as a word, whatever their text.
+static bool carriesWord(TokenType type) {
+    return type != TokenType::STRING && type != TokenType::NUMBER && type != TokenType::PERIOD &&
+           type != TokenType::COMMA && type != TokenType::LEFT_BRACKET && type != TokenType::RIGHT_BRACKET &&
+           type != TokenType::END_OF_FILE;
+}
+
+static SymbolId foldedWord(const Token& token) {
+    if (token.word != noSymbol || !carriesWord(token.type)) {
+        return token.word;
+    }
+    return StringInterner::knownWord(token.lexeme);
 }
 
-static bool sameWord(const Token& token, const std::string& word) {
-    return toLower(token.lexeme) == toLower(word);
+static bool sameWord(const Token& token, KnownWord word) {
+    return foldedWord(token) == word;
 }
 
-static bool isArticle(const Token& token) {
-    std::string lower = toLower(token.lexeme);
-    return lower == "a" || lower == "an" || lower == "the";
+static SymbolId foldedWord(const TokenSpan& tokens, size_t index) {
+    SymbolId word = tokens.word(index);
+    if (word != noSymbol || !carriesWord(tokens.type(index))) {
+        return word;
+    }
+    return StringInterner::knownWord(tokens.lexeme(index));
 }
 
-static bool isDeclarationSeparator(const Token& token) {
-    std::string lower = toLower(token.lexeme);
-    return lower == "of" || lower == "is";
+static bool sameWord(const TokenSpan& tokens, size_t index, KnownWord word) {
+    return foldedWord(tokens, index) == word;
+}
+
+static bool isArticle(const TokenSpan& tokens, size_t index) {
+    SymbolId word = foldedWord(tokens, index);
+    return word == WORD_A || word == WORD_AN || word == WORD_THE;
+}
+
+static bool isDeclarationSeparator(const TokenSpan& tokens, size_t index) {
+    SymbolId word = foldedWord(tokens, index);
+    return word == WORD_OF || word == WORD_IS;
 }
 
 static bool startsStatement(const Token& token) {
@@ -49,207 +71,379 @@ static bool startsStatement(const Token& token) {
     }
 }
 
-static bool isArithmeticOperator(const Token& token) {
-    return token.type == TokenType::KW_ADD ||
-           token.type == TokenType::KW_SUBTRACT ||
-           token.type == TokenType::KW_MULTIPLY ||
-           token.type == TokenType::KW_DIVIDE;
+static bool isArithmeticOperator(TokenType type) {
+    return type == TokenType::KW_ADD ||
+           type == TokenType::KW_SUBTRACT ||
+           type == TokenType::KW_MULTIPLY ||
+           type == TokenType::KW_DIVIDE;
 }
 
-static std::string joinTokens(const std::vector<Token>& tokens, size_t start = 0, size_t end = 0) {
+static std::string_view arithmeticOperation(SymbolId word) {
+    switch (word) {
+        case WORD_ADD: return "add";
+        case WORD_SUBTRACT: return "subtract";
+        case WORD_MULTIPLY: return "multiply";
+        case WORD_DIVIDE: return "divide";
+        default: throw std::runtime_error("Expected add, subtract, multiply or divide");
+    }
+}
+
+// Joins the lexemes straight into the arena; the result is at most one byte per token longer
+// than the lexemes, so the exact buffer is sized up front and nothing is reallocated.
+static std::string_view joinTokens(AST::Arena& arena, const TokenSpan& tokens, size_t start = 0, size_t end = 0) {
     if (end == 0 || end > tokens.size()) {
         end = tokens.size();
     }
 
-    std::ostringstream oss;
+    size_t length = 0;
+    for (size_t i = start; i < end; ++i) {
+        length += tokens.lexeme(i).size() + 1;
+    }
+    if (length == 0) {
+        return std::string_view();
+    }
+
+    char* result = static_cast<char*>(arena.allocate(length, 1));
+    size_t size = 0;
     bool needsSpace = false;
     for (size_t i = start; i < end; ++i) {
-        const Token& token = tokens[i];
-        if (token.type == TokenType::COMMA) {
-            oss << ",";
+        TokenType type = tokens.type(i);
+        if (type == TokenType::COMMA) {
+            result[size++] = ',';
             needsSpace = true;
             continue;
         }
-        if (token.type == TokenType::RIGHT_BRACKET) {
-            oss << "]";
+        if (type == TokenType::RIGHT_BRACKET) {
+            result[size++] = ']';
             needsSpace = true;
             continue;
         }
-        if (needsSpace && token.type != TokenType::LEFT_BRACKET) {
-            oss << " ";
+        if (needsSpace && type != TokenType::LEFT_BRACKET) {
+            result[size++] = ' ';
         }
-        if (token.type == TokenType::LEFT_BRACKET) {
-            oss << "[";
+        if (type == TokenType::LEFT_BRACKET) {
+            result[size++] = '[';
             needsSpace = false;
         } else {
-            oss << token.lexeme;
+            std::string_view lexeme = tokens.lexeme(i);
+            std::copy(lexeme.begin(), lexeme.end(), result + size);
+            size += lexeme.size();
             needsSpace = true;
         }
     }
-    return oss.str();
+    return std::string_view(result, size);
 }
 
-static bool isArithmeticSentence(const std::vector<Token>& tokens) {
-    bool hasOperator = false;
-    bool hasEquals = false;
-    for (const auto& token : tokens) {
-        if (isArithmeticOperator(token)) {
-            hasOperator = true;
-        }
-        if (token.type == TokenType::KW_EQUALS || sameWord(token, "equals")) {
-            hasEquals = true;
+enum SentenceFeature : uint32_t {
+    FEATURE_WITH = 1u << 0,
+    FEATURE_AT = 1u << 1,
+    FEATURE_FROM = 1u << 2,
+    FEATURE_TO = 1u << 3,
+    FEATURE_EQUALS = 1u << 4,
+    FEATURE_ARITHMETIC_OPERATOR = 1u << 5,
+    FEATURE_HAS = 1u << 6,
+    FEATURE_IS = 1u << 7,
+    FEATURE_LITERAL = 1u << 8,
+    FEATURE_LEADING_ARTICLE = 1u << 9,
+    FEATURE_RECORD_INSTANCE = 1u << 10
+};
+
+struct SentenceFeatures {
+    uint32_t mask = 0;
+    SymbolId firstWord = noSymbol;
+    SymbolId secondWord = noSymbol;
+    size_t chooseIndex = std::string::npos;
+    size_t promptIndex = std::string::npos;
+};
+
+// Collects in one pass everything the narrative sentence rules look at. A record instance is
+// "<name> is [article] <type> ... with <fields>": the first "is" must not lead the sentence and
+// some "with" must follow the type without ending the sentence.
+static SentenceFeatures classifySentence(const TokenSpan& tokens) {
+    SentenceFeatures features;
+    size_t isIndex = std::string::npos;
+    size_t typeIndex = std::string::npos;
+    size_t lastWith = std::string::npos;
+    size_t previousWith = std::string::npos;
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        TokenType type = tokens.type(i);
+        SymbolId word = foldedWord(tokens, i);
+        if (i == 0) {
+            features.firstWord = word;
+        } else if (i == 1) {
+            features.secondWord = word;
         }
-    }
-    return hasOperator && hasEquals;
-}
 
-static bool isImageDeclarationSentence(const std::vector<Token>& tokens) {
-    return tokens.size() >= 8 &&
-           sameWord(tokens[0], "create") &&
-           sameWord(tokens[1], "image");
-}
-
-static bool isPixelWriteSentence(const std::vector<Token>& tokens) {
-    return tokens.size() >= 8 &&
-           (sameWord(tokens[0], "paint") || sameWord(tokens[0], "set")) &&
-           std::any_of(tokens.begin(), tokens.end(), [](const Token& token) { return sameWord(token, "at"); }) &&
-           std::any_of(tokens.begin(), tokens.end(), [](const Token& token) { return sameWord(token, "with"); });
-}
-
-static bool isImageFillSentence(const std::vector<Token>& tokens) {
-    return tokens.size() >= 5 &&
-           sameWord(tokens[0], "fill") &&
-           std::any_of(tokens.begin(), tokens.end(), [](const Token& token) { return sameWord(token, "with"); });
-}
-
-static bool isRectanglePaintSentence(const std::vector<Token>& tokens) {
-    return tokens.size() >= 10 &&
-           sameWord(tokens[0], "paint") &&
-           sameWord(tokens[1], "rectangle") &&
-           std::any_of(tokens.begin(), tokens.end(), [](const Token& token) { return sameWord(token, "from"); }) &&
-           std::any_of(tokens.begin(), tokens.end(), [](const Token& token) { return sameWord(token, "to"); }) &&
-           std::any_of(tokens.begin(), tokens.end(), [](const Token& token) { return sameWord(token, "with"); });
-}
-
-static bool isImageSaveSentence(const std::vector<Token>& tokens) {
-    return tokens.size() >= 5 &&
-           sameWord(tokens[0], "save") &&
-           sameWord(tokens[1], "image");
-}
+        switch (type) {
+            case TokenType::NUMBER:
+            case TokenType::STRING:
+            case TokenType::LEFT_BRACKET:
+                features.mask |= FEATURE_LITERAL;
+                if (type == TokenType::STRING && features.chooseIndex != std::string::npos &&
+                    features.promptIndex == std::string::npos) {
+                    features.promptIndex = i;
+                }
+                break;
+            case TokenType::KW_ADD:
+            case TokenType::KW_SUBTRACT:
+            case TokenType::KW_MULTIPLY:
+            case TokenType::KW_DIVIDE:
+                features.mask |= FEATURE_ARITHMETIC_OPERATOR;
+                break;
+            default:
+                break;
+        }
 
-static bool isRecordInstanceSentence(const std::vector<Token>& tokens) {
-    size_t isIndex = tokens.size();
-    for (size_t i = 0; i < tokens.size(); ++i) {
-        if (tokens[i].type == TokenType::KW_IS || sameWord(tokens[i], "is")) {
-            isIndex = i;
-            break;
+        if (type == TokenType::KW_EQUALS || word == WORD_EQUALS) {
+            features.mask |= FEATURE_EQUALS;
+        }
+        if (type == TokenType::KW_HAS || word == WORD_HAS) {
+            features.mask |= FEATURE_HAS;
+        }
+        if (type == TokenType::KW_IS || word == WORD_IS) {
+            features.mask |= FEATURE_IS;
+            if (isIndex == std::string::npos) {
+                isIndex = i;
+            }
+        }
+        if (features.chooseIndex == std::string::npos &&
+            (type == TokenType::KW_CHOOSE || type == TokenType::KW_INPUT ||
+             word == WORD_CHOOSE || word == WORD_INPUT)) {
+            features.chooseIndex = i;
+        }
+        if (isIndex != std::string::npos && i == isIndex + 1) {
+            typeIndex = word == WORD_A || word == WORD_AN || word == WORD_THE ? i + 1 : i;
         }
-    }
-    if (isIndex == tokens.size() || isIndex == 0) {
-        return false;
-    }
 
-    size_t typeIndex = isIndex + 1;
-    if (typeIndex < tokens.size() && isArticle(tokens[typeIndex])) {
-        typeIndex++;
-    }
-    if (typeIndex >= tokens.size()) {
-        return false;
+        if (word == WORD_WITH) {
+            features.mask |= FEATURE_WITH;
+            previousWith = lastWith;
+            lastWith = i;
+        } else if (word == WORD_AT) {
+            features.mask |= FEATURE_AT;
+        } else if (word == WORD_FROM) {
+            features.mask |= FEATURE_FROM;
+        } else if (word == WORD_TO) {
+            features.mask |= FEATURE_TO;
+        } else if (i == 0 && (word == WORD_A || word == WORD_AN || word == WORD_THE)) {
+            features.mask |= FEATURE_LEADING_ARTICLE;
+        }
     }
 
-    for (size_t i = typeIndex + 1; i < tokens.size(); ++i) {
-        if (sameWord(tokens[i], "with")) {
-            return i + 1 < tokens.size();
-        }
+    size_t withBeforeEnd = lastWith + 1 < tokens.size() ? lastWith : previousWith;
+    if (isIndex != std::string::npos && isIndex > 0 && typeIndex < tokens.size() &&
+        withBeforeEnd != std::string::npos && withBeforeEnd > typeIndex) {
+        features.mask |= FEATURE_RECORD_INSTANCE;
     }
-    return false;
+    return features;
 }
 
-static std::vector<std::vector<Token>> splitByAnd(const std::vector<Token>& tokens, size_t start = 0) {
-    std::vector<std::vector<Token>> segments;
-    std::vector<Token> current;
+static std::vector<TokenSpan> splitByAnd(const TokenSpan& tokens, size_t start = 0) {
+    std::vector<TokenSpan> segments;
+    size_t segmentStart = start;
     int bracketDepth = 0;
     for (size_t i = start; i < tokens.size(); ++i) {
-        if (tokens[i].type == TokenType::LEFT_BRACKET) {
+        TokenType type = tokens.type(i);
+        if (type == TokenType::LEFT_BRACKET) {
             bracketDepth++;
-        } else if (tokens[i].type == TokenType::RIGHT_BRACKET && bracketDepth > 0) {
+        } else if (type == TokenType::RIGHT_BRACKET && bracketDepth > 0) {
             bracketDepth--;
         }
 
-        if (bracketDepth == 0 && sameWord(tokens[i], "and")) {
-            if (!current.empty()) {
-                segments.push_back(current);
-                current.clear();
+        if (bracketDepth == 0 && sameWord(tokens, i, WORD_AND)) {
+            if (i > segmentStart) {
+                segments.push_back(tokens.subspan(segmentStart, i));
             }
-        } else {
-            current.push_back(tokens[i]);
+            segmentStart = i + 1;
         }
     }
-    if (!current.empty()) {
-        segments.push_back(current);
+    if (tokens.size() > segmentStart) {
+        segments.push_back(tokens.subspan(segmentStart, tokens.size()));
     }
     return segments;
 }
 
-static std::vector<std::string> splitExpressionsByComma(const std::vector<Token>& tokens, size_t start, size_t end) {
-    std::vector<std::string> expressions;
-    std::vector<Token> current;
+static std::vector<std::string_view> splitExpressionsByComma(AST::Arena& arena, const TokenSpan& tokens,
+                                                             size_t start, size_t end) {
+    std::vector<std::string_view> expressions;
+    size_t expressionStart = start;
     for (size_t i = start; i < end; ++i) {
-        if (tokens[i].type == TokenType::COMMA) {
-            if (!current.empty()) {
-                expressions.push_back(joinTokens(current));
-                current.clear();
+        if (tokens.type(i) == TokenType::COMMA) {
+            if (i > expressionStart) {
+                expressions.push_back(joinTokens(arena, tokens, expressionStart, i));
             }
-        } else {
-            current.push_back(tokens[i]);
+            expressionStart = i + 1;
         }
     }
-    if (!current.empty()) {
-        expressions.push_back(joinTokens(current));
+    if (end > expressionStart) {
+        expressions.push_back(joinTokens(arena, tokens, expressionStart, end));
     }
     return expressions;
 }
 
-static std::vector<std::string> parseColorExpressions(const std::vector<Token>& tokens, size_t start, size_t end) {
-    auto expressions = splitExpressionsByComma(tokens, start, end);
+static std::vector<std::string_view> parseColorExpressions(AST::Arena& arena, const TokenSpan& tokens,
+                                                           size_t start, size_t end) {
+    auto expressions = splitExpressionsByComma(arena, tokens, start, end);
     if (expressions.size() == 3) {
         return expressions;
     }
 
     if (end >= start && end - start == 3) {
-        return {tokens[start].lexeme, tokens[start + 1].lexeme, tokens[start + 2].lexeme};
+        return {arena.copy(tokens.lexeme(start)), arena.copy(tokens.lexeme(start + 1)),
+                arena.copy(tokens.lexeme(start + 2))};
     }
 
-    std::string colorName = joinTokens(tokens, start, end);
+    std::string colorName(joinTokens(arena, tokens, start, end));
     if (colorName.empty()) {
         throw std::runtime_error("Expected a color name or three color expressions");
     }
-    return {colorName + " red", colorName + " green", colorName + " blue"};
+    return {arena.copy(colorName + " red"), arena.copy(colorName + " green"), arena.copy(colorName + " blue")};
+}
+
+static std::string_view joinLexemes(AST::Arena& arena, const TokenSpan& tokens, size_t start, size_t end) {
+    size_t length = 0;
+    for (size_t i = start; i < end; ++i) {
+        length += tokens.lexeme(i).size() + 1;
+    }
+    if (length == 0) {
+        return std::string_view();
+    }
+
+    char* result = static_cast<char*>(arena.allocate(length, 1));
+    size_t size = 0;
+    for (size_t i = start; i < end; ++i) {
+        if (i > start) {
+            result[size++] = ' ';
+        }
+        std::string_view lexeme = tokens.lexeme(i);
+        std::copy(lexeme.begin(), lexeme.end(), result + size);
+        size += lexeme.size();
+    }
+    return std::string_view(result, size);
+}
+
+static AST::Operand parseOperand(AST::Arena& arena, StringInterner& names, const TokenSpan& tokens, size_t start,
+                                 size_t end) {
+    std::string_view text = joinLexemes(arena, tokens, start, end);
+    if (end - start == 1 && tokens.type(start) == TokenType::STRING) {
+        return AST::Operand(text, AST::Operand::Kind::TEXT);
+    }
+    if (isNumberLiteral(text)) {
+        return AST::Operand(text, AST::Operand::Kind::NUMBER);
+    }
+    return AST::Operand(text, AST::Operand::Kind::NAME, names.intern(text));
+}
+
+// Conditions read "<left> is [not | greater than | less than | at least | at most] <right>" or
+// "<left> equals <right>"; anything without such an operator names a story condition.
+static AST::Condition parseCondition(AST::Arena& arena, StringInterner& names, const TokenSpan& tokens,
+                                     std::string_view text) {
+    if (text.find_first_not_of(' ') == std::string_view::npos) {
+        return AST::Condition();
+    }
+
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        if (tokens.type(i) == TokenType::STRING) {
+            continue;
+        }
+        SymbolId word = foldedWord(tokens, i);
+        if (word != WORD_IS && word != WORD_EQUALS) {
+            continue;
+        }
+        if (i == 0) {
+            return AST::Condition();
+        }
+
+        size_t rightStart = i + 1;
+        AST::ComparisonOperator op = AST::ComparisonOperator::EQUAL;
+        if (word == WORD_IS && rightStart < tokens.size()) {
+            SymbolId first = foldedWord(tokens, rightStart);
+            SymbolId second = rightStart + 1 < tokens.size() ? foldedWord(tokens, rightStart + 1) : noSymbol;
+            if (first == WORD_NOT) {
+                op = AST::ComparisonOperator::NOT_EQUAL;
+                rightStart++;
+            } else if (first == WORD_GREATER && second == WORD_THAN) {
+                op = AST::ComparisonOperator::GREATER;
+                rightStart += 2;
+            } else if (first == WORD_LESS && second == WORD_THAN) {
+                op = AST::ComparisonOperator::LESS;
+                rightStart += 2;
+            } else if (first == WORD_AT && second == WORD_LEAST) {
+                op = AST::ComparisonOperator::AT_LEAST;
+                rightStart += 2;
+            } else if (first == WORD_AT && second == WORD_MOST) {
+                op = AST::ComparisonOperator::AT_MOST;
+                rightStart += 2;
+            }
+        }
+        if (rightStart >= tokens.size()) {
+            return AST::Condition();
+        }
+        return AST::Condition(parseOperand(arena, names, tokens, 0, i), op,
+                              parseOperand(arena, names, tokens, rightStart, tokens.size()));
+    }
+    return AST::Condition(AST::Operand(text, AST::Operand::Kind::NAME, names.intern(text)));
 }
 
 Parser::Parser(const std::vector<Token>& tokens)
-    : tokens(tokens), current(0) {}
+    : ownedTokens(tokens), arena(nullptr), names(nullptr), tokens(&ownedTokens), lexer(nullptr), lexerExhausted(true), current(0) {}
+
+Parser::Parser(const TokenStream& tokens)
+    : ownedTokens(std::string_view()), arena(nullptr), names(nullptr), tokens(&tokens), lexer(nullptr), lexerExhausted(true), current(0) {}
+
+Parser::Parser(Lexer& lexer)
+    : ownedTokens(lexer.input()), arena(nullptr), names(nullptr), tokens(&ownedTokens), lexer(&lexer), lexerExhausted(false), current(0) {}
+
+bool Parser::hasToken(size_t index) const {
+    while (ownedTokens.size() <= index && !lexerExhausted) {
+        Token token = lexer->next();
+        ownedTokens.append(token);
+        lexerExhausted = token.type == TokenType::END_OF_FILE;
+    }
+    return index < tokens->size();
+}
+
+Token Parser::tokenAt(size_t index) const {
+    return tokens->at(index);
+}
+
+SymbolId Parser::wordAt(size_t index) const {
+    SymbolId word = tokens->word(index);
+    if (word != noSymbol || !carriesWord(tokens->type(index))) {
+        return word;
+    }
+    return StringInterner::knownWord(tokens->lexeme(index));
+}
+
+void Parser::releaseConsumedTokens() {
+    if (lexer == nullptr || current <= 1) {
+        return;
+    }
+    ownedTokens.discardFront(current - 1);
+    current = 1;
+}
 
 bool Parser::isAtEnd() const {
-    return current >= tokens.size() || tokens[current].type == TokenType::END_OF_FILE;
+    return !hasToken(current) || tokens->type(current) == TokenType::END_OF_FILE;
 }
 
-const Token& Parser::peek() const {
-    return tokens[current];
+Token Parser::peek() const {
+    hasToken(current);
+    return tokenAt(current);
 }
 
-const Token& Parser::previous() const {
-    return tokens[current - 1];
+Token Parser::previous() const {
+    return tokenAt(current - 1);
 }
 
-const Token& Parser::advance() {
+Token Parser::advance() {
     if (!isAtEnd()) current++;
     return previous();
 }
 
 bool Parser::check(TokenType expected) const {
     if (isAtEnd()) return false;
-    return peek().type == expected;
+    return tokens->type(current) == expected;
 }
 
 bool Parser::match(TokenType expected) {
@@ -260,62 +454,97 @@ bool Parser::match(TokenType expected) {
     return false;
 }
 
-const Token& Parser::consume(TokenType type, const std::string& errorMessage) {
+Token Parser::consume(TokenType type, const std::string& errorMessage) {
     if (check(type)) return advance();
+    size_t index = hasToken(current) ? current : tokens->size() - 1;
     std::ostringstream oss;
-    oss << errorMessage << " at line " << peek().line << ", column " << peek().column;
+    oss << errorMessage << " at line " << tokens->line(index) << ", column " << tokens->column(index);
     throw std::runtime_error(oss.str());
 }
 
-const Token& Parser::lookAhead(size_t offset) const {
-    if (current + offset >= tokens.size()) {
-        return tokens.back();
+Token Parser::lookAhead(size_t offset) const {
+    if (!hasToken(current + offset)) {
+        return tokenAt(tokens->size() - 1);
     }
-    return tokens[current + offset];
+    return tokenAt(current + offset);
 }
 
 bool Parser::checkEndMarker() const {
-    if (current + 3 >= tokens.size()) {
+    if (!hasToken(current + 3)) {
         return false;
     }
-    return toLower(tokens[current].lexeme) == "the" &&
-           toLower(tokens[current + 1].lexeme) == "story" &&
-           toLower(tokens[current + 2].lexeme) == "ends" &&
-           tokens[current + 3].type == TokenType::PERIOD;
+    return wordAt(current) == WORD_THE &&
+           wordAt(current + 1) == WORD_STORY &&
+           wordAt(current + 2) == WORD_ENDS &&
+           tokens->type(current + 3) == TokenType::PERIOD;
 }
 
-bool Parser::isKeyword(const std::string& word, const std::string& keyword) const {
-    return toLower(word) == toLower(keyword);
+std::unique_ptr<AST::Story> Parser::parseStory() {
+    beginStory();
+    auto story = std::make_unique<AST::Story>();
+    while (auto stmt = nextStatement(story->arena, story->names)) {
+        story->statements.push_back(story->arena, stmt);
+    }
+    return story;
 }
 
-std::unique_ptr<AST::Story> Parser::parseStory() {
+void Parser::beginStory() {
     consume(TokenType::KW_ONCE, "The script must start with 'Once upon a time.'");
     consume(TokenType::KW_UPON, "The script must start with 'Once upon a time.'");
     consume(TokenType::KW_A, "The script must start with 'Once upon a time.'");
     consume(TokenType::KW_TIME, "The script must start with 'Once upon a time.'");
     consume(TokenType::PERIOD, "Expected end of sentence after 'Once upon a time'");
+}
 
-    auto story = std::make_unique<AST::Story>();
-    while (!isAtEnd() && !checkEndMarker()) {
-        auto stmt = parseStatement();
-        if (stmt) {
-            story->statements.push_back(std::move(stmt));
-        }
+AST::Statement* Parser::nextStatement(AST::Arena& arena, StringInterner& names) {
+    this->arena = &arena;
+    this->names = &names;
+    if (checkEndMarker()) {
+        advance();
+        advance();
+        advance();
+        advance();
+        return nullptr;
     }
-
-    if (!checkEndMarker()) {
+    if (isAtEnd()) {
         throw std::runtime_error("The script must end with 'The story ends.'");
     }
-    advance();
-    advance();
-    advance();
-    advance();
-    return story;
+    return parseStatement();
+}
+
+bool Parser::atDeclaration() const {
+    return check(TokenType::KW_DEFINE_FUNCTION);
+}
+
+const char* Parser::consumedEnd() const {
+    Token last = previous();
+    const char* end = last.lexeme.data() + last.lexeme.size();
+    return last.type == TokenType::STRING ? end + 1 : end;
+}
+
+// Parses one statement together with everything nested in it. Blocks are tracked on
+// openBlocks rather than the call stack, so nesting depth is only limited by memory.
+AST::Statement* Parser::parseStatement() {
+    openBlocks.clear();
+    AST::Statement* statement = openStatement();
+    while (!openBlocks.empty()) {
+        AST::NodeList<AST::Statement*>* block = openBlocks.back().block;
+        if (block == nullptr || atBlockEnd()) {
+            closeBlock();
+            continue;
+        }
+        if (auto nested = openStatement()) {
+            block->push_back(*arena, nested);
+        }
+    }
+    return statement;
 }
 
-std::unique_ptr<AST::Statement> Parser::parseStatement() {
+// Parses a simple statement, or the header of a compound one, whose block is left open.
+AST::Statement* Parser::openStatement() {
+    releaseConsumedTokens();
     if (check(TokenType::KW_IF)) {
-        return parseConditionalStatement();
+        return openConditionalStatement(true);
     }
     if (check(TokenType::KW_CHOOSE) || check(TokenType::KW_INPUT)) {
         return parseInteractiveStatement();
@@ -324,23 +553,23 @@ std::unique_ptr<AST::Statement> Parser::parseStatement() {
         return parseRandomStatement();
     }
     if (check(TokenType::KW_WHILE)) {
-        return parseWhileStatement();
+        return openWhileStatement();
     }
     if (check(TokenType::KW_FOR)) {
         if (lookAhead(1).type == TokenType::KW_EACH &&
             lookAhead(3).type == TokenType::IDENTIFIER &&
-            sameWord(lookAhead(3), "from")) {
-            return parseForRangeStatement();
+            sameWord(lookAhead(3), WORD_FROM)) {
+            return openForRangeStatement();
         }
-        return parseForEachStatement();
+        return openForEachStatement();
     }
     if (check(TokenType::KW_DEFINE_FUNCTION)) {
-        if ((lookAhead(1).type == TokenType::IDENTIFIER && sameWord(lookAhead(1), "record")) ||
-            (lookAhead(1).type == TokenType::IDENTIFIER && sameWord(lookAhead(1), "the") &&
-             lookAhead(2).type == TokenType::IDENTIFIER && sameWord(lookAhead(2), "record"))) {
+        if ((lookAhead(1).type == TokenType::IDENTIFIER && sameWord(lookAhead(1), WORD_RECORD)) ||
+            (lookAhead(1).type == TokenType::IDENTIFIER && sameWord(lookAhead(1), WORD_THE) &&
+             lookAhead(2).type == TokenType::IDENTIFIER && sameWord(lookAhead(2), WORD_RECORD))) {
             return parseRecordDeclaration();
         }
-        return parseFunctionDeclaration();
+        return openFunctionDeclaration();
     }
     if (check(TokenType::KW_CALL)) {
         return parseFunctionCall();
@@ -357,124 +586,85 @@ std::unique_ptr<AST::Statement> Parser::parseStatement() {
     return parseNarrativeStatement();
 }
 
-std::unique_ptr<AST::Statement> Parser::parseNarrativeStatement() {
-    std::vector<Token> tokensInSentence;
+AST::Statement* Parser::parseNarrativeStatement() {
+    size_t sentenceStart = current;
     while (!check(TokenType::PERIOD) && !isAtEnd()) {
-        tokensInSentence.push_back(advance());
+        current++;
     }
+    TokenSpan tokensInSentence(*tokens, sentenceStart, current);
     consume(TokenType::PERIOD, "Expected '.' at the end of the sentence");
 
-    if (isRecordInstanceSentence(tokensInSentence)) {
+    struct SentenceRule {
+        size_t minimumTokens;
+        KnownWord firstWord;
+        KnownWord alternateFirstWord;
+        KnownWord secondWord;
+        uint32_t requiredFeatures;
+        AST::Statement* (Parser::*parse)(const TokenSpan&);
+    };
+    static const SentenceRule rules[] = {
+        {8, WORD_CREATE, WORD_CREATE, WORD_IMAGE, 0, &Parser::parseImageDeclaration},
+        {5, WORD_FILL, WORD_FILL, KNOWN_WORD_COUNT, FEATURE_WITH, &Parser::parseImageFillStatement},
+        {10, WORD_PAINT, WORD_PAINT, WORD_RECTANGLE, FEATURE_FROM | FEATURE_TO | FEATURE_WITH,
+         &Parser::parseRectanglePaintStatement},
+        {8, WORD_PAINT, WORD_SET, KNOWN_WORD_COUNT, FEATURE_AT | FEATURE_WITH, &Parser::parsePixelWriteStatement},
+        {5, WORD_SAVE, WORD_SAVE, WORD_IMAGE, 0, &Parser::parseImageSaveStatement},
+        {0, KNOWN_WORD_COUNT, KNOWN_WORD_COUNT, KNOWN_WORD_COUNT, FEATURE_ARITHMETIC_OPERATOR | FEATURE_EQUALS,
+         &Parser::parseArithmeticStatement},
+    };
+
+    SentenceFeatures features = classifySentence(tokensInSentence);
+    if (features.mask & FEATURE_RECORD_INSTANCE) {
         return parseRecordInstanceDeclaration(tokensInSentence);
     }
-    if (isImageDeclarationSentence(tokensInSentence)) {
-        return parseImageDeclaration(tokensInSentence);
-    }
-    if (isImageFillSentence(tokensInSentence)) {
-        return parseImageFillStatement(tokensInSentence);
-    }
-    if (isRectanglePaintSentence(tokensInSentence)) {
-        return parseRectanglePaintStatement(tokensInSentence);
-    }
-    if (isPixelWriteSentence(tokensInSentence)) {
-        return parsePixelWriteStatement(tokensInSentence);
-    }
-    if (isImageSaveSentence(tokensInSentence)) {
-        return parseImageSaveStatement(tokensInSentence);
-    }
-    if (isArithmeticSentence(tokensInSentence)) {
-        return parseArithmeticStatement(tokensInSentence);
-    }
-
-    for (size_t i = 0; i < tokensInSentence.size(); ++i) {
-        if (tokensInSentence[i].type == TokenType::KW_CHOOSE ||
-            tokensInSentence[i].type == TokenType::KW_INPUT ||
-            sameWord(tokensInSentence[i], "choose") ||
-            sameWord(tokensInSentence[i], "input")) {
-            for (size_t j = i + 1; j < tokensInSentence.size(); ++j) {
-                if (tokensInSentence[j].type == TokenType::STRING) {
-                    return std::make_unique<AST::InteractiveStatement>(tokensInSentence[j].lexeme);
-                }
-            }
-            return std::make_unique<AST::InteractiveStatement>(joinTokens(tokensInSentence, i + 1));
+    for (const auto& rule : rules) {
+        if (tokensInSentence.size() >= rule.minimumTokens &&
+            (rule.firstWord == KNOWN_WORD_COUNT || features.firstWord == rule.firstWord ||
+             features.firstWord == rule.alternateFirstWord) &&
+            (rule.secondWord == KNOWN_WORD_COUNT || features.secondWord == rule.secondWord) &&
+            (features.mask & rule.requiredFeatures) == rule.requiredFeatures) {
+            return (this->*rule.parse)(tokensInSentence);
         }
     }
 
-    bool hasDeclarationMarker = false;
-    bool startsWithArticle = !tokensInSentence.empty() && isArticle(tokensInSentence.front());
-    bool hasLiteralValue = false;
-    for (const auto& token : tokensInSentence) {
-        if (token.type == TokenType::NUMBER || token.type == TokenType::STRING ||
-            token.type == TokenType::LEFT_BRACKET) {
-            hasLiteralValue = true;
-            break;
-        }
-    }
-    for (const auto& token : tokensInSentence) {
-        if (token.type == TokenType::KW_HAS || sameWord(token, "has")) {
-            hasDeclarationMarker = true;
-            break;
-        }
-        if ((token.type == TokenType::KW_IS || sameWord(token, "is")) &&
-            (startsWithArticle || hasLiteralValue)) {
-            hasDeclarationMarker = true;
-            break;
+    if (features.chooseIndex != std::string::npos) {
+        if (features.promptIndex != std::string::npos) {
+            return arena->make<AST::InteractiveStatement>(arena->copy(tokensInSentence.lexeme(features.promptIndex)));
         }
+        return arena->make<AST::InteractiveStatement>(joinTokens(*arena, tokensInSentence, features.chooseIndex + 1));
     }
 
-    if (hasDeclarationMarker) {
+    if ((features.mask & FEATURE_HAS) ||
+        ((features.mask & FEATURE_IS) && (features.mask & (FEATURE_LEADING_ARTICLE | FEATURE_LITERAL)))) {
         return parseVariableDeclarationBlock(tokensInSentence);
     }
 
-    return std::make_unique<AST::NarrativeStatement>(joinTokens(tokensInSentence));
+    return arena->make<AST::NarrativeStatement>(joinTokens(*arena, tokensInSentence));
 }
 
-std::unique_ptr<AST::Statement> Parser::parseConditionalStatement() {
-    return parseConditionalStatement(true);
-}
-
-std::unique_ptr<AST::Statement> Parser::parseConditionalStatement(bool consumeEndMarker) {
+AST::Statement* Parser::openConditionalStatement(bool consumeEndMarker) {
     consume(TokenType::KW_IF, "Expected 'if' to start a condition");
 
-    std::ostringstream conditionStream;
+    size_t conditionStart = current;
     while (!isAtEnd() && !check(TokenType::KW_THEN)) {
-        conditionStream << advance().lexeme << " ";
-    }
-    std::string condition = conditionStream.str();
-    if (!condition.empty() && condition.back() == ' ') {
-        condition.pop_back();
+        current++;
     }
+    TokenSpan conditionTokens(*tokens, conditionStart, current);
+    std::string_view condition = joinLexemes(*arena, conditionTokens, 0, conditionTokens.size());
+    AST::Condition test = parseCondition(*arena, *names, conditionTokens, condition);
     consume(TokenType::KW_THEN, "Expected 'then' after the condition");
 
-    auto condStmt = std::make_unique<AST::ConditionalStatement>(condition);
-    condStmt->thenBranch = parseBlock();
-
-    if (check(TokenType::KW_ELSE)) {
-        advance();
-        if (check(TokenType::KW_IF)) {
-            condStmt->elseBranch.push_back(parseConditionalStatement(false));
-        } else {
-            condStmt->elseBranch = parseBlock();
-        }
-    }
-
-    if (consumeEndMarker) {
-        if (check(TokenType::KW_END) || check(TokenType::KW_ENDIF)) {
-            advance();
-            consume(TokenType::PERIOD, "Expected '.' after condition terminator");
-        } else {
-            throw std::runtime_error("Expected 'end.' or 'endif.' to close the condition");
-        }
-    }
+    auto condStmt = arena->make<AST::ConditionalStatement>(condition, test);
+    openBlocks.push_back({condStmt, &condStmt->thenBranch, consumeEndMarker});
     return condStmt;
 }
 
-std::unique_ptr<AST::Statement> Parser::parseInteractiveStatement() {
+AST::Statement* Parser::parseInteractiveStatement() {
     advance();
     if (check(TokenType::STRING)) {
-        std::string prompt = advance().lexeme;
+        std::string prompt(advance().lexeme);
         consume(TokenType::PERIOD, "Expected '.' at the end of the interactive instruction");
-        return std::make_unique<AST::InteractiveStatement>(prompt);
+        return arena->make<AST::InteractiveStatement>(prompt);
     }
 
     std::ostringstream promptStream;
@@ -486,37 +676,37 @@ std::unique_ptr<AST::Statement> Parser::parseInteractiveStatement() {
         prompt.pop_back();
     }
     consume(TokenType::PERIOD, "Expected '.' at the end of the interactive instruction");
-    return std::make_unique<AST::InteractiveStatement>(prompt);
+    return arena->make<AST::InteractiveStatement>(prompt);
 }
 
-std::unique_ptr<AST::Statement> Parser::parseRandomStatement() {
+AST::Statement* Parser::parseRandomStatement() {
     advance();
     std::ostringstream subjectStream;
-    while (!isAtEnd() && !sameWord(peek(), "leans")) {
+    while (!isAtEnd() && !sameWord(peek(), WORD_LEANS)) {
         subjectStream << advance().lexeme << " ";
     }
     std::string subject = subjectStream.str();
     if (!subject.empty() && subject.back() == ' ') {
         subject.pop_back();
     }
-    if (isAtEnd() || !sameWord(peek(), "leans")) {
+    if (isAtEnd() || !sameWord(peek(), WORD_LEANS)) {
         throw std::runtime_error("Expected 'leans' in random instruction");
     }
     advance();
-    if (isAtEnd() || !sameWord(peek(), "towards")) {
+    if (isAtEnd() || !sameWord(peek(), WORD_TOWARDS)) {
         throw std::runtime_error("Expected 'towards' in random instruction");
     }
     advance();
 
     std::ostringstream firstStateStream;
-    while (!isAtEnd() && !sameWord(peek(), "or")) {
+    while (!isAtEnd() && !sameWord(peek(), WORD_OR)) {
         firstStateStream << advance().lexeme << " ";
     }
     std::string firstState = firstStateStream.str();
     if (!firstState.empty() && firstState.back() == ' ') {
         firstState.pop_back();
     }
-    if (isAtEnd() || !sameWord(peek(), "or")) {
+    if (isAtEnd() || !sameWord(peek(), WORD_OR)) {
         throw std::runtime_error("Expected 'or' in random instruction");
     }
     advance();
@@ -530,37 +720,32 @@ std::unique_ptr<AST::Statement> Parser::parseRandomStatement() {
         secondState.pop_back();
     }
     consume(TokenType::PERIOD, "Expected '.' at the end of the random instruction");
-    return std::make_unique<AST::RandomStatement>(subject, std::make_pair(firstState, secondState));
+    return arena->make<AST::RandomStatement>(subject, std::make_pair(arena->copy(firstState), arena->copy(secondState)));
 }
 
-std::unique_ptr<AST::Statement> Parser::parseWhileStatement() {
+AST::Statement* Parser::openWhileStatement() {
     advance();
-    std::ostringstream conditionStream;
-    bool hasConditionToken = false;
+    size_t conditionStart = current;
     while (!check(TokenType::PERIOD) && !isAtEnd()) {
-        if (hasConditionToken && startsStatement(peek())) {
+        if (current > conditionStart && startsStatement(peek())) {
             break;
         }
-        conditionStream << advance().lexeme << " ";
-        hasConditionToken = true;
-    }
-    std::string condition = conditionStream.str();
-    if (!condition.empty() && condition.back() == ' ') {
-        condition.pop_back();
+        current++;
     }
+    TokenSpan conditionTokens(*tokens, conditionStart, current);
+    std::string_view condition = joinLexemes(*arena, conditionTokens, 0, conditionTokens.size());
+    AST::Condition test = parseCondition(*arena, *names, conditionTokens, condition);
     match(TokenType::PERIOD);
 
-    auto whileStmt = std::make_unique<AST::WhileStatement>(condition);
-    whileStmt->body = parseBlock();
-    consume(TokenType::KW_ENDWHILE, "Expected 'endwhile' to close the while loop");
-    consume(TokenType::PERIOD, "Expected '.' after 'endwhile'");
+    auto whileStmt = arena->make<AST::WhileStatement>(condition, test);
+    openBlocks.push_back({whileStmt, &whileStmt->body, true});
     return whileStmt;
 }
 
-std::unique_ptr<AST::Statement> Parser::parseForEachStatement() {
+AST::Statement* Parser::openForEachStatement() {
     advance();
     consume(TokenType::KW_EACH, "Expected 'each' after 'for'");
-    std::string iterator = advance().lexeme;
+    std::string iterator(advance().lexeme);
     consume(TokenType::KW_IN, "Expected 'in' in the for each loop");
 
     std::ostringstream collectionStream;
@@ -573,31 +758,29 @@ std::unique_ptr<AST::Statement> Parser::parseForEachStatement() {
     }
     consume(TokenType::KW_DO, "Expected 'do' in the for each loop");
 
-    auto forEachStmt = std::make_unique<AST::ForEachStatement>(iterator, collection);
-    forEachStmt->body = parseBlock();
-    consume(TokenType::KW_ENDFOR, "Expected 'endfor' to close the for each loop");
-    consume(TokenType::PERIOD, "Expected '.' after 'endfor'");
+    auto forEachStmt = arena->make<AST::ForEachStatement>(iterator, collection);
+    openBlocks.push_back({forEachStmt, &forEachStmt->body, true});
     return forEachStmt;
 }
 
-std::unique_ptr<AST::Statement> Parser::parseForRangeStatement() {
+AST::Statement* Parser::openForRangeStatement() {
     advance();
     consume(TokenType::KW_EACH, "Expected 'each' after 'for'");
-    std::string iterator = advance().lexeme;
-    if (!sameWord(peek(), "from")) {
+    std::string iterator(advance().lexeme);
+    if (!sameWord(peek(), WORD_FROM)) {
         throw std::runtime_error("Expected 'from' in the numeric for loop");
     }
     advance();
 
     std::ostringstream startStream;
-    while (!isAtEnd() && !sameWord(peek(), "to")) {
+    while (!isAtEnd() && !sameWord(peek(), WORD_TO)) {
         startStream << advance().lexeme << " ";
     }
     std::string start = startStream.str();
     if (!start.empty() && start.back() == ' ') {
         start.pop_back();
     }
-    if (!sameWord(peek(), "to")) {
+    if (!sameWord(peek(), WORD_TO)) {
         throw std::runtime_error("Expected 'to' in the numeric for loop");
     }
     advance();
@@ -612,65 +795,62 @@ std::unique_ptr<AST::Statement> Parser::parseForRangeStatement() {
     }
     consume(TokenType::KW_DO, "Expected 'do' in the numeric for loop");
 
-    auto forRangeStmt = std::make_unique<AST::ForRangeStatement>(iterator, start, end);
-    forRangeStmt->body = parseBlock();
-    consume(TokenType::KW_ENDFOR, "Expected 'endfor' to close the numeric for loop");
-    consume(TokenType::PERIOD, "Expected '.' after 'endfor'");
+    auto forRangeStmt = arena->make<AST::ForRangeStatement>(iterator, start, end);
+    openBlocks.push_back({forRangeStmt, &forRangeStmt->body, true});
     return forRangeStmt;
 }
 
-std::unique_ptr<AST::Statement> Parser::parseFunctionDeclaration() {
+AST::Statement* Parser::openFunctionDeclaration() {
     advance();
-    if (!sameWord(peek(), "the")) {
+    if (!sameWord(peek(), WORD_THE)) {
         throw std::runtime_error("Expected 'the' after 'define'");
     }
     advance();
-    if (!sameWord(peek(), "function")) {
+    if (!sameWord(peek(), WORD_FUNCTION)) {
         throw std::runtime_error("Expected 'function' after 'define the'");
     }
     advance();
-    std::string funcName = advance().lexeme;
-    if (!sameWord(peek(), "as")) {
+    std::string funcName(advance().lexeme);
+    if (!sameWord(peek(), WORD_AS)) {
         throw std::runtime_error("Expected 'as' after the function name");
     }
     advance();
     match(TokenType::PERIOD);
 
-    auto funcDecl = std::make_unique<AST::FunctionDeclaration>(funcName);
-    funcDecl->body = parseBlock();
-    consume(TokenType::KW_ENDFUNCTION, "Expected 'endfunction' to close the function");
-    consume(TokenType::PERIOD, "Expected '.' after 'endfunction'");
+    auto funcDecl = arena->make<AST::FunctionDeclaration>(funcName);
+    openBlocks.push_back({funcDecl, &funcDecl->body, true});
     return funcDecl;
 }
 
-std::unique_ptr<AST::Statement> Parser::parseFunctionCall() {
+AST::Statement* Parser::parseFunctionCall() {
     advance();
-    std::string funcName = advance().lexeme;
+    std::string funcName(advance().lexeme);
     consume(TokenType::PERIOD, "Expected '.' after the function call");
-    return std::make_unique<AST::FunctionCall>(funcName);
+    return arena->make<AST::FunctionCall>(funcName);
 }
 
-std::unique_ptr<AST::Statement> Parser::parseReturnStatement() {
+AST::Statement* Parser::parseReturnStatement() {
     advance();
     match(TokenType::PERIOD);
-    return std::make_unique<AST::ReturnStatement>();
+    return arena->make<AST::ReturnStatement>();
 }
 
-std::unique_ptr<AST::Statement> Parser::parseCommentStatement() {
-    std::string comment = advance().lexeme;
+AST::Statement* Parser::parseCommentStatement() {
+    std::string comment(advance().lexeme);
     while (!check(TokenType::PERIOD) && !isAtEnd()) {
-        comment += " " + advance().lexeme;
+        comment += ' ';
+        comment += advance().lexeme;
     }
     consume(TokenType::PERIOD, "Expected '.' at the end of the comment");
-    return std::make_unique<AST::CommentStatement>(comment);
+    return arena->make<AST::CommentStatement>(comment);
 }
 
-std::unique_ptr<AST::Statement> Parser::parseRecordDeclaration() {
+AST::Statement* Parser::parseRecordDeclaration() {
     advance();
-    if (sameWord(peek(), "the")) {
+    if (sameWord(peek(), WORD_THE)) {
         advance();
     }
-    if (!sameWord(peek(), "record")) {
+    if (!sameWord(peek(), WORD_RECORD)) {
         throw std::runtime_error("Expected 'record' after 'define'");
     }
     advance();
@@ -678,19 +858,20 @@ std::unique_ptr<AST::Statement> Parser::parseRecordDeclaration() {
     if (check(TokenType::PERIOD) || isAtEnd()) {
         throw std::runtime_error("Expected a record name");
     }
-    std::string recordName = advance().lexeme;
-    if (!sameWord(peek(), "with")) {
+    std::string recordName(advance().lexeme);
+    if (!sameWord(peek(), WORD_WITH)) {
         throw std::runtime_error("Expected 'with' after the record name");
     }
     advance();
 
-    std::vector<Token> fieldTokens;
+    size_t fieldStart = current;
     while (!check(TokenType::PERIOD) && !isAtEnd()) {
-        fieldTokens.push_back(advance());
+        current++;
     }
+    TokenSpan fieldTokens(*tokens, fieldStart, current);
     consume(TokenType::PERIOD, "Expected '.' after the record declaration");
 
-    std::vector<std::pair<std::string, std::string>> fields;
+    AST::NodeList<AST::Field> fields;
     for (const auto& segment : splitByAnd(fieldTokens)) {
         if (segment.size() < 2) {
             throw std::runtime_error("Expected record field form '<field> <type>'");
@@ -698,42 +879,42 @@ std::unique_ptr<AST::Statement> Parser::parseRecordDeclaration() {
 
         size_t separator = segment.size();
         for (size_t i = 0; i < segment.size(); ++i) {
-            if (sameWord(segment[i], "of") || sameWord(segment[i], "is") || sameWord(segment[i], "as")) {
+            if (sameWord(segment, i, WORD_OF) || sameWord(segment, i, WORD_IS) || sameWord(segment, i, WORD_AS)) {
                 separator = i;
                 break;
             }
         }
 
-        std::string fieldName;
-        std::string fieldType;
+        std::string_view fieldName;
+        std::string_view fieldType;
         if (separator != segment.size()) {
             if (separator == 0 || separator + 1 >= segment.size()) {
                 throw std::runtime_error("Expected record field form '<field> of <type>'");
             }
-            fieldName = joinTokens(segment, 0, separator);
-            fieldType = joinTokens(segment, separator + 1);
+            fieldName = joinTokens(*arena, segment, 0, separator);
+            fieldType = joinTokens(*arena, segment, separator + 1);
         } else {
-            fieldName = joinTokens(segment, 0, segment.size() - 1);
-            fieldType = segment.back().lexeme;
+            fieldName = joinTokens(*arena, segment, 0, segment.size() - 1);
+            fieldType = arena->copy(segment.lexeme(segment.size() - 1));
         }
 
         if (fieldName.empty() || fieldType.empty()) {
             throw std::runtime_error("Expected record field name and type");
         }
-        fields.emplace_back(fieldName, fieldType);
+        fields.push_back(*arena, AST::Field{fieldName, fieldType});
     }
 
-    return std::make_unique<AST::RecordDeclaration>(recordName, std::move(fields));
+    return arena->make<AST::RecordDeclaration>(recordName, fields);
 }
 
-std::unique_ptr<AST::Statement> Parser::parseArithmeticStatement(const std::vector<Token>& tokensInSentence) {
+AST::Statement* Parser::parseArithmeticStatement(const TokenSpan& tokensInSentence) {
     size_t operatorIndex = tokensInSentence.size();
     size_t equalsIndex = tokensInSentence.size();
     for (size_t i = 0; i < tokensInSentence.size(); ++i) {
-        if (operatorIndex == tokensInSentence.size() && isArithmeticOperator(tokensInSentence[i])) {
+        if (operatorIndex == tokensInSentence.size() && isArithmeticOperator(tokensInSentence.type(i))) {
             operatorIndex = i;
         }
-        if (tokensInSentence[i].type == TokenType::KW_EQUALS || sameWord(tokensInSentence[i], "equals")) {
+        if (tokensInSentence.type(i) == TokenType::KW_EQUALS || sameWord(tokensInSentence, i, WORD_EQUALS)) {
             equalsIndex = i;
             break;
         }
@@ -744,30 +925,30 @@ std::unique_ptr<AST::Statement> Parser::parseArithmeticStatement(const std::vect
         throw std::runtime_error("Expected arithmetic form '<left> <operation> <right> equals <target>'");
     }
 
-    std::string operation = toLower(tokensInSentence[operatorIndex].lexeme);
-    return std::make_unique<AST::ArithmeticStatement>(
-        joinTokens(tokensInSentence, 0, operatorIndex),
+    std::string_view operation = arithmeticOperation(foldedWord(tokensInSentence, operatorIndex));
+    return arena->make<AST::ArithmeticStatement>(
+        joinTokens(*arena, tokensInSentence, 0, operatorIndex),
         operation,
-        joinTokens(tokensInSentence, operatorIndex + 1, equalsIndex),
-        joinTokens(tokensInSentence, equalsIndex + 1));
+        joinTokens(*arena, tokensInSentence, operatorIndex + 1, equalsIndex),
+        joinTokens(*arena, tokensInSentence, equalsIndex + 1));
 }
 
-std::unique_ptr<AST::Statement> Parser::parseRecordInstanceDeclaration(const std::vector<Token>& tokensInSentence) {
+AST::Statement* Parser::parseRecordInstanceDeclaration(const TokenSpan& tokensInSentence) {
     size_t isIndex = tokensInSentence.size();
     for (size_t i = 0; i < tokensInSentence.size(); ++i) {
-        if (tokensInSentence[i].type == TokenType::KW_IS || sameWord(tokensInSentence[i], "is")) {
+        if (tokensInSentence.type(i) == TokenType::KW_IS || sameWord(tokensInSentence, i, WORD_IS)) {
             isIndex = i;
             break;
         }
     }
 
     size_t typeIndex = isIndex + 1;
-    if (typeIndex < tokensInSentence.size() && isArticle(tokensInSentence[typeIndex])) {
+    if (typeIndex < tokensInSentence.size() && isArticle(tokensInSentence, typeIndex)) {
         typeIndex++;
     }
     size_t withIndex = tokensInSentence.size();
     for (size_t i = typeIndex + 1; i < tokensInSentence.size(); ++i) {
-        if (sameWord(tokensInSentence[i], "with")) {
+        if (sameWord(tokensInSentence, i, WORD_WITH)) {
             withIndex = i;
             break;
         }
@@ -777,30 +958,30 @@ std::unique_ptr<AST::Statement> Parser::parseRecordInstanceDeclaration(const std
         throw std::runtime_error("Expected record instance form '<name> is a <Record> with <field> <value>'");
     }
 
-    std::vector<std::pair<std::string, std::string>> fieldValues;
+    AST::NodeList<AST::FieldValue> fieldValues;
     for (const auto& segment : splitByAnd(tokensInSentence, withIndex + 1)) {
         if (segment.size() < 2) {
             throw std::runtime_error("Expected record value form '<field> <value>'");
         }
         size_t valueStart = 1;
-        if (segment.size() >= 3 && (sameWord(segment[1], "of") || sameWord(segment[1], "is"))) {
+        if (segment.size() >= 3 && (sameWord(segment, 1, WORD_OF) || sameWord(segment, 1, WORD_IS))) {
             valueStart = 2;
         }
-        std::string fieldName = segment[0].lexeme;
-        std::string value = joinTokens(segment, valueStart);
+        std::string_view fieldName = arena->copy(segment.lexeme(0));
+        std::string_view value = joinTokens(*arena, segment, valueStart);
         if (fieldName.empty() || value.empty()) {
             throw std::runtime_error("Expected record field name and value");
         }
-        fieldValues.emplace_back(fieldName, value);
+        fieldValues.push_back(*arena, AST::FieldValue{fieldName, value});
     }
 
-    return std::make_unique<AST::RecordInstanceDeclaration>(
-        joinTokens(tokensInSentence, 0, isIndex),
-        tokensInSentence[typeIndex].lexeme,
-        std::move(fieldValues));
+    return arena->make<AST::RecordInstanceDeclaration>(
+        joinTokens(*arena, tokensInSentence, 0, isIndex),
+        arena->copy(tokensInSentence.lexeme(typeIndex)),
+        fieldValues);
 }
 
-std::unique_ptr<AST::Statement> Parser::parseImageDeclaration(const std::vector<Token>& tokensInSentence) {
+AST::Statement* Parser::parseImageDeclaration(const TokenSpan& tokensInSentence) {
     if (tokensInSentence.size() < 9) {
         throw std::runtime_error("Expected image form 'Create image <name> with width <width> and height <height>'");
     }
@@ -809,12 +990,12 @@ std::unique_ptr<AST::Statement> Parser::parseImageDeclaration(const std::vector<
     size_t andIndex = tokensInSentence.size();
     size_t heightIndex = tokensInSentence.size();
     for (size_t i = 0; i < tokensInSentence.size(); ++i) {
-        if (widthIndex == tokensInSentence.size() && sameWord(tokensInSentence[i], "width")) {
+        if (widthIndex == tokensInSentence.size() && sameWord(tokensInSentence, i, WORD_WIDTH)) {
             widthIndex = i;
         } else if (widthIndex != tokensInSentence.size() && andIndex == tokensInSentence.size() &&
-                   sameWord(tokensInSentence[i], "and")) {
+                   sameWord(tokensInSentence, i, WORD_AND)) {
             andIndex = i;
-        } else if (andIndex != tokensInSentence.size() && sameWord(tokensInSentence[i], "height")) {
+        } else if (andIndex != tokensInSentence.size() && sameWord(tokensInSentence, i, WORD_HEIGHT)) {
             heightIndex = i;
             break;
         }
@@ -826,19 +1007,19 @@ std::unique_ptr<AST::Statement> Parser::parseImageDeclaration(const std::vector<
         throw std::runtime_error("Expected image form 'Create image <name> with width <width> and height <height>'");
     }
 
-    return std::make_unique<AST::ImageDeclaration>(
-        tokensInSentence[2].lexeme,
-        joinTokens(tokensInSentence, widthIndex + 1, andIndex),
-        joinTokens(tokensInSentence, heightIndex + 1));
+    return arena->make<AST::ImageDeclaration>(
+        arena->copy(tokensInSentence.lexeme(2)),
+        joinTokens(*arena, tokensInSentence, widthIndex + 1, andIndex),
+        joinTokens(*arena, tokensInSentence, heightIndex + 1));
 }
 
-std::unique_ptr<AST::Statement> Parser::parsePixelWriteStatement(const std::vector<Token>& tokensInSentence) {
+AST::Statement* Parser::parsePixelWriteStatement(const TokenSpan& tokensInSentence) {
     size_t atIndex = tokensInSentence.size();
     size_t withIndex = tokensInSentence.size();
     for (size_t i = 0; i < tokensInSentence.size(); ++i) {
-        if (atIndex == tokensInSentence.size() && sameWord(tokensInSentence[i], "at")) {
+        if (atIndex == tokensInSentence.size() && sameWord(tokensInSentence, i, WORD_AT)) {
             atIndex = i;
-        } else if (atIndex != tokensInSentence.size() && sameWord(tokensInSentence[i], "with")) {
+        } else if (atIndex != tokensInSentence.size() && sameWord(tokensInSentence, i, WORD_WITH)) {
             withIndex = i;
             break;
         }
@@ -849,28 +1030,28 @@ std::unique_ptr<AST::Statement> Parser::parsePixelWriteStatement(const std::vect
         throw std::runtime_error("Expected pixel form 'Paint <image> at <x> <y> with <red> <green> <blue>'");
     }
 
-    auto colorExpressions = parseColorExpressions(tokensInSentence, withIndex + 1, tokensInSentence.size());
+    auto colorExpressions = parseColorExpressions(*arena, tokensInSentence, withIndex + 1, tokensInSentence.size());
 
-    return std::make_unique<AST::PixelWriteStatement>(
-        tokensInSentence[1].lexeme,
-        tokensInSentence[atIndex + 1].lexeme,
-        tokensInSentence[atIndex + 2].lexeme,
+    return arena->make<AST::PixelWriteStatement>(
+        arena->copy(tokensInSentence.lexeme(1)),
+        arena->copy(tokensInSentence.lexeme(atIndex + 1)),
+        arena->copy(tokensInSentence.lexeme(atIndex + 2)),
         colorExpressions[0],
         colorExpressions[1],
         colorExpressions[2]);
 }
 
-std::unique_ptr<AST::Statement> Parser::parseImageFillStatement(const std::vector<Token>& tokensInSentence) {
+AST::Statement* Parser::parseImageFillStatement(const TokenSpan& tokensInSentence) {
     size_t withIndex = tokensInSentence.size();
     for (size_t i = 0; i < tokensInSentence.size(); ++i) {
-        if (sameWord(tokensInSentence[i], "with")) {
+        if (sameWord(tokensInSentence, i, WORD_WITH)) {
             withIndex = i;
             break;
         }
     }
 
     size_t imageIndex = 1;
-    if (tokensInSentence.size() > 2 && sameWord(tokensInSentence[1], "image")) {
+    if (tokensInSentence.size() > 2 && sameWord(tokensInSentence, 1, WORD_IMAGE)) {
         imageIndex = 2;
     }
 
@@ -878,29 +1059,29 @@ std::unique_ptr<AST::Statement> Parser::parseImageFillStatement(const std::vecto
         throw std::runtime_error("Expected fill form 'Fill image <name> with <color>'");
     }
 
-    auto colorExpressions = parseColorExpressions(tokensInSentence, withIndex + 1, tokensInSentence.size());
-    return std::make_unique<AST::ImageFillStatement>(
-        tokensInSentence[imageIndex].lexeme,
+    auto colorExpressions = parseColorExpressions(*arena, tokensInSentence, withIndex + 1, tokensInSentence.size());
+    return arena->make<AST::ImageFillStatement>(
+        arena->copy(tokensInSentence.lexeme(imageIndex)),
         colorExpressions[0],
         colorExpressions[1],
         colorExpressions[2]);
 }
 
-std::unique_ptr<AST::Statement> Parser::parseRectanglePaintStatement(const std::vector<Token>& tokensInSentence) {
+AST::Statement* Parser::parseRectanglePaintStatement(const TokenSpan& tokensInSentence) {
     size_t onIndex = tokensInSentence.size();
     size_t fromIndex = tokensInSentence.size();
     size_t toIndex = tokensInSentence.size();
     size_t withIndex = tokensInSentence.size();
 
     for (size_t i = 0; i < tokensInSentence.size(); ++i) {
-        if (onIndex == tokensInSentence.size() && sameWord(tokensInSentence[i], "on")) {
+        if (onIndex == tokensInSentence.size() && sameWord(tokensInSentence, i, WORD_ON)) {
             onIndex = i;
-        } else if (fromIndex == tokensInSentence.size() && sameWord(tokensInSentence[i], "from")) {
+        } else if (fromIndex == tokensInSentence.size() && sameWord(tokensInSentence, i, WORD_FROM)) {
             fromIndex = i;
         } else if (fromIndex != tokensInSentence.size() && toIndex == tokensInSentence.size() &&
-                   sameWord(tokensInSentence[i], "to")) {
+                   sameWord(tokensInSentence, i, WORD_TO)) {
             toIndex = i;
-        } else if (toIndex != tokensInSentence.size() && sameWord(tokensInSentence[i], "with")) {
+        } else if (toIndex != tokensInSentence.size() && sameWord(tokensInSentence, i, WORD_WITH)) {
             withIndex = i;
             break;
         }
@@ -913,44 +1094,44 @@ std::unique_ptr<AST::Statement> Parser::parseRectanglePaintStatement(const std::
         throw std::runtime_error("Expected rectangle form 'Paint rectangle on <image> from <left> <bottom> to <right> <top> with <color>'");
     }
 
-    auto colorExpressions = parseColorExpressions(tokensInSentence, withIndex + 1, tokensInSentence.size());
-    return std::make_unique<AST::RectanglePaintStatement>(
-        tokensInSentence[onIndex + 1].lexeme,
-        tokensInSentence[fromIndex + 1].lexeme,
-        tokensInSentence[fromIndex + 2].lexeme,
-        tokensInSentence[toIndex + 1].lexeme,
-        tokensInSentence[toIndex + 2].lexeme,
+    auto colorExpressions = parseColorExpressions(*arena, tokensInSentence, withIndex + 1, tokensInSentence.size());
+    return arena->make<AST::RectanglePaintStatement>(
+        arena->copy(tokensInSentence.lexeme(onIndex + 1)),
+        arena->copy(tokensInSentence.lexeme(fromIndex + 1)),
+        arena->copy(tokensInSentence.lexeme(fromIndex + 2)),
+        arena->copy(tokensInSentence.lexeme(toIndex + 1)),
+        arena->copy(tokensInSentence.lexeme(toIndex + 2)),
         colorExpressions[0],
         colorExpressions[1],
         colorExpressions[2]);
 }
 
-std::unique_ptr<AST::Statement> Parser::parseImageSaveStatement(const std::vector<Token>& tokensInSentence) {
+AST::Statement* Parser::parseImageSaveStatement(const TokenSpan& tokensInSentence) {
     size_t toIndex = tokensInSentence.size();
     for (size_t i = 0; i < tokensInSentence.size(); ++i) {
-        if (sameWord(tokensInSentence[i], "to")) {
+        if (sameWord(tokensInSentence, i, WORD_TO)) {
             toIndex = i;
             break;
         }
     }
 
     if (toIndex == tokensInSentence.size() || toIndex + 1 >= tokensInSentence.size() ||
-        tokensInSentence[toIndex + 1].type != TokenType::STRING) {
+        tokensInSentence.type(toIndex + 1) != TokenType::STRING) {
         throw std::runtime_error("Expected image save form 'Save image <name> to \"path.ppm\"'");
     }
 
-    return std::make_unique<AST::ImageSaveStatement>(
-        tokensInSentence[2].lexeme,
-        tokensInSentence[toIndex + 1].lexeme);
+    return arena->make<AST::ImageSaveStatement>(
+        arena->copy(tokensInSentence.lexeme(2)),
+        arena->copy(tokensInSentence.lexeme(toIndex + 1)));
 }
 
-std::unique_ptr<AST::Statement> Parser::parseVariableDeclarationBlock(const std::vector<Token>& tokensInSentence) {
+AST::Statement* Parser::parseVariableDeclarationBlock(const TokenSpan& tokensInSentence) {
     size_t splitIndex = tokensInSentence.size();
     for (size_t i = 0; i < tokensInSentence.size(); i++) {
-        if (tokensInSentence[i].type == TokenType::KW_HAS ||
-            tokensInSentence[i].type == TokenType::KW_IS ||
-            sameWord(tokensInSentence[i], "has") ||
-            sameWord(tokensInSentence[i], "is")) {
+        if (tokensInSentence.type(i) == TokenType::KW_HAS ||
+            tokensInSentence.type(i) == TokenType::KW_IS ||
+            sameWord(tokensInSentence, i, WORD_HAS) ||
+            sameWord(tokensInSentence, i, WORD_IS)) {
             splitIndex = i;
             break;
         }
@@ -959,61 +1140,59 @@ std::unique_ptr<AST::Statement> Parser::parseVariableDeclarationBlock(const std:
         throw std::runtime_error("Expected 'has' or 'is' in variable declaration");
     }
 
-    std::string owner = joinTokens(tokensInSentence, 0, splitIndex);
-    std::vector<std::vector<Token>> declSegments;
-    std::vector<Token> currentSegment;
+    std::string_view owner = joinTokens(*arena, tokensInSentence, 0, splitIndex);
+    std::vector<TokenSpan> declSegments;
+    size_t segmentStart = splitIndex;
     int bracketDepth = 0;
-    bool startsWithIs = sameWord(tokensInSentence[splitIndex], "is");
+    bool startsWithIs = sameWord(tokensInSentence, splitIndex, WORD_IS);
 
     for (size_t i = splitIndex; i < tokensInSentence.size(); i++) {
-        if (tokensInSentence[i].type == TokenType::LEFT_BRACKET) {
+        if (tokensInSentence.type(i) == TokenType::LEFT_BRACKET) {
             bracketDepth++;
-        } else if (tokensInSentence[i].type == TokenType::RIGHT_BRACKET && bracketDepth > 0) {
+        } else if (tokensInSentence.type(i) == TokenType::RIGHT_BRACKET && bracketDepth > 0) {
             bracketDepth--;
         }
 
-        if (!startsWithIs && bracketDepth == 0 && sameWord(tokensInSentence[i], "and")) {
-            if (!currentSegment.empty()) {
-                declSegments.push_back(currentSegment);
-                currentSegment.clear();
+        if (!startsWithIs && bracketDepth == 0 && sameWord(tokensInSentence, i, WORD_AND)) {
+            if (i > segmentStart) {
+                declSegments.push_back(tokensInSentence.subspan(segmentStart, i));
             }
-        } else {
-            currentSegment.push_back(tokensInSentence[i]);
+            segmentStart = i + 1;
         }
     }
-    if (!currentSegment.empty()) {
-        declSegments.push_back(currentSegment);
+    if (tokensInSentence.size() > segmentStart) {
+        declSegments.push_back(tokensInSentence.subspan(segmentStart, tokensInSentence.size()));
     }
 
-    auto block = std::make_unique<AST::VariableDeclarationBlock>();
+    auto block = arena->make<AST::VariableDeclarationBlock>();
     for (const auto& segment : declSegments) {
         size_t idx = 0;
         bool stateAssignment = false;
-        if (idx < segment.size() && sameWord(segment[idx], "has")) {
+        if (idx < segment.size() && sameWord(segment, idx, WORD_HAS)) {
             idx++;
-        } else if (idx < segment.size() && sameWord(segment[idx], "is")) {
+        } else if (idx < segment.size() && sameWord(segment, idx, WORD_IS)) {
             stateAssignment = true;
             idx++;
         }
 
-        std::string varName;
+        std::string_view varName;
         if (stateAssignment) {
             varName = "state";
         } else {
-            if (idx < segment.size() && isArticle(segment[idx])) {
+            if (idx < segment.size() && isArticle(segment, idx)) {
                 idx++;
             }
             size_t nameStart = idx;
             while (idx < segment.size() &&
-                   !isDeclarationSeparator(segment[idx]) &&
-                   segment[idx].type != TokenType::LEFT_BRACKET) {
+                   !isDeclarationSeparator(segment, idx) &&
+                   segment.type(idx) != TokenType::LEFT_BRACKET) {
                 idx++;
             }
-            varName = joinTokens(segment, nameStart, idx);
+            varName = joinTokens(*arena, segment, nameStart, idx);
             if (varName.empty()) {
                 throw std::runtime_error("Expected variable name in declaration");
             }
-            if (idx < segment.size() && isDeclarationSeparator(segment[idx])) {
+            if (idx < segment.size() && isDeclarationSeparator(segment, idx)) {
                 idx++;
             }
         }
@@ -1022,67 +1201,108 @@ std::unique_ptr<AST::Statement> Parser::parseVariableDeclarationBlock(const std:
             throw std::runtime_error("Expected value in variable declaration");
         }
 
-        if (segment[idx].type == TokenType::LEFT_BRACKET) {
+        if (segment.type(idx) == TokenType::LEFT_BRACKET) {
             idx++;
-            std::vector<std::string> values;
-            while (idx < segment.size() && segment[idx].type != TokenType::RIGHT_BRACKET) {
-                if (segment[idx].type != TokenType::COMMA) {
-                    values.push_back(segment[idx].lexeme);
+            AST::NodeList<std::string_view> values;
+            while (idx < segment.size() && segment.type(idx) != TokenType::RIGHT_BRACKET) {
+                if (segment.type(idx) != TokenType::COMMA) {
+                    values.push_back(*arena, arena->copy(segment.lexeme(idx)));
                 }
                 idx++;
             }
             block->declarations.push_back(
-                std::make_unique<AST::VariableDeclaration>(owner, varName, std::move(values)));
+                *arena, arena->make<AST::VariableDeclaration>(owner, varName, values));
         } else {
-            std::string value = joinTokens(segment, idx);
+            std::string_view value = joinTokens(*arena, segment, idx);
             if (value.empty()) {
                 throw std::runtime_error("Expected value in variable declaration");
             }
             block->declarations.push_back(
-                std::make_unique<AST::VariableDeclaration>(owner, varName, value));
+                *arena, arena->make<AST::VariableDeclaration>(owner, varName, value));
         }
     }
     return block;
 }
 
-std::vector<std::unique_ptr<AST::Statement>> Parser::parseBlock() {
-    std::vector<std::unique_ptr<AST::Statement>> block;
-    while (!isAtEnd() && !checkEndMarker()) {
-        std::string nextLex = toLower(peek().lexeme);
-        if (check(TokenType::KW_ELSE) ||
-            check(TokenType::KW_END) ||
-            check(TokenType::KW_ENDIF) ||
-            check(TokenType::KW_ENDWHILE) ||
-            check(TokenType::KW_ENDFOR) ||
-            check(TokenType::KW_ENDFUNCTION) ||
-            nextLex == "else" ||
-            nextLex == "end" ||
-            nextLex == "endif" ||
-            nextLex == "endwhile" ||
-            nextLex == "endfor" ||
-            nextLex == "endfunction") {
-            break;
+bool Parser::atBlockEnd() const {
+    if (isAtEnd() || checkEndMarker()) {
+        return true;
+    }
+    SymbolId nextWord = foldedWord(peek());
+    return check(TokenType::KW_ELSE) ||
+           check(TokenType::KW_END) ||
+           check(TokenType::KW_ENDIF) ||
+           check(TokenType::KW_ENDWHILE) ||
+           check(TokenType::KW_ENDFOR) ||
+           check(TokenType::KW_ENDFUNCTION) ||
+           nextWord == WORD_ELSE ||
+           nextWord == WORD_END ||
+           nextWord == WORD_ENDIF ||
+           nextWord == WORD_ENDWHILE ||
+           nextWord == WORD_ENDFOR ||
+           nextWord == WORD_ENDFUNCTION;
+}
+
+// Finishes the innermost open block. An 'else' moves a condition on to its else branch
+// instead, and an 'else if' opens the nested condition it stands for.
+void Parser::closeBlock() {
+    OpenBlock& open = openBlocks.back();
+    switch (open.statement->kind) {
+    case AST::NodeKind::CONDITIONAL: {
+        auto condStmt = static_cast<AST::ConditionalStatement*>(open.statement);
+        if (open.block == &condStmt->thenBranch && check(TokenType::KW_ELSE)) {
+            advance();
+            if (check(TokenType::KW_IF)) {
+                open.block = nullptr;
+                condStmt->elseBranch.push_back(*arena, openConditionalStatement(false));
+            } else {
+                open.block = &condStmt->elseBranch;
+            }
+            return;
         }
-        auto stmt = parseStatement();
-        if (stmt) {
-            block.push_back(std::move(stmt));
+        if (open.consumeEndMarker) {
+            if (check(TokenType::KW_END) || check(TokenType::KW_ENDIF)) {
+                advance();
+                consume(TokenType::PERIOD, "Expected '.' after condition terminator");
+            } else {
+                throw std::runtime_error("Expected 'end.' or 'endif.' to close the condition");
+            }
         }
-    }
-    return block;
+        break;
+    }
+    case AST::NodeKind::WHILE:
+        consume(TokenType::KW_ENDWHILE, "Expected 'endwhile' to close the while loop");
+        consume(TokenType::PERIOD, "Expected '.' after 'endwhile'");
+        break;
+    case AST::NodeKind::FOR_EACH:
+        consume(TokenType::KW_ENDFOR, "Expected 'endfor' to close the for each loop");
+        consume(TokenType::PERIOD, "Expected '.' after 'endfor'");
+        break;
+    case AST::NodeKind::FOR_RANGE:
+        consume(TokenType::KW_ENDFOR, "Expected 'endfor' to close the numeric for loop");
+        consume(TokenType::PERIOD, "Expected '.' after 'endfor'");
+        break;
+    default:
+        consume(TokenType::KW_ENDFUNCTION, "Expected 'endfunction' to close the function");
+        consume(TokenType::PERIOD, "Expected '.' after 'endfunction'");
+        break;
+    }
+    openBlocks.pop_back();
 }
 
-std::unique_ptr<AST::Statement> Parser::parseOutputStatement() {
+AST::Statement* Parser::parseOutputStatement() {
     advance();
     if (check(TokenType::STRING)) {
-        std::string message = advance().lexeme;
+        std::string message(advance().lexeme);
         consume(TokenType::PERIOD, "Expected '.' at the end of the output statement");
-        return std::make_unique<AST::TellStatement>(message);
+        return arena->make<AST::TellStatement>(message);
     }
 
-    std::vector<Token> messageTokens;
+    size_t messageStart = current;
     while (!check(TokenType::PERIOD) && !isAtEnd()) {
-        messageTokens.push_back(advance());
+        current++;
     }
+    TokenSpan messageTokens(*tokens, messageStart, current);
     consume(TokenType::PERIOD, "Expected '.' at the end of the output statement");
-    return std::make_unique<AST::TellStatement>(joinTokens(messageTokens));
+    return arena->make<AST::TellStatement>(joinTokens(*arena, messageTokens));
 }
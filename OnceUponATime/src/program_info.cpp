@@ -0,0 +1,152 @@
+// program_info.cpp
+#include "program_info.h"
+#include "token.h"
+
+bool ProgramAnalyzer::analyze(AST::Statement& statement) {
+    size_t recordCount = info.records.size();
+    size_t functionCount = info.functions.size();
+    AST::walk(statement, [this](AST::Node& node) { AST::dispatch(node, *this); });
+    return info.records.size() != recordCount || info.functions.size() != functionCount;
+}
+
+ProgramInfo ProgramAnalyzer::finish() {
+    ProgramInfo result = std::move(info);
+    info = ProgramInfo();
+    return result;
+}
+
+void ProgramAnalyzer::addStoryRead(const AST::Operand& operand) {
+    if (operand.kind == AST::Operand::Kind::NAME) {
+        info.storyOperands.emplace(operand.text);
+    }
+}
+
+void ProgramAnalyzer::addStoryRead(const AST::Condition& condition) {
+    if (condition.kind == AST::Condition::Kind::FLAG || condition.left.kind != AST::Operand::Kind::NAME) {
+        info.storyFlags.emplace(condition.left.text);
+    } else if (condition.kind == AST::Condition::Kind::COMPARISON) {
+        info.storyOperands.emplace(condition.left.text);
+    }
+}
+
+void ProgramAnalyzer::visit(AST::NarrativeStatement&) {
+}
+
+void ProgramAnalyzer::visit(AST::ConditionalStatement& node) {
+    addStoryRead(node.test);
+}
+
+void ProgramAnalyzer::visit(AST::InteractiveStatement&) {
+}
+
+void ProgramAnalyzer::visit(AST::RandomStatement&) {
+}
+
+void ProgramAnalyzer::visit(AST::WhileStatement& node) {
+    addStoryRead(node.test);
+}
+
+void ProgramAnalyzer::visit(AST::ForEachStatement& node) {
+    info.collections.emplace(node.collection);
+}
+
+void ProgramAnalyzer::visit(AST::ForRangeStatement& node) {
+    ProgramInfo::Declaration declaration;
+    declaration.kind = ProgramInfo::Declaration::Kind::RANGE_ITERATOR;
+    declaration.owner = std::string(node.iterator);
+    info.declarations.push_back(std::move(declaration));
+    addStoryRead(AST::Operand(node.start));
+    addStoryRead(AST::Operand(node.end));
+}
+
+void ProgramAnalyzer::visit(AST::FunctionDeclaration& node) {
+    info.functions.push_back(&node);
+}
+
+void ProgramAnalyzer::visit(AST::FunctionCall&) {
+}
+
+void ProgramAnalyzer::visit(AST::ReturnStatement&) {
+}
+
+void ProgramAnalyzer::visit(AST::CommentStatement&) {
+}
+
+void ProgramAnalyzer::visit(AST::Story&) {
+}
+
+void ProgramAnalyzer::visit(AST::VariableDeclaration& node) {
+    ProgramInfo::Declaration declaration;
+    declaration.kind = ProgramInfo::Declaration::Kind::VARIABLE;
+    declaration.owner = std::string(node.owner);
+    declaration.name = std::string(node.varName);
+    declaration.collection = node.isCollection();
+    declaration.numeric = isNumberLiteral(node.value);
+    info.declarations.push_back(std::move(declaration));
+}
+
+void ProgramAnalyzer::visit(AST::VariableDeclarationBlock&) {
+}
+
+void ProgramAnalyzer::visit(AST::ArithmeticStatement& node) {
+    ProgramInfo::Declaration declaration;
+    declaration.kind = ProgramInfo::Declaration::Kind::ARITHMETIC_TARGET;
+    declaration.owner = std::string(node.target.text);
+    info.declarations.push_back(std::move(declaration));
+    addStoryRead(node.left);
+    addStoryRead(node.right);
+}
+
+void ProgramAnalyzer::visit(AST::RecordDeclaration& node) {
+    ProgramInfo::Declaration declaration;
+    declaration.kind = ProgramInfo::Declaration::Kind::RECORD_TYPE;
+    declaration.record = info.records.size();
+    info.declarations.push_back(std::move(declaration));
+    info.records.push_back(&node);
+}
+
+void ProgramAnalyzer::visit(AST::RecordInstanceDeclaration& node) {
+    ProgramInfo::Declaration declaration;
+    declaration.kind = ProgramInfo::Declaration::Kind::RECORD_INSTANCE;
+    declaration.owner = std::string(node.name);
+    declaration.name = std::string(node.typeName);
+    info.declarations.push_back(std::move(declaration));
+    for (const auto& fieldValue : node.fieldValues) {
+        addStoryRead(fieldValue.second);
+    }
+}
+
+void ProgramAnalyzer::visit(AST::ImageDeclaration& node) {
+    info.usesImages = true;
+    addStoryRead(node.width);
+    addStoryRead(node.height);
+}
+
+void ProgramAnalyzer::visit(AST::PixelWriteStatement& node) {
+    info.usesImages = true;
+    for (const AST::Operand* operand : {&node.x, &node.y, &node.red, &node.green, &node.blue}) {
+        addStoryRead(*operand);
+    }
+}
+
+void ProgramAnalyzer::visit(AST::ImageFillStatement& node) {
+    info.usesImages = true;
+    for (const AST::Operand* operand : {&node.red, &node.green, &node.blue}) {
+        addStoryRead(*operand);
+    }
+}
+
+void ProgramAnalyzer::visit(AST::RectanglePaintStatement& node) {
+    info.usesImages = true;
+    for (const AST::Operand* operand : {&node.left, &node.bottom, &node.right, &node.top,
+                                        &node.red, &node.green, &node.blue}) {
+        addStoryRead(*operand);
+    }
+}
+
+void ProgramAnalyzer::visit(AST::ImageSaveStatement&) {
+    info.usesImages = true;
+}
+
+void ProgramAnalyzer::visit(AST::TellStatement&) {
+}
@@ -0,0 +1,113 @@
+// source_file.cpp
+#include "source_file.h"
+#include <fstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+SourceFile::SourceFile(const std::filesystem::path& path)
+    : data(nullptr), size(0), mapping(nullptr) {
+    if (!map(path)) {
+        read(path);
+    }
+}
+
+SourceFile::~SourceFile() {
+    if (mapping == nullptr) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(mapping);
+#else
+    munmap(mapping, size);
+#endif
+}
+
+std::string_view SourceFile::text() const {
+    return std::string_view(data, size);
+}
+
+bool SourceFile::isMapped() const {
+    return mapping != nullptr;
+}
+
+#ifdef _WIN32
+
+bool SourceFile::map(const std::filesystem::path& path) {
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE fileMapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (fileMapping == nullptr) {
+        return false;
+    }
+    void* view = MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(fileMapping);
+    if (view == nullptr) {
+        return false;
+    }
+    mapping = view;
+    data = static_cast<const char*>(view);
+    size = static_cast<size_t>(fileSize.QuadPart);
+    return true;
+}
+
+#else
+
+bool SourceFile::map(const std::filesystem::path& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED) {
+        return false;
+    }
+    madvise(view, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+    mapping = view;
+    data = static_cast<const char*>(view);
+    size = static_cast<size_t>(info.st_size);
+    return true;
+}
+
+#endif
+
+void SourceFile::read(const std::filesystem::path& path) {
+    std::ifstream input(path, std::ios::binary);
+    if (!input) {
+        throw std::runtime_error("Unable to open " + path.string());
+    }
+    char chunk[65536];
+    while (input.read(chunk, sizeof(chunk)) || input.gcount() > 0) {
+        buffer.append(chunk, static_cast<size_t>(input.gcount()));
+    }
+    data = buffer.data();
+    size = buffer.size();
+}
@@ -0,0 +1,756 @@
+// story_cache.cpp
+#include "story_cache.h"
+#include "parser.h"
+#include "source_file.h"
+#include "string_interner.h"
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+constexpr char cacheMagic[4] = {'O', 'U', 'A', 'C'};
+constexpr uint32_t cacheVersion = 2;
+constexpr size_t noEnd = std::numeric_limits<size_t>::max();
+
+// What an image depends on besides its script: the encoding in this file, the trees the parser
+// builds, and the layout of the nodes they are read back into. The header keeps a hash of all
+// three, so a change to any of them turns older images into misses.
+constexpr uint32_t cacheFormat() {
+    const size_t parts[] = {
+        cacheVersion, Parser::outputVersion, static_cast<size_t>(AST::NodeKind::TELL) + 1,
+        sizeof(AST::Operand), sizeof(AST::Condition), sizeof(AST::Field), sizeof(AST::FieldValue),
+        sizeof(AST::NarrativeStatement), sizeof(AST::ConditionalStatement), sizeof(AST::InteractiveStatement),
+        sizeof(AST::RandomStatement), sizeof(AST::WhileStatement), sizeof(AST::ForEachStatement),
+        sizeof(AST::ForRangeStatement), sizeof(AST::FunctionDeclaration), sizeof(AST::FunctionCall),
+        sizeof(AST::ReturnStatement), sizeof(AST::CommentStatement), sizeof(AST::VariableDeclaration),
+        sizeof(AST::VariableDeclarationBlock), sizeof(AST::ArithmeticStatement),
+        sizeof(AST::RecordDeclaration), sizeof(AST::RecordInstanceDeclaration), sizeof(AST::ImageDeclaration),
+        sizeof(AST::PixelWriteStatement), sizeof(AST::ImageFillStatement),
+        sizeof(AST::RectanglePaintStatement), sizeof(AST::ImageSaveStatement), sizeof(AST::TellStatement)};
+    uint32_t hash = 2166136261u;
+    for (size_t part : parts) {
+        hash = (hash ^ static_cast<uint32_t>(part)) * 16777619u;
+    }
+    return hash;
+}
+
+struct CacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceLength;
+    AST::Fingerprint source;
+    uint32_t stringCount;
+    uint32_t statementCount;
+    uint32_t wordCount;
+    uint32_t stringBytes;
+};
+
+struct StringEntry {
+    uint32_t offset;
+    uint32_t length;
+};
+
+static_assert(sizeof(CacheHeader) == 48, "The cache header is written as is");
+static_assert(sizeof(StringEntry) == 8, "String entries are written as is");
+
+// An operand takes one word: its string index, whether the parser interned its name, and its kind.
+constexpr uint32_t operandNamedBit = 4;
+constexpr uint32_t operandIndexShift = 3;
+
+class StoryWriter {
+public:
+    std::string write(const AST::Story& story, std::string_view source);
+
+private:
+    std::vector<uint32_t> words;
+    std::vector<StringEntry> entries;
+    std::string bytes;
+    std::unordered_map<std::string_view, uint32_t> indices;
+
+    uint32_t indexOf(std::string_view text);
+    void string(std::string_view text);
+    void operand(const AST::Operand& operand);
+    void condition(const AST::Condition& condition);
+    void statement(const AST::Statement& statement, std::vector<std::pair<const AST::Statement*, size_t>>& pending);
+    void close(size_t start);
+};
+
+uint32_t StoryWriter::indexOf(std::string_view text) {
+    auto found = indices.find(text);
+    if (found != indices.end()) {
+        return found->second;
+    }
+    if (entries.size() >= (1u << (32 - operandIndexShift)) ||
+        bytes.size() + text.size() > std::numeric_limits<uint32_t>::max()) {
+        throw std::runtime_error("The story is too large to be cached");
+    }
+    uint32_t index = static_cast<uint32_t>(entries.size());
+    entries.push_back({static_cast<uint32_t>(bytes.size()), static_cast<uint32_t>(text.size())});
+    bytes.append(text);
+    indices.emplace(text, index);
+    return index;
+}
+
+void StoryWriter::string(std::string_view text) {
+    words.push_back(indexOf(text));
+}
+
+void StoryWriter::operand(const AST::Operand& operand) {
+    uint32_t named = operand.name != noSymbol ? operandNamedBit : 0;
+    words.push_back(indexOf(operand.text) << operandIndexShift | named | static_cast<uint32_t>(operand.kind));
+}
+
+void StoryWriter::condition(const AST::Condition& condition) {
+    words.push_back(static_cast<uint32_t>(condition.kind) | static_cast<uint32_t>(condition.op) << 8);
+    operand(condition.left);
+    operand(condition.right);
+}
+
+void StoryWriter::close(size_t start) {
+    words[start + 1] = static_cast<uint32_t>(words.size() - start);
+}
+
+// Writes the record of one statement. Children are queued on pending, behind a null entry
+// that closes the record once they are written.
+void StoryWriter::statement(const AST::Statement& statement,
+                            std::vector<std::pair<const AST::Statement*, size_t>>& pending) {
+    size_t start = words.size();
+    words.push_back(static_cast<uint32_t>(statement.kind));
+    words.push_back(0);
+    const AST::NodeList<AST::Statement*>* first = nullptr;
+    const AST::NodeList<AST::Statement*>* second = nullptr;
+    switch (statement.kind) {
+    case AST::NodeKind::NARRATIVE:
+        string(static_cast<const AST::NarrativeStatement&>(statement).text);
+        break;
+    case AST::NodeKind::CONDITIONAL: {
+        auto& node = static_cast<const AST::ConditionalStatement&>(statement);
+        string(node.condition);
+        condition(node.test);
+        words.push_back(static_cast<uint32_t>(node.thenBranch.size()));
+        words.push_back(static_cast<uint32_t>(node.elseBranch.size()));
+        first = &node.thenBranch;
+        second = &node.elseBranch;
+        break;
+    }
+    case AST::NodeKind::INTERACTIVE:
+        string(static_cast<const AST::InteractiveStatement&>(statement).prompt);
+        break;
+    case AST::NodeKind::RANDOM: {
+        auto& node = static_cast<const AST::RandomStatement&>(statement);
+        string(node.subject);
+        string(node.randomStates.first);
+        string(node.randomStates.second);
+        break;
+    }
+    case AST::NodeKind::WHILE: {
+        auto& node = static_cast<const AST::WhileStatement&>(statement);
+        string(node.condition);
+        condition(node.test);
+        words.push_back(static_cast<uint32_t>(node.body.size()));
+        first = &node.body;
+        break;
+    }
+    case AST::NodeKind::FOR_EACH: {
+        auto& node = static_cast<const AST::ForEachStatement&>(statement);
+        string(node.iterator);
+        string(node.collection);
+        words.push_back(static_cast<uint32_t>(node.body.size()));
+        first = &node.body;
+        break;
+    }
+    case AST::NodeKind::FOR_RANGE: {
+        auto& node = static_cast<const AST::ForRangeStatement&>(statement);
+        string(node.iterator);
+        string(node.start);
+        string(node.end);
+        words.push_back(static_cast<uint32_t>(node.body.size()));
+        first = &node.body;
+        break;
+    }
+    case AST::NodeKind::FUNCTION_DECLARATION: {
+        auto& node = static_cast<const AST::FunctionDeclaration&>(statement);
+        string(node.name);
+        words.push_back(static_cast<uint32_t>(node.body.size()));
+        first = &node.body;
+        break;
+    }
+    case AST::NodeKind::FUNCTION_CALL:
+        string(static_cast<const AST::FunctionCall&>(statement).name);
+        break;
+    case AST::NodeKind::RETURN:
+        break;
+    case AST::NodeKind::COMMENT:
+        string(static_cast<const AST::CommentStatement&>(statement).comment);
+        break;
+    case AST::NodeKind::VARIABLE_DECLARATION: {
+        auto& node = static_cast<const AST::VariableDeclaration&>(statement);
+        string(node.owner);
+        string(node.varName);
+        string(node.value);
+        words.push_back(static_cast<uint32_t>(node.values.size()));
+        for (std::string_view value : node.values) {
+            string(value);
+        }
+        break;
+    }
+    case AST::NodeKind::VARIABLE_DECLARATION_BLOCK: {
+        auto& node = static_cast<const AST::VariableDeclarationBlock&>(statement);
+        words.push_back(static_cast<uint32_t>(node.declarations.size()));
+        for (const AST::VariableDeclaration* declaration : node.declarations) {
+            this->statement(*declaration, pending);
+        }
+        break;
+    }
+    case AST::NodeKind::ARITHMETIC: {
+        auto& node = static_cast<const AST::ArithmeticStatement&>(statement);
+        operand(node.left);
+        string(node.operation);
+        operand(node.right);
+        operand(node.target);
+        break;
+    }
+    case AST::NodeKind::RECORD_DECLARATION: {
+        auto& node = static_cast<const AST::RecordDeclaration&>(statement);
+        string(node.name);
+        words.push_back(static_cast<uint32_t>(node.fields.size()));
+        for (const AST::Field& field : node.fields) {
+            string(field.first);
+            string(field.second);
+        }
+        break;
+    }
+    case AST::NodeKind::RECORD_INSTANCE: {
+        auto& node = static_cast<const AST::RecordInstanceDeclaration&>(statement);
+        string(node.name);
+        string(node.typeName);
+        words.push_back(static_cast<uint32_t>(node.fieldValues.size()));
+        for (const AST::FieldValue& fieldValue : node.fieldValues) {
+            string(fieldValue.first);
+            operand(fieldValue.second);
+        }
+        break;
+    }
+    case AST::NodeKind::IMAGE_DECLARATION: {
+        auto& node = static_cast<const AST::ImageDeclaration&>(statement);
+        string(node.name);
+        operand(node.width);
+        operand(node.height);
+        break;
+    }
+    case AST::NodeKind::PIXEL_WRITE: {
+        auto& node = static_cast<const AST::PixelWriteStatement&>(statement);
+        string(node.imageName);
+        operand(node.x);
+        operand(node.y);
+        operand(node.red);
+        operand(node.green);
+        operand(node.blue);
+        break;
+    }
+    case AST::NodeKind::IMAGE_FILL: {
+        auto& node = static_cast<const AST::ImageFillStatement&>(statement);
+        string(node.imageName);
+        operand(node.red);
+        operand(node.green);
+        operand(node.blue);
+        break;
+    }
+    case AST::NodeKind::RECTANGLE_PAINT: {
+        auto& node = static_cast<const AST::RectanglePaintStatement&>(statement);
+        string(node.imageName);
+        operand(node.left);
+        operand(node.bottom);
+        operand(node.right);
+        operand(node.top);
+        operand(node.red);
+        operand(node.green);
+        operand(node.blue);
+        break;
+    }
+    case AST::NodeKind::IMAGE_SAVE: {
+        auto& node = static_cast<const AST::ImageSaveStatement&>(statement);
+        string(node.imageName);
+        string(node.outputPath);
+        break;
+    }
+    case AST::NodeKind::TELL:
+        string(static_cast<const AST::TellStatement&>(statement).message);
+        break;
+    case AST::NodeKind::STORY:
+        throw std::runtime_error("A story cannot be nested in a statement");
+    }
+
+    if (first == nullptr) {
+        close(start);
+        return;
+    }
+    pending.emplace_back(nullptr, start);
+    for (const auto* list : {second, first}) {
+        if (list == nullptr) {
+            continue;
+        }
+        for (size_t i = list->size(); i > 0; --i) {
+            pending.emplace_back((*list)[i - 1], 0);
+        }
+    }
+}
+
+std::string StoryWriter::write(const AST::Story& story, std::string_view source) {
+    std::vector<std::pair<const AST::Statement*, size_t>> pending;
+    for (size_t i = story.statements.size(); i > 0; --i) {
+        pending.emplace_back(story.statements[i - 1], 0);
+    }
+    while (!pending.empty()) {
+        auto [next, start] = pending.back();
+        pending.pop_back();
+        if (next == nullptr) {
+            close(start);
+        } else {
+            statement(*next, pending);
+        }
+    }
+    if (words.size() > std::numeric_limits<uint32_t>::max()) {
+        throw std::runtime_error("The story is too large to be cached");
+    }
+
+    CacheHeader header;
+    std::memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+    header.version = cacheFormat();
+    header.sourceLength = source.size();
+    header.source = AST::fingerprint(source);
+    header.stringCount = static_cast<uint32_t>(entries.size());
+    header.statementCount = static_cast<uint32_t>(story.statements.size());
+    header.wordCount = static_cast<uint32_t>(words.size());
+    header.stringBytes = static_cast<uint32_t>(bytes.size());
+
+    std::string image;
+    image.reserve(sizeof(header) + entries.size() * sizeof(StringEntry) + words.size() * sizeof(uint32_t) + bytes.size());
+    image.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    image.append(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(StringEntry));
+    image.append(reinterpret_cast<const char*>(words.data()), words.size() * sizeof(uint32_t));
+    image.append(bytes);
+    return image;
+}
+
+class StoryReader {
+public:
+    StoryReader(std::string_view image, const CacheHeader& header);
+    void read(AST::Story& story, uint32_t statementCount);
+
+private:
+    // A list still waiting for children; end is where the record owning it must stop.
+    struct Frame {
+        AST::NodeList<AST::Statement*>* list;
+        uint32_t remaining;
+        size_t end;
+    };
+
+    std::vector<std::string_view> strings;
+    std::vector<SymbolId> names;
+    const char* words;
+    size_t wordCount;
+    size_t position;
+    AST::Arena* arena;
+    StringInterner* interner;
+    std::vector<Frame> frames;
+
+    [[noreturn]] static void damaged();
+    uint32_t word();
+    uint32_t count();
+    std::string_view string();
+    AST::Operand operand();
+    AST::Condition condition();
+    AST::Statement* statement();
+};
+
+void StoryReader::damaged() {
+    throw std::runtime_error("The story cache is damaged");
+}
+
+StoryReader::StoryReader(std::string_view image, const CacheHeader& header)
+    : words(nullptr), wordCount(header.wordCount), position(0), arena(nullptr), interner(nullptr) {
+    size_t entriesSize = static_cast<size_t>(header.stringCount) * sizeof(StringEntry);
+    size_t wordsSize = static_cast<size_t>(header.wordCount) * sizeof(uint32_t);
+    if (image.size() != sizeof(CacheHeader) + entriesSize + wordsSize + header.stringBytes) {
+        damaged();
+    }
+    const char* entries = image.data() + sizeof(CacheHeader);
+    words = entries + entriesSize;
+    const char* bytes = words + wordsSize;
+    strings.reserve(header.stringCount);
+    for (uint32_t i = 0; i < header.stringCount; ++i) {
+        StringEntry entry;
+        std::memcpy(&entry, entries + i * sizeof(StringEntry), sizeof(entry));
+        if (entry.offset > header.stringBytes || entry.length > header.stringBytes - entry.offset) {
+            damaged();
+        }
+        strings.emplace_back(bytes + entry.offset, entry.length);
+    }
+    names.assign(header.stringCount, noSymbol);
+}
+
+uint32_t StoryReader::word() {
+    if (position >= wordCount) {
+        damaged();
+    }
+    uint32_t value;
+    std::memcpy(&value, words + position * sizeof(uint32_t), sizeof(value));
+    position++;
+    return value;
+}
+
+// Every counted item takes at least one word, which bounds a count before it is trusted.
+uint32_t StoryReader::count() {
+    uint32_t value = word();
+    if (value > wordCount - position) {
+        damaged();
+    }
+    return value;
+}
+
+std::string_view StoryReader::string() {
+    uint32_t index = word();
+    if (index >= strings.size()) {
+        damaged();
+    }
+    return strings[index];
+}
+
+AST::Operand StoryReader::operand() {
+    uint32_t value = word();
+    uint32_t index = value >> operandIndexShift;
+    uint32_t kind = value & (operandNamedBit - 1);
+    if (index >= strings.size() || kind > static_cast<uint32_t>(AST::Operand::Kind::TEXT)) {
+        damaged();
+    }
+    SymbolId name = noSymbol;
+    if (value & operandNamedBit) {
+        if (names[index] == noSymbol) {
+            names[index] = interner->intern(strings[index]);
+        }
+        name = names[index];
+    }
+    return AST::Operand(strings[index], static_cast<AST::Operand::Kind>(kind), name);
+}
+
+AST::Condition StoryReader::condition() {
+    uint32_t value = word();
+    uint32_t kind = value & 0xff;
+    uint32_t op = value >> 8;
+    if (kind > static_cast<uint32_t>(AST::Condition::Kind::COMPARISON) ||
+        op > static_cast<uint32_t>(AST::ComparisonOperator::AT_MOST)) {
+        damaged();
+    }
+    AST::Condition result;
+    result.kind = static_cast<AST::Condition::Kind>(kind);
+    result.op = static_cast<AST::ComparisonOperator>(op);
+    result.left = operand();
+    result.right = operand();
+    return result;
+}
+
+// Builds the node of one record. A compound statement gets its lists pushed as frames, to be
+// filled from the records that follow it.
+AST::Statement* StoryReader::statement() {
+    size_t start = position;
+    uint32_t kind = word();
+    uint32_t extent = word();
+    if (extent < 2 || extent > wordCount - start) {
+        damaged();
+    }
+    size_t end = start + extent;
+    switch (static_cast<AST::NodeKind>(kind)) {
+    case AST::NodeKind::NARRATIVE:
+        return arena->make<AST::NarrativeStatement>(string());
+    case AST::NodeKind::CONDITIONAL: {
+        std::string_view text = string();
+        AST::Condition test = condition();
+        auto node = arena->make<AST::ConditionalStatement>(text, test);
+        uint32_t thenCount = count();
+        uint32_t elseCount = count();
+        frames.push_back({&node->elseBranch, elseCount, end});
+        frames.push_back({&node->thenBranch, thenCount, noEnd});
+        return node;
+    }
+    case AST::NodeKind::INTERACTIVE:
+        return arena->make<AST::InteractiveStatement>(string());
+    case AST::NodeKind::RANDOM: {
+        std::string_view subject = string();
+        std::string_view first = string();
+        std::string_view second = string();
+        return arena->make<AST::RandomStatement>(subject, std::make_pair(first, second));
+    }
+    case AST::NodeKind::WHILE: {
+        std::string_view text = string();
+        AST::Condition test = condition();
+        auto node = arena->make<AST::WhileStatement>(text, test);
+        frames.push_back({&node->body, count(), end});
+        return node;
+    }
+    case AST::NodeKind::FOR_EACH: {
+        std::string_view iterator = string();
+        std::string_view collection = string();
+        auto node = arena->make<AST::ForEachStatement>(iterator, collection);
+        frames.push_back({&node->body, count(), end});
+        return node;
+    }
+    case AST::NodeKind::FOR_RANGE: {
+        std::string_view iterator = string();
+        std::string_view first = string();
+        std::string_view last = string();
+        auto node = arena->make<AST::ForRangeStatement>(iterator, first, last);
+        frames.push_back({&node->body, count(), end});
+        return node;
+    }
+    case AST::NodeKind::FUNCTION_DECLARATION: {
+        auto node = arena->make<AST::FunctionDeclaration>(string());
+        frames.push_back({&node->body, count(), end});
+        return node;
+    }
+    default:
+        break;
+    }
+
+    AST::Statement* node = nullptr;
+    switch (static_cast<AST::NodeKind>(kind)) {
+    case AST::NodeKind::FUNCTION_CALL:
+        node = arena->make<AST::FunctionCall>(string());
+        break;
+    case AST::NodeKind::RETURN:
+        node = arena->make<AST::ReturnStatement>();
+        break;
+    case AST::NodeKind::COMMENT:
+        node = arena->make<AST::CommentStatement>(string());
+        break;
+    case AST::NodeKind::VARIABLE_DECLARATION: {
+        std::string_view owner = string();
+        std::string_view varName = string();
+        std::string_view value = string();
+        uint32_t valueCount = count();
+        if (valueCount == 0) {
+            node = arena->make<AST::VariableDeclaration>(owner, varName, value);
+            break;
+        }
+        AST::NodeList<std::string_view> values;
+        for (uint32_t i = 0; i < valueCount; ++i) {
+            values.push_back(*arena, string());
+        }
+        node = arena->make<AST::VariableDeclaration>(owner, varName, values);
+        break;
+    }
+    case AST::NodeKind::VARIABLE_DECLARATION_BLOCK: {
+        auto block = arena->make<AST::VariableDeclarationBlock>();
+        uint32_t declarationCount = count();
+        for (uint32_t i = 0; i < declarationCount; ++i) {
+            auto declaration = AST::as<AST::VariableDeclaration>(statement());
+            if (declaration == nullptr) {
+                damaged();
+            }
+            block->declarations.push_back(*arena, declaration);
+        }
+        node = block;
+        break;
+    }
+    case AST::NodeKind::ARITHMETIC: {
+        AST::Operand left = operand();
+        std::string_view operation = string();
+        AST::Operand right = operand();
+        AST::Operand target = operand();
+        node = arena->make<AST::ArithmeticStatement>(left, operation, right, target);
+        break;
+    }
+    case AST::NodeKind::RECORD_DECLARATION: {
+        std::string_view name = string();
+        uint32_t fieldCount = count();
+        AST::NodeList<AST::Field> fields;
+        for (uint32_t i = 0; i < fieldCount; ++i) {
+            std::string_view fieldName = string();
+            fields.push_back(*arena, {fieldName, string()});
+        }
+        node = arena->make<AST::RecordDeclaration>(name, fields);
+        break;
+    }
+    case AST::NodeKind::RECORD_INSTANCE: {
+        std::string_view name = string();
+        std::string_view typeName = string();
+        uint32_t valueCount = count();
+        AST::NodeList<AST::FieldValue> fieldValues;
+        for (uint32_t i = 0; i < valueCount; ++i) {
+            std::string_view fieldName = string();
+            fieldValues.push_back(*arena, {fieldName, operand()});
+        }
+        node = arena->make<AST::RecordInstanceDeclaration>(name, typeName, fieldValues);
+        break;
+    }
+    case AST::NodeKind::IMAGE_DECLARATION: {
+        std::string_view name = string();
+        AST::Operand width = operand();
+        AST::Operand height = operand();
+        node = arena->make<AST::ImageDeclaration>(name, width, height);
+        break;
+    }
+    case AST::NodeKind::PIXEL_WRITE: {
+        std::string_view imageName = string();
+        AST::Operand x = operand();
+        AST::Operand y = operand();
+        AST::Operand red = operand();
+        AST::Operand green = operand();
+        AST::Operand blue = operand();
+        node = arena->make<AST::PixelWriteStatement>(imageName, x, y, red, green, blue);
+        break;
+    }
+    case AST::NodeKind::IMAGE_FILL: {
+        std::string_view imageName = string();
+        AST::Operand red = operand();
+        AST::Operand green = operand();
+        AST::Operand blue = operand();
+        node = arena->make<AST::ImageFillStatement>(imageName, red, green, blue);
+        break;
+    }
+    case AST::NodeKind::RECTANGLE_PAINT: {
+        std::string_view imageName = string();
+        AST::Operand left = operand();
+        AST::Operand bottom = operand();
+        AST::Operand right = operand();
+        AST::Operand top = operand();
+        AST::Operand red = operand();
+        AST::Operand green = operand();
+        AST::Operand blue = operand();
+        node = arena->make<AST::RectanglePaintStatement>(imageName, left, bottom, right, top, red, green, blue);
+        break;
+    }
+    case AST::NodeKind::IMAGE_SAVE: {
+        std::string_view imageName = string();
+        std::string_view outputPath = string();
+        node = arena->make<AST::ImageSaveStatement>(imageName, outputPath);
+        break;
+    }
+    case AST::NodeKind::TELL:
+        node = arena->make<AST::TellStatement>(string());
+        break;
+    default:
+        damaged();
+    }
+    if (position != end) {
+        damaged();
+    }
+    return node;
+}
+
+void StoryReader::read(AST::Story& story, uint32_t statementCount) {
+    arena = &story.arena;
+    interner = &story.names;
+    frames.push_back({&story.statements, statementCount, wordCount});
+    while (!frames.empty()) {
+        Frame& frame = frames.back();
+        if (frame.remaining == 0) {
+            if (frame.end != noEnd && frame.end != position) {
+                damaged();
+            }
+            frames.pop_back();
+            continue;
+        }
+        frame.remaining--;
+        AST::NodeList<AST::Statement*>* list = frame.list;
+        AST::Statement* node = statement();
+        list->push_back(*arena, node);
+    }
+}
+
+uint64_t rotateLeft(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+}
+
+uint64_t storyContentHash(std::string_view source) {
+    constexpr uint64_t prime1 = 0x9E3779B185EBCA87ull;
+    constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4Full;
+    uint64_t hash = prime1 ^ static_cast<uint64_t>(source.size());
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= source.size(); i += sizeof(uint64_t)) {
+        uint64_t chunk;
+        std::memcpy(&chunk, source.data() + i, sizeof(chunk));
+        hash = rotateLeft(hash ^ (chunk * prime2), 31) * prime1;
+    }
+    for (; i < source.size(); ++i) {
+        hash = rotateLeft(hash ^ (static_cast<unsigned char>(source[i]) * prime2), 31) * prime1;
+    }
+    hash ^= hash >> 33;
+    hash *= prime2;
+    hash ^= hash >> 29;
+    return hash;
+}
+
+std::string serializeStory(const AST::Story& story, std::string_view source) {
+    StoryWriter writer;
+    return writer.write(story, source);
+}
+
+std::unique_ptr<AST::Story> deserializeStory(std::string_view image, std::string_view source) {
+    CacheHeader header;
+    if (image.size() < sizeof(header)) {
+        return nullptr;
+    }
+    std::memcpy(&header, image.data(), sizeof(header));
+    if (std::memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0 ||
+        header.version != cacheFormat() || header.sourceLength != source.size() ||
+        header.source != AST::fingerprint(source)) {
+        return nullptr;
+    }
+    auto story = std::make_unique<AST::Story>();
+    StoryReader reader(image, header);
+    reader.read(*story, header.statementCount);
+    return story;
+}
+
+std::filesystem::path storyCachePath(const std::filesystem::path& scriptPath) {
+    std::filesystem::path cachePath = scriptPath;
+    cachePath += ".astc";
+    return cachePath;
+}
+
+std::unique_ptr<AST::Story> loadCachedStory(const std::filesystem::path& scriptPath, std::string_view source) {
+    std::filesystem::path cachePath = storyCachePath(scriptPath);
+    std::error_code error;
+    if (!std::filesystem::is_regular_file(cachePath, error)) {
+        return nullptr;
+    }
+    try {
+        auto image = std::make_shared<SourceFile>(cachePath);
+        auto story = deserializeStory(image->text(), source);
+        if (story) {
+            story->backing = image;
+        }
+        return story;
+    } catch (const std::runtime_error&) {
+        return nullptr;
+    }
+}
+
+bool saveCachedStory(const std::filesystem::path& scriptPath, std::string_view source, const AST::Story& story) {
+    std::string image = serializeStory(story, source);
+    std::filesystem::path cachePath = storyCachePath(scriptPath);
+    std::filesystem::path partialPath = cachePath;
+    partialPath += ".tmp";
+    std::error_code error;
+    {
+        std::ofstream output(partialPath, std::ios::binary | std::ios::trunc);
+        if (!output.write(image.data(), static_cast<std::streamsize>(image.size()))) {
+            output.close();
+            std::filesystem::remove(partialPath, error);
+            return false;
+        }
+    }
+    std::filesystem::rename(partialPath, cachePath, error);
+    if (error) {
+        std::filesystem::remove(partialPath, error);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,78 @@
+// string_interner.cpp
+#include "string_interner.h"
+#include <algorithm>
+
+namespace {
+
+constexpr std::string_view knownWords[] = {
+    "a", "an", "the", "of", "is", "has", "equals", "with", "at", "from", "to", "and", "or", "as", "on",
+    "record", "function", "image", "create", "paint", "set", "fill", "rectangle", "save", "width",
+    "height", "story", "ends", "leans", "towards", "choose", "input", "else", "end", "endif",
+    "endwhile", "endfor", "endfunction", "not", "greater", "less", "than", "least", "most",
+    "add", "subtract", "multiply", "divide",
+};
+
+static_assert(sizeof(knownWords) / sizeof(knownWords[0]) == KNOWN_WORD_COUNT,
+              "knownWords must list every KnownWord in order");
+
+}
+
+StringInterner::StringInterner() {
+    for (std::string_view word : knownWords) {
+        intern(word);
+    }
+}
+
+SymbolId StringInterner::intern(std::string_view text) {
+    auto it = ids.find(text);
+    if (it != ids.end()) {
+        return it->second;
+    }
+    SymbolId id = static_cast<SymbolId>(strings.size());
+    strings.emplace_back(text);
+    ids.emplace(strings.back(), id);
+    return id;
+}
+
+SymbolId StringInterner::internFolded(std::string_view word) {
+    auto upper = [](char c) { return c >= 'A' && c <= 'Z'; };
+    if (std::none_of(word.begin(), word.end(), upper)) {
+        return intern(word);
+    }
+    folded.assign(word);
+    for (char& c : folded) {
+        if (upper(c)) {
+            c = static_cast<char>(c - 'A' + 'a');
+        }
+    }
+    return intern(folded);
+}
+
+SymbolId StringInterner::findFolded(std::string_view word) const {
+    auto upper = [](char c) { return c >= 'A' && c <= 'Z'; };
+    if (std::none_of(word.begin(), word.end(), upper)) {
+        auto it = ids.find(word);
+        return it != ids.end() ? it->second : noSymbol;
+    }
+    std::string lower(word);
+    for (char& c : lower) {
+        if (c >= 'A' && c <= 'Z') {
+            c = static_cast<char>(c - 'A' + 'a');
+        }
+    }
+    auto it = ids.find(lower);
+    return it != ids.end() ? it->second : noSymbol;
+}
+
+std::string_view StringInterner::text(SymbolId id) const {
+    return strings[id];
+}
+
+size_t StringInterner::size() const {
+    return strings.size();
+}
+
+SymbolId StringInterner::knownWord(std::string_view word) {
+    static const StringInterner known;
+    return known.findFolded(word);
+}
@@ -0,0 +1,208 @@
+// token_stream.cpp
+#include "token_stream.h"
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <stdexcept>
+
+TokenStream::TokenStream(std::string_view source)
+    : source(source), owned(false) {}
+
+TokenStream::TokenStream(const std::vector<Token>& tokens)
+    : owned(true) {
+    size_t length = 0;
+    for (const auto& token : tokens) {
+        length += token.lexeme.size();
+    }
+    ownedText.reserve(length);
+    for (const auto& token : tokens) {
+        types.push_back(static_cast<uint8_t>(token.type));
+        offsets.push_back(static_cast<uint32_t>(ownedText.size()));
+        lengths.push_back(static_cast<uint32_t>(token.lexeme.size()));
+        if (token.type == TokenType::NUMBER) {
+            payloads.push_back(static_cast<uint32_t>(numbers.size()));
+            numbers.push_back(NumberValue{token.integer, token.real, token.integral});
+        } else {
+            payloads.push_back(token.word);
+        }
+        explicitLines.push_back(token.line);
+        explicitColumns.push_back(token.column);
+        ownedText += token.lexeme;
+    }
+}
+
+size_t TokenStream::size() const {
+    return types.size();
+}
+
+TokenType TokenStream::type(size_t index) const {
+    return static_cast<TokenType>(types[index]);
+}
+
+std::string_view TokenStream::lexeme(size_t index) const {
+    return std::string_view(base() + offsets[index], lengths[index]);
+}
+
+SymbolId TokenStream::word(size_t index) const {
+    return type(index) == TokenType::NUMBER ? noSymbol : payloads[index];
+}
+
+const NumberValue& TokenStream::number(size_t index) const {
+    assert(type(index) == TokenType::NUMBER);
+    return numbers[payloads[index]];
+}
+
+int TokenStream::line(size_t index) const {
+    if (!explicitLines.empty()) {
+        return explicitLines[index];
+    }
+    return static_cast<int>(lineIndexOf(positionOf(index, true))) + 1;
+}
+
+int TokenStream::column(size_t index) const {
+    if (!explicitColumns.empty()) {
+        return explicitColumns[index];
+    }
+    size_t position = positionOf(index, false);
+    return static_cast<int>(position - lineStarts[lineIndexOf(position)]) + 1;
+}
+
+Token TokenStream::at(size_t index) const {
+    Token token{type(index), lexeme(index), 0, 0};
+    if (token.type == TokenType::NUMBER) {
+        const NumberValue& value = numbers[payloads[index]];
+        token.integral = value.integral;
+        token.integer = value.integer;
+        token.real = value.real;
+    } else {
+        token.word = payloads[index];
+    }
+    return token;
+}
+
+void TokenStream::append(const Token& token) {
+    assert(!owned);
+    size_t offset = static_cast<size_t>(token.lexeme.data() - source.data());
+    if (offset + token.lexeme.size() > std::numeric_limits<uint32_t>::max()) {
+        throw std::runtime_error("Scripts larger than 4 GB are not supported");
+    }
+    types.push_back(static_cast<uint8_t>(token.type));
+    offsets.push_back(static_cast<uint32_t>(offset));
+    lengths.push_back(static_cast<uint32_t>(token.lexeme.size()));
+    if (token.type == TokenType::NUMBER) {
+        payloads.push_back(static_cast<uint32_t>(numbers.size()));
+        numbers.push_back(NumberValue{token.integer, token.real, token.integral});
+    } else {
+        payloads.push_back(token.word);
+    }
+}
+
+void TokenStream::discardFront(size_t count) {
+    size_t discardedNumbers = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (type(i) == TokenType::NUMBER) {
+            discardedNumbers++;
+        }
+    }
+    types.erase(types.begin(), types.begin() + count);
+    offsets.erase(offsets.begin(), offsets.begin() + count);
+    lengths.erase(lengths.begin(), lengths.begin() + count);
+    payloads.erase(payloads.begin(), payloads.begin() + count);
+    if (!explicitLines.empty()) {
+        explicitLines.erase(explicitLines.begin(), explicitLines.begin() + count);
+        explicitColumns.erase(explicitColumns.begin(), explicitColumns.begin() + count);
+    }
+    if (discardedNumbers > 0) {
+        numbers.erase(numbers.begin(), numbers.begin() + discardedNumbers);
+        for (size_t i = 0; i < types.size(); ++i) {
+            if (type(i) == TokenType::NUMBER) {
+                payloads[i] -= static_cast<uint32_t>(discardedNumbers);
+            }
+        }
+    }
+}
+
+void TokenStream::resize(size_t tokenCount, size_t numberCount) {
+    types.resize(tokenCount);
+    offsets.resize(tokenCount);
+    lengths.resize(tokenCount);
+    payloads.resize(tokenCount);
+    numbers.resize(numberCount);
+}
+
+void TokenStream::copyFrom(const TokenStream& part, size_t tokenCount, size_t tokenOffset, size_t numberOffset,
+                           const std::vector<SymbolId>& wordRemap) {
+    assert(!owned && part.source.data() == source.data());
+    std::copy_n(part.types.begin(), tokenCount, types.begin() + tokenOffset);
+    std::copy_n(part.offsets.begin(), tokenCount, offsets.begin() + tokenOffset);
+    std::copy_n(part.lengths.begin(), tokenCount, lengths.begin() + tokenOffset);
+    for (size_t i = 0; i < tokenCount; ++i) {
+        uint32_t payload = part.payloads[i];
+        if (part.type(i) == TokenType::NUMBER) {
+            payload += static_cast<uint32_t>(numberOffset);
+        } else if (payload != noSymbol) {
+            payload = wordRemap[payload];
+        }
+        payloads[tokenOffset + i] = payload;
+    }
+    std::copy(part.numbers.begin(), part.numbers.end(), numbers.begin() + numberOffset);
+}
+
+size_t TokenStream::numberCount() const {
+    return numbers.size();
+}
+
+const char* TokenStream::base() const {
+    return owned ? ownedText.data() : source.data();
+}
+
+// The lexer reports a string at the line of its closing quote and the column of its opening
+// one; every other token is reported where it starts.
+size_t TokenStream::positionOf(size_t index, bool end) const {
+    if (type(index) == TokenType::STRING) {
+        return end ? offsets[index] + lengths[index] : offsets[index] - 1;
+    }
+    return offsets[index];
+}
+
+size_t TokenStream::lineIndexOf(size_t position) const {
+    if (lineStarts.empty()) {
+        lineStarts.push_back(0);
+        for (size_t i = 0; i < source.size(); ++i) {
+            if (source[i] == '\n') {
+                lineStarts.push_back(static_cast<uint32_t>(i + 1));
+            }
+        }
+    }
+    return static_cast<size_t>(std::upper_bound(lineStarts.begin(), lineStarts.end(), position) -
+                               lineStarts.begin()) - 1;
+}
+
+TokenSpan::TokenSpan(const TokenStream& tokens, size_t begin, size_t end)
+    : tokens(&tokens), begin(begin), end(end) {}
+
+size_t TokenSpan::size() const {
+    return end - begin;
+}
+
+bool TokenSpan::empty() const {
+    return begin == end;
+}
+
+TokenType TokenSpan::type(size_t index) const {
+    return tokens->type(begin + index);
+}
+
+std::string_view TokenSpan::lexeme(size_t index) const {
+    return tokens->lexeme(begin + index);
+}
+
+SymbolId TokenSpan::word(size_t index) const {
+    return tokens->word(begin + index);
+}
+
+TokenSpan TokenSpan::subspan(size_t start, size_t end) const {
+    end = std::min(end, size());
+    start = std::min(start, end);
+    return TokenSpan(*tokens, begin + start, begin + end);
+}
@@ -72,8 +72,8 @@ public:
             decl->accept(*this);
     }
     void visit(AST::ArithmeticStatement& node) override {
-        output << "Arithmetic: " << node.left << " " << node.operation << " " << node.right
-               << " equals " << node.target << "\n";
+        output << "Arithmetic: " << node.left.text << " " << node.operation << " " << node.right.text
+               << " equals " << node.target.text << "\n";
     }
     void visit(AST::RecordDeclaration& node) override {
         output << "RecordDeclaration: " << node.name << "\n";
@@ -83,20 +83,20 @@ public:
     void visit(AST::RecordInstanceDeclaration& node) override {
         output << "RecordInstance: " << node.name << " " << node.typeName << "\n";
         for (const auto& field : node.fieldValues)
-            output << "Value: " << field.first << " " << field.second << "\n";
+            output << "Value: " << field.first << " " << field.second.text << "\n";
     }
     void visit(AST::ImageDeclaration& node) override {
-        output << "ImageDeclaration: " << node.name << " " << node.width << " " << node.height << "\n";
+        output << "ImageDeclaration: " << node.name << " " << node.width.text << " " << node.height.text << "\n";
     }
     void visit(AST::PixelWriteStatement& node) override {
-        output << "PixelWrite: " << node.imageName << " " << node.x << " " << node.y << "\n";
+        output << "PixelWrite: " << node.imageName << " " << node.x.text << " " << node.y.text << "\n";
     }
     void visit(AST::ImageFillStatement& node) override {
         output << "ImageFill: " << node.imageName << "\n";
     }
     void visit(AST::RectanglePaintStatement& node) override {
-        output << "RectanglePaint: " << node.imageName << " " << node.left << " " << node.bottom
-               << " " << node.right << " " << node.top << "\n";
+        output << "RectanglePaint: " << node.imageName << " " << node.left.text << " " << node.bottom.text
+               << " " << node.right.text << " " << node.top.text << "\n";
     }
     void visit(AST::ImageSaveStatement& node) override {
         output << "ImageSave: " << node.imageName << " " << node.outputPath << "\n";
@@ -115,9 +115,11 @@ TEST(ASTTest, NarrativeStatementTest) {
 }
 
 TEST(ASTTest, ConditionalStatementTest) {
-    auto narrative = std::make_unique<AST::NarrativeStatement>("door opens");
-    AST::ConditionalStatement cond("door is unlocked");
-    cond.thenBranch.push_back(std::move(narrative));
+    AST::Arena arena;
+    auto narrative = arena.make<AST::NarrativeStatement>("door opens");
+    AST::ConditionalStatement cond("door is unlocked",
+        AST::Condition({"door"}, AST::ComparisonOperator::EQUAL, {"unlocked"}));
+    cond.thenBranch.push_back(arena, narrative);
     TestVisitor visitor;
     cond.accept(visitor);
     std::string result = visitor.output.str();
@@ -126,9 +128,11 @@ TEST(ASTTest, ConditionalStatementTest) {
 }
 
 TEST(ASTTest, WhileStatementTest) {
-    auto narrative = std::make_unique<AST::NarrativeStatement>("dragon roars loudly");
-    AST::WhileStatement ws("dragon is awake");
-    ws.body.push_back(std::move(narrative));
+    AST::Arena arena;
+    auto narrative = arena.make<AST::NarrativeStatement>("dragon roars loudly");
+    AST::WhileStatement ws("dragon is awake",
+        AST::Condition({"dragon"}, AST::ComparisonOperator::EQUAL, {"awake"}));
+    ws.body.push_back(arena, narrative);
     TestVisitor visitor;
     ws.accept(visitor);
     std::string result = visitor.output.str();
@@ -137,9 +141,10 @@ TEST(ASTTest, WhileStatementTest) {
 }
 
 TEST(ASTTest, ForEachStatementTest) {
-    auto narrative = std::make_unique<AST::NarrativeStatement>("companion joins bravely");
+    AST::Arena arena;
+    auto narrative = arena.make<AST::NarrativeStatement>("companion joins bravely");
     AST::ForEachStatement fe("companion", "squad");
-    fe.body.push_back(std::move(narrative));
+    fe.body.push_back(arena, narrative);
     TestVisitor visitor;
     fe.accept(visitor);
     std::string result = visitor.output.str();
@@ -148,9 +153,10 @@ TEST(ASTTest, ForEachStatementTest) {
 }
 
 TEST(ASTTest, FunctionDeclarationAndCallTest) {
-    auto narrative = std::make_unique<AST::NarrativeStatement>("hero heals quickly");
-    auto funcDecl = std::make_unique<AST::FunctionDeclaration>("healHero");
-    funcDecl->body.push_back(std::move(narrative));
+    AST::Arena arena;
+    auto narrative = arena.make<AST::NarrativeStatement>("hero heals quickly");
+    auto funcDecl = arena.make<AST::FunctionDeclaration>("healHero");
+    funcDecl->body.push_back(arena, narrative);
     AST::FunctionCall funcCall("healHero");
     TestVisitor visitor;
     funcDecl->accept(visitor);
@@ -180,11 +186,12 @@ TEST(ASTTest, VariableDeclarationTest) {
 }
 
 TEST(ASTTest, VariableDeclarationBlockTest) {
-    auto varDecl1 = std::make_unique<AST::VariableDeclaration>("The hero", "strength", "10");
-    auto varDecl2 = std::make_unique<AST::VariableDeclaration>("The hero", "magic", "5");
-    auto varBlock = std::make_unique<AST::VariableDeclarationBlock>();
-    varBlock->declarations.push_back(std::move(varDecl1));
-    varBlock->declarations.push_back(std::move(varDecl2));
+    AST::Arena arena;
+    auto varDecl1 = arena.make<AST::VariableDeclaration>("The hero", "strength", "10");
+    auto varDecl2 = arena.make<AST::VariableDeclaration>("The hero", "magic", "5");
+    auto varBlock = arena.make<AST::VariableDeclarationBlock>();
+    varBlock->declarations.push_back(arena, varDecl1);
+    varBlock->declarations.push_back(arena, varDecl2);
     TestVisitor visitor;
     varBlock->accept(visitor);
     std::string result = visitor.output.str();
@@ -194,8 +201,9 @@ TEST(ASTTest, VariableDeclarationBlockTest) {
 }
 
 TEST(ASTTest, RecordDeclarationAndInstanceTest) {
-    AST::RecordDeclaration record("Vec3", {{"x", "number"}, {"y", "number"}, {"z", "number"}});
-    AST::RecordInstanceDeclaration instance("The color", "Vec3", {{"x", "1"}, {"y", "0.5"}, {"z", "0"}});
+    AST::Arena arena;
+    AST::RecordDeclaration record("Vec3", arena.list<AST::Field>({{"x", "number"}, {"y", "number"}, {"z", "number"}}));
+    AST::RecordInstanceDeclaration instance("The color", "Vec3", arena.list<AST::FieldValue>({{"x", "1"}, {"y", "0.5"}, {"z", "0"}}));
     TestVisitor visitor;
     record.accept(visitor);
     instance.accept(visitor);
@@ -213,3 +221,88 @@ TEST(ASTTest, TellStatementTest) {
     std::string result = visitor.output.str();
     EXPECT_NE(result.find("Tell: Hello, world!"), std::string::npos);
 }
+
+struct KindCounter {
+    int narratives = 0;
+    int loops = 0;
+    int others = 0;
+    void visit(AST::NarrativeStatement&) { narratives++; }
+    void visit(AST::WhileStatement&) { loops++; }
+    template <typename T>
+    void visit(T&) { others++; }
+};
+
+TEST(ASTTest, NodeKindDispatchTest) {
+    AST::Arena arena;
+    auto narrative = arena.make<AST::NarrativeStatement>("The hero sleeps");
+    auto loop = arena.make<AST::WhileStatement>("hero is tired",
+        AST::Condition({"hero"}, AST::ComparisonOperator::EQUAL, {"tired"}));
+    loop->body.push_back(arena, narrative);
+    loop->body.push_back(arena, arena.make<AST::TellStatement>("Zzz"));
+    auto function = arena.make<AST::FunctionDeclaration>("Rest");
+    function->body.push_back(arena, loop);
+
+    EXPECT_EQ(narrative->kind, AST::NodeKind::NARRATIVE);
+    EXPECT_EQ(function->kind, AST::NodeKind::FUNCTION_DECLARATION);
+    EXPECT_EQ(AST::as<AST::WhileStatement>(loop), loop);
+    EXPECT_EQ(AST::as<AST::WhileStatement>(narrative), nullptr);
+
+    KindCounter counter;
+    AST::visitAll(loop->body, counter);
+    EXPECT_EQ(counter.narratives, 1);
+    EXPECT_EQ(counter.others, 1);
+
+    std::vector<AST::NodeKind> order;
+    AST::walk(*function, [&order](AST::Node& node) { order.push_back(node.kind); });
+    std::vector<AST::NodeKind> expected = {AST::NodeKind::FUNCTION_DECLARATION, AST::NodeKind::WHILE,
+                                           AST::NodeKind::NARRATIVE, AST::NodeKind::TELL};
+    EXPECT_EQ(order, expected);
+
+    TestVisitor visitor;
+    AST::dispatch(*narrative, visitor);
+    EXPECT_NE(visitor.output.str().find("The hero sleeps"), std::string::npos);
+}
+
+namespace {
+
+AST::FunctionDeclaration* makeRestFunction(AST::Arena& arena, const char* message) {
+    auto loop = arena.make<AST::WhileStatement>("hero is tired",
+        AST::Condition({"hero"}, AST::ComparisonOperator::EQUAL, {"tired"}));
+    loop->body.push_back(arena, arena.make<AST::TellStatement>(message));
+    auto function = arena.make<AST::FunctionDeclaration>("Rest");
+    function->body.push_back(arena, loop);
+    return function;
+}
+
+}
+
+TEST(ASTTest, StructuralFingerprintTest) {
+    AST::Arena arena;
+    auto first = makeRestFunction(arena, "Zzz");
+    auto same = makeRestFunction(arena, "Zzz");
+    auto changed = makeRestFunction(arena, "Snore");
+    EXPECT_FALSE(AST::fingerprint(*first).empty());
+    EXPECT_EQ(AST::fingerprint(*first), AST::fingerprint(*same));
+    EXPECT_NE(AST::fingerprint(*first), AST::fingerprint(*changed));
+    EXPECT_EQ(first->body[0]->fingerprint, same->body[0]->fingerprint);
+    EXPECT_NE(first->body[0]->fingerprint, changed->body[0]->fingerprint);
+
+    auto vector = arena.make<AST::RecordDeclaration>("Vec", arena.list<AST::Field>({{"x", "number"}, {"y", "number"}}));
+    auto renamed = arena.make<AST::RecordDeclaration>("Vec", arena.list<AST::Field>({{"x", "number"}, {"z", "number"}}));
+    EXPECT_NE(AST::fingerprint(*vector), AST::fingerprint(*renamed));
+
+    // The cached value is returned as is until the node is reset.
+    AST::Fingerprint cached = first->fingerprint;
+    first->name = "Sleep";
+    EXPECT_EQ(AST::fingerprint(*first), cached);
+    first->fingerprint = AST::Fingerprint();
+    EXPECT_NE(AST::fingerprint(*first), cached);
+
+    AST::Statement* deepest = arena.make<AST::ReturnStatement>();
+    for (int i = 0; i < 100000; ++i) {
+        auto loop = arena.make<AST::WhileStatement>("hero is tired", AST::Condition(AST::Operand("hero")));
+        loop->body.push_back(arena, deepest);
+        deepest = loop;
+    }
+    EXPECT_FALSE(AST::fingerprint(*deepest).empty());
+}
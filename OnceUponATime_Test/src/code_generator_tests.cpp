@@ -17,24 +17,28 @@ TEST(CodeGeneratorTest, NarrativeGenerationTest) {
 }
 
 TEST(CodeGeneratorTest, ConditionalGenerationTest) {
-    auto narrativeThen = std::make_unique<AST::NarrativeStatement>("door opens");
-    AST::ConditionalStatement cond("door is unlocked");
-    cond.thenBranch.push_back(std::move(narrativeThen));
+    AST::Arena arena;
+    auto narrativeThen = arena.make<AST::NarrativeStatement>("door opens");
+    AST::ConditionalStatement cond("door is unlocked",
+        AST::Condition({"door"}, AST::ComparisonOperator::EQUAL, {"unlocked"}));
+    cond.thenBranch.push_back(arena, narrativeThen);
     CodeGeneratorVisitor codeGen;
     cond.accept(codeGen);
     std::string generated = codeGen.getGeneratedCode();
     EXPECT_NE(generated.find("if ("), std::string::npos);
-    EXPECT_NE(generated.find("getStoryState(\"door\") == \"unlocked\""), std::string::npos);
+    EXPECT_NE(generated.find("getStoryState(StoryKey::door) == \"unlocked\""), std::string::npos);
 }
 
 TEST(CodeGeneratorTest, WhileAndForEachGenerationTest) {
-    auto narrativeWhile = std::make_unique<AST::NarrativeStatement>("dragon roars loudly");
-    auto whileStmt = std::make_unique<AST::WhileStatement>("dragon is awake");
-    whileStmt->body.push_back(std::move(narrativeWhile));
+    AST::Arena arena;
+    auto narrativeWhile = arena.make<AST::NarrativeStatement>("dragon roars loudly");
+    auto whileStmt = arena.make<AST::WhileStatement>("dragon is awake",
+        AST::Condition({"dragon"}, AST::ComparisonOperator::EQUAL, {"awake"}));
+    whileStmt->body.push_back(arena, narrativeWhile);
 
-    auto narrativeForEach = std::make_unique<AST::NarrativeStatement>("companion joins bravely");
-    auto foreachStmt = std::make_unique<AST::ForEachStatement>("companion", "squad");
-    foreachStmt->body.push_back(std::move(narrativeForEach));
+    auto narrativeForEach = arena.make<AST::NarrativeStatement>("companion joins bravely");
+    auto foreachStmt = arena.make<AST::ForEachStatement>("companion", "squad");
+    foreachStmt->body.push_back(arena, narrativeForEach);
 
     CodeGeneratorVisitor codeGen;
     whileStmt->accept(codeGen);
@@ -45,9 +49,10 @@ TEST(CodeGeneratorTest, WhileAndForEachGenerationTest) {
 }
 
 TEST(CodeGeneratorTest, FunctionGenerationTest) {
-    auto narrative = std::make_unique<AST::NarrativeStatement>("hero heals quickly");
-    auto funcDecl = std::make_unique<AST::FunctionDeclaration>("healHero");
-    funcDecl->body.push_back(std::move(narrative));
+    AST::Arena arena;
+    auto narrative = arena.make<AST::NarrativeStatement>("hero heals quickly");
+    auto funcDecl = arena.make<AST::FunctionDeclaration>("healHero");
+    funcDecl->body.push_back(arena, narrative);
 
     CodeGeneratorVisitor codeGen;
     funcDecl->accept(codeGen);
@@ -72,37 +77,39 @@ TEST(CodeGeneratorTest, DecimalVariableDeclarationGenerationTest) {
 }
 
 TEST(CodeGeneratorTest, ArithmeticGenerationTest) {
+    AST::Arena arena;
     AST::Story story;
-    auto vars = std::make_unique<AST::VariableDeclarationBlock>();
-    vars->declarations.push_back(std::make_unique<AST::VariableDeclaration>("Magic", "value", "5"));
-    story.statements.push_back(std::move(vars));
-    story.statements.push_back(std::make_unique<AST::ArithmeticStatement>("Magic value", "subtract", "1", "Magic value"));
+    auto vars = arena.make<AST::VariableDeclarationBlock>();
+    vars->declarations.push_back(arena, arena.make<AST::VariableDeclaration>("Magic", "value", "5"));
+    story.statements.push_back(arena, vars);
+    story.statements.push_back(arena, arena.make<AST::ArithmeticStatement>("Magic value", "subtract", "1", "Magic value"));
 
     CodeGeneratorVisitor codeGen;
     story.accept(codeGen);
     std::string generated = codeGen.getGeneratedCode();
     EXPECT_NE(generated.find("int magic = 5;"), std::string::npos);
-    EXPECT_NE(generated.find("magic = magic - 1;"), std::string::npos);
+    EXPECT_NE(generated.find("magic = 4;"), std::string::npos);
 }
 
 TEST(CodeGeneratorTest, ImageRuntimeGenerationTest) {
+    AST::Arena arena;
     AST::Story story;
-    auto vars = std::make_unique<AST::VariableDeclarationBlock>();
-    vars->declarations.push_back(std::make_unique<AST::VariableDeclaration>("Image", "width", "4"));
-    vars->declarations.push_back(std::make_unique<AST::VariableDeclaration>("Image", "height", "2"));
-    story.statements.push_back(std::move(vars));
-    story.statements.push_back(std::make_unique<AST::ImageDeclaration>("canvas", "image width", "image height"));
-    story.statements.push_back(std::make_unique<AST::ImageFillStatement>("canvas", "0.1", "0.2", "0.3"));
-    story.statements.push_back(std::make_unique<AST::RectanglePaintStatement>(
+    auto vars = arena.make<AST::VariableDeclarationBlock>();
+    vars->declarations.push_back(arena, arena.make<AST::VariableDeclaration>("Image", "width", "4"));
+    vars->declarations.push_back(arena, arena.make<AST::VariableDeclaration>("Image", "height", "2"));
+    story.statements.push_back(arena, vars);
+    story.statements.push_back(arena, arena.make<AST::ImageDeclaration>("canvas", "image width", "image height"));
+    story.statements.push_back(arena, arena.make<AST::ImageFillStatement>("canvas", "0.1", "0.2", "0.3"));
+    story.statements.push_back(arena, arena.make<AST::RectanglePaintStatement>(
         "canvas", "0", "0", "2", "1", "1", "0", "0"));
-    story.statements.push_back(std::make_unique<AST::PixelWriteStatement>("canvas", "0", "1", "1", "0.5", "0"));
-    story.statements.push_back(std::make_unique<AST::ImageSaveStatement>("canvas", "output/gradient.ppm"));
+    story.statements.push_back(arena, arena.make<AST::PixelWriteStatement>("canvas", "0", "1", "1", "0.5", "0"));
+    story.statements.push_back(arena, arena.make<AST::ImageSaveStatement>("canvas", "output/gradient.ppm"));
 
     CodeGeneratorVisitor codeGen;
     story.accept(codeGen);
     std::string generated = codeGen.getGeneratedCode();
     EXPECT_NE(generated.find("struct OuatImage"), std::string::npos);
-    EXPECT_NE(generated.find("OuatImage canvas = makeImage(static_cast<int>(image_width), static_cast<int>(image_height));"), std::string::npos);
+    EXPECT_NE(generated.find("OuatImage canvas = makeImage(static_cast<int>(4), static_cast<int>(2));"), std::string::npos);
     EXPECT_NE(generated.find("fillImage(canvas, 0.1, 0.2, 0.3);"), std::string::npos);
     EXPECT_NE(generated.find("paintRectangle(canvas, static_cast<int>(0), static_cast<int>(0), static_cast<int>(2), static_cast<int>(1), 1, 0, 0);"), std::string::npos);
     EXPECT_NE(generated.find("paintPixel(canvas, static_cast<int>(0), static_cast<int>(1), 1, 0.5, 0);"), std::string::npos);
@@ -110,16 +117,17 @@ TEST(CodeGeneratorTest, ImageRuntimeGenerationTest) {
 }
 
 TEST(CodeGeneratorTest, RecordGenerationAndFieldAccessTest) {
+    AST::Arena arena;
     AST::Story story;
-    story.statements.push_back(std::make_unique<AST::RecordDeclaration>(
+    story.statements.push_back(arena, arena.make<AST::RecordDeclaration>(
         "Vec3",
-        std::vector<std::pair<std::string, std::string>>{{"x", "number"}, {"y", "number"}, {"z", "number"}}));
-    story.statements.push_back(std::make_unique<AST::RecordInstanceDeclaration>(
+        arena.list<AST::Field>({{"x", "number"}, {"y", "number"}, {"z", "number"}})));
+    story.statements.push_back(arena, arena.make<AST::RecordInstanceDeclaration>(
         "The color",
         "Vec3",
-        std::vector<std::pair<std::string, std::string>>{{"x", "1"}, {"y", "0.5"}, {"z", "0.25"}}));
-    story.statements.push_back(std::make_unique<AST::ImageDeclaration>("canvas", "1", "1"));
-    story.statements.push_back(std::make_unique<AST::PixelWriteStatement>(
+        arena.list<AST::FieldValue>({{"x", "1"}, {"y", "0.5"}, {"z", "0.25"}})));
+    story.statements.push_back(arena, arena.make<AST::ImageDeclaration>("canvas", "1", "1"));
+    story.statements.push_back(arena, arena.make<AST::PixelWriteStatement>(
         "canvas", "0", "0", "color x", "color y", "color z"));
 
     CodeGeneratorVisitor codeGen;
@@ -127,29 +135,30 @@ TEST(CodeGeneratorTest, RecordGenerationAndFieldAccessTest) {
     std::string generated = codeGen.getGeneratedCode();
     EXPECT_NE(generated.find("struct Vec3"), std::string::npos);
     EXPECT_NE(generated.find("double x = 0;"), std::string::npos);
-    EXPECT_NE(generated.find("Vec3 color{};"), std::string::npos);
-    EXPECT_NE(generated.find("color.x = 1;"), std::string::npos);
-    EXPECT_NE(generated.find("paintPixel(canvas, static_cast<int>(0), static_cast<int>(0), color.x, color.y, color.z);"), std::string::npos);
+    // Every read of the fields is folded, so the instance itself is never written.
+    EXPECT_EQ(generated.find("Vec3 color{};"), std::string::npos);
+    EXPECT_NE(generated.find("paintPixel(canvas, static_cast<int>(0), static_cast<int>(0), 1.0, 0.5, 0.25);"), std::string::npos);
 }
 
 TEST(CodeGeneratorTest, NestedRecordFieldAccessTest) {
+    AST::Arena arena;
     AST::Story story;
-    story.statements.push_back(std::make_unique<AST::RecordDeclaration>(
+    story.statements.push_back(arena, arena.make<AST::RecordDeclaration>(
         "Vec3",
-        std::vector<std::pair<std::string, std::string>>{{"x", "number"}, {"y", "number"}, {"z", "number"}}));
-    story.statements.push_back(std::make_unique<AST::RecordDeclaration>(
+        arena.list<AST::Field>({{"x", "number"}, {"y", "number"}, {"z", "number"}})));
+    story.statements.push_back(arena, arena.make<AST::RecordDeclaration>(
         "Ray",
-        std::vector<std::pair<std::string, std::string>>{{"origin", "Vec3"}, {"direction", "Vec3"}}));
-    story.statements.push_back(std::make_unique<AST::RecordInstanceDeclaration>(
+        arena.list<AST::Field>({{"origin", "Vec3"}, {"direction", "Vec3"}})));
+    story.statements.push_back(arena, arena.make<AST::RecordInstanceDeclaration>(
         "The camera origin",
         "Vec3",
-        std::vector<std::pair<std::string, std::string>>{{"x", "0"}, {"y", "1"}, {"z", "2"}}));
-    story.statements.push_back(std::make_unique<AST::RecordInstanceDeclaration>(
+        arena.list<AST::FieldValue>({{"x", "0"}, {"y", "1"}, {"z", "2"}})));
+    story.statements.push_back(arena, arena.make<AST::RecordInstanceDeclaration>(
         "The camera ray",
         "Ray",
-        std::vector<std::pair<std::string, std::string>>{{"origin", "camera origin"}, {"direction", "camera origin"}}));
-    story.statements.push_back(std::make_unique<AST::ImageDeclaration>("canvas", "1", "1"));
-    story.statements.push_back(std::make_unique<AST::PixelWriteStatement>(
+        arena.list<AST::FieldValue>({{"origin", "camera origin"}, {"direction", "camera origin"}})));
+    story.statements.push_back(arena, arena.make<AST::ImageDeclaration>("canvas", "1", "1"));
+    story.statements.push_back(arena, arena.make<AST::PixelWriteStatement>(
         "canvas", "0", "0", "camera ray origin x", "camera ray origin y", "camera ray origin z"));
 
     CodeGeneratorVisitor codeGen;
@@ -163,7 +172,9 @@ TEST(CodeGeneratorTest, NestedRecordFieldAccessTest) {
 }
 
 TEST(CodeGeneratorTest, CollectionDeclarationGenerationTest) {
-    AST::VariableDeclaration collection("The hero", "companions", std::vector<std::string>{"Alice", "Bob", "Charlie"});
+    AST::Arena arena;
+    AST::VariableDeclaration collection("The hero", "companions",
+                                        arena.list<std::string_view>({"Alice", "Bob", "Charlie"}));
     CodeGeneratorVisitor codeGen;
     collection.accept(codeGen);
     std::string generated = codeGen.getGeneratedCode();
@@ -171,9 +182,10 @@ TEST(CodeGeneratorTest, CollectionDeclarationGenerationTest) {
 }
 
 TEST(CodeGeneratorTest, StoryGenerationTest) {
-    auto narrative = std::make_unique<AST::NarrativeStatement>("princess lived bravely");
+    AST::Arena arena;
+    auto narrative = arena.make<AST::NarrativeStatement>("princess lived bravely");
     AST::Story story;
-    story.statements.push_back(std::move(narrative));
+    story.statements.push_back(arena, narrative);
 
     CodeGeneratorVisitor codeGen;
     story.accept(codeGen);
@@ -183,13 +195,14 @@ TEST(CodeGeneratorTest, StoryGenerationTest) {
 }
 
 TEST(CodeGeneratorTest, StoryHoistsFunctionDeclarationsTest) {
-    auto funcDecl = std::make_unique<AST::FunctionDeclaration>("healHero");
-    funcDecl->body.push_back(std::make_unique<AST::TellStatement>("healed"));
-    auto funcCall = std::make_unique<AST::FunctionCall>("healHero");
+    AST::Arena arena;
+    auto funcDecl = arena.make<AST::FunctionDeclaration>("healHero");
+    funcDecl->body.push_back(arena, arena.make<AST::TellStatement>("healed"));
+    auto funcCall = arena.make<AST::FunctionCall>("healHero");
 
     AST::Story story;
-    story.statements.push_back(std::move(funcDecl));
-    story.statements.push_back(std::move(funcCall));
+    story.statements.push_back(arena, funcDecl);
+    story.statements.push_back(arena, funcCall);
 
     CodeGeneratorVisitor codeGen;
     story.accept(codeGen);
@@ -247,11 +260,12 @@ TEST(CodeGeneratorTest, CommentGenerationTest) {
 }
 
 TEST(CodeGeneratorTest, VariableDeclarationBlockGenerationTest) {
-    auto varDecl1 = std::make_unique<AST::VariableDeclaration>("The hero", "strength", "10");
-    auto varDecl2 = std::make_unique<AST::VariableDeclaration>("The hero", "magic", "5");
-    auto varBlock = std::make_unique<AST::VariableDeclarationBlock>();
-    varBlock->declarations.push_back(std::move(varDecl1));
-    varBlock->declarations.push_back(std::move(varDecl2));
+    AST::Arena arena;
+    auto varDecl1 = arena.make<AST::VariableDeclaration>("The hero", "strength", "10");
+    auto varDecl2 = arena.make<AST::VariableDeclaration>("The hero", "magic", "5");
+    auto varBlock = arena.make<AST::VariableDeclarationBlock>();
+    varBlock->declarations.push_back(arena, varDecl1);
+    varBlock->declarations.push_back(arena, varDecl2);
 
     CodeGeneratorVisitor codeGen;
     varBlock->accept(codeGen);
@@ -261,37 +275,43 @@ TEST(CodeGeneratorTest, VariableDeclarationBlockGenerationTest) {
 }
 
 TEST(CodeGeneratorTest, WhileMultipleStatementsGenerationTest) {
-    auto whileStmt = std::make_unique<AST::WhileStatement>("dragon is awake");
-    whileStmt->body.push_back(std::make_unique<AST::NarrativeStatement>("Hero trembles"));
-    whileStmt->body.push_back(std::make_unique<AST::NarrativeStatement>("Knight prepares"));
+    AST::Arena arena;
+    auto whileStmt = arena.make<AST::WhileStatement>("dragon is awake",
+        AST::Condition({"dragon"}, AST::ComparisonOperator::EQUAL, {"awake"}));
+    whileStmt->body.push_back(arena, arena.make<AST::NarrativeStatement>("Hero trembles"));
+    whileStmt->body.push_back(arena, arena.make<AST::NarrativeStatement>("Knight prepares"));
 
     CodeGeneratorVisitor codeGen;
     whileStmt->accept(codeGen);
     std::string generated = codeGen.getGeneratedCode();
-    EXPECT_NE(generated.find("getStoryState(\"dragon\") == \"awake\""), std::string::npos);
+    EXPECT_NE(generated.find("getStoryState(StoryKey::dragon) == \"awake\""), std::string::npos);
     EXPECT_NE(generated.find("Hero trembles"), std::string::npos);
     EXPECT_NE(generated.find("Knight prepares"), std::string::npos);
 }
 
 TEST(CodeGeneratorTest, NestedWhileGenerationTest) {
-    auto innerWhile = std::make_unique<AST::WhileStatement>("hero is brave");
-    innerWhile->body.push_back(std::make_unique<AST::NarrativeStatement>("Hero fights"));
+    AST::Arena arena;
+    auto innerWhile = arena.make<AST::WhileStatement>("hero is brave",
+        AST::Condition({"hero"}, AST::ComparisonOperator::EQUAL, {"brave"}));
+    innerWhile->body.push_back(arena, arena.make<AST::NarrativeStatement>("Hero fights"));
 
-    auto outerWhile = std::make_unique<AST::WhileStatement>("dragon is awake");
-    outerWhile->body.push_back(std::move(innerWhile));
+    auto outerWhile = arena.make<AST::WhileStatement>("dragon is awake",
+        AST::Condition({"dragon"}, AST::ComparisonOperator::EQUAL, {"awake"}));
+    outerWhile->body.push_back(arena, innerWhile);
 
     CodeGeneratorVisitor codeGen;
     outerWhile->accept(codeGen);
     std::string generated = codeGen.getGeneratedCode();
-    EXPECT_NE(generated.find("getStoryState(\"dragon\") == \"awake\""), std::string::npos);
-    EXPECT_NE(generated.find("getStoryState(\"hero\") == \"brave\""), std::string::npos);
+    EXPECT_NE(generated.find("getStoryState(StoryKey::dragon) == \"awake\""), std::string::npos);
+    EXPECT_NE(generated.find("getStoryState(StoryKey::hero) == \"brave\""), std::string::npos);
     EXPECT_NE(generated.find("Hero fights"), std::string::npos);
 }
 
 TEST(CodeGeneratorTest, ForEachMultipleStatementsGenerationTest) {
-    auto forEachStmt = std::make_unique<AST::ForEachStatement>("knight", "round table");
-    forEachStmt->body.push_back(std::make_unique<AST::NarrativeStatement>("Knight stands"));
-    forEachStmt->body.push_back(std::make_unique<AST::NarrativeStatement>("Knight bows"));
+    AST::Arena arena;
+    auto forEachStmt = arena.make<AST::ForEachStatement>("knight", "round table");
+    forEachStmt->body.push_back(arena, arena.make<AST::NarrativeStatement>("Knight stands"));
+    forEachStmt->body.push_back(arena, arena.make<AST::NarrativeStatement>("Knight bows"));
 
     CodeGeneratorVisitor codeGen;
     forEachStmt->accept(codeGen);
@@ -302,8 +322,9 @@ TEST(CodeGeneratorTest, ForEachMultipleStatementsGenerationTest) {
 }
 
 TEST(CodeGeneratorTest, ForRangeGenerationTest) {
-    auto forRangeStmt = std::make_unique<AST::ForRangeStatement>("y", "0", "height");
-    forRangeStmt->body.push_back(std::make_unique<AST::TellStatement>("row"));
+    AST::Arena arena;
+    auto forRangeStmt = arena.make<AST::ForRangeStatement>("y", "0", "height");
+    forRangeStmt->body.push_back(arena, arena.make<AST::TellStatement>("row"));
 
     CodeGeneratorVisitor codeGen;
     forRangeStmt->accept(codeGen);
@@ -313,11 +334,12 @@ TEST(CodeGeneratorTest, ForRangeGenerationTest) {
 }
 
 TEST(CodeGeneratorTest, NestedForEachGenerationTest) {
-    auto innerForEach = std::make_unique<AST::ForEachStatement>("room", "castle");
-    innerForEach->body.push_back(std::make_unique<AST::NarrativeStatement>("Room is cleaned"));
+    AST::Arena arena;
+    auto innerForEach = arena.make<AST::ForEachStatement>("room", "castle");
+    innerForEach->body.push_back(arena, arena.make<AST::NarrativeStatement>("Room is cleaned"));
 
-    auto outerForEach = std::make_unique<AST::ForEachStatement>("castle", "kingdom");
-    outerForEach->body.push_back(std::move(innerForEach));
+    auto outerForEach = arena.make<AST::ForEachStatement>("castle", "kingdom");
+    outerForEach->body.push_back(arena, innerForEach);
 
     CodeGeneratorVisitor codeGen;
     outerForEach->accept(codeGen);
@@ -328,16 +350,42 @@ TEST(CodeGeneratorTest, NestedForEachGenerationTest) {
 }
 
 TEST(CodeGeneratorTest, LoopWithConditionalGenerationTest) {
-    auto conditional = std::make_unique<AST::ConditionalStatement>("knight is brave");
-    conditional->thenBranch.push_back(std::make_unique<AST::NarrativeStatement>("Knight fights"));
+    AST::Arena arena;
+    auto conditional = arena.make<AST::ConditionalStatement>("knight is brave",
+        AST::Condition({"knight"}, AST::ComparisonOperator::EQUAL, {"brave"}));
+    conditional->thenBranch.push_back(arena, arena.make<AST::NarrativeStatement>("Knight fights"));
 
-    auto forEachStmt = std::make_unique<AST::ForEachStatement>("knight", "round table");
-    forEachStmt->body.push_back(std::move(conditional));
+    auto forEachStmt = arena.make<AST::ForEachStatement>("knight", "round table");
+    forEachStmt->body.push_back(arena, conditional);
 
     CodeGeneratorVisitor codeGen;
     forEachStmt->accept(codeGen);
     std::string generated = codeGen.getGeneratedCode();
     EXPECT_NE(generated.find("for (const auto& knight : round_table)"), std::string::npos);
-    EXPECT_NE(generated.find("getStoryState(\"knight\") == \"brave\""), std::string::npos);
+    EXPECT_NE(generated.find("getStoryState(StoryKey::knight) == \"brave\""), std::string::npos);
     EXPECT_NE(generated.find("Knight fights"), std::string::npos);
 }
+
+TEST(CodeGeneratorTest, OperandResolutionTest) {
+    AST::Arena arena;
+    AST::Story story;
+    story.statements.push_back(arena, arena.make<AST::RecordDeclaration>(
+        "Vec3",
+        arena.list<AST::Field>({{"x", "number"}, {"y", "number"}, {"z", "number"}})));
+    story.statements.push_back(arena, arena.make<AST::RecordInstanceDeclaration>(
+        "The color",
+        "Vec3",
+        arena.list<AST::FieldValue>({{"x", "1"}, {"y", "0.5"}, {"z", "0.25"}})));
+    story.statements.push_back(arena, arena.make<AST::ArithmeticStatement>("gold", "add", "1", "purse"));
+    auto fill = arena.make<AST::ImageFillStatement>("canvas", "color x", "purse", "sky brightness");
+    story.statements.push_back(arena, fill);
+
+    CodeGeneratorVisitor codeGen;
+    story.accept(codeGen);
+    EXPECT_EQ(fill->red.binding, AST::Operand::Binding::FIELD);
+    EXPECT_EQ(fill->green.binding, AST::Operand::Binding::SYMBOL);
+    EXPECT_EQ(fill->blue.binding, AST::Operand::Binding::STORY_STATE);
+    std::string generated = codeGen.getGeneratedCode();
+    EXPECT_NE(generated.find("fillImage(canvas, 1.0, purse, getStoryNumber(StoryKey::sky_brightness));"),
+              std::string::npos);
+}
@@ -0,0 +1,47 @@
+// code_output_tests.cpp
+
+#include "pch.h"
+
+#include "code_output.h"
+#include <sstream>
+#include <string>
+
+TEST(CodeOutputTest, AppendsAcrossChunksTest) {
+    CodeOutput output(8);
+    output << "int x = " << 42 << ";" << '\n' << std::string("double y = ") << -7 << ";\n";
+    output << static_cast<size_t>(123456789012ull);
+    std::string expected = "int x = 42;\ndouble y = -7;\n123456789012";
+    EXPECT_EQ(output.size(), expected.size());
+    EXPECT_EQ(output.str(), expected);
+
+    std::ostringstream written;
+    output.writeTo(written);
+    EXPECT_EQ(written.str(), expected);
+
+    EXPECT_EQ(output.take(), expected);
+    EXPECT_EQ(output.size(), 0u);
+    output << "next";
+    EXPECT_EQ(output.take(), "next");
+}
+
+TEST(CodeOutputTest, WritesFullChunksToTargetTest) {
+    std::ostringstream target;
+    CodeOutput output(4);
+    output << "ab";
+    output.setTarget(&target);
+    EXPECT_EQ(target.str(), "");
+
+    output << "cdefghij";
+    EXPECT_EQ(target.str(), "abcdefgh");
+    EXPECT_EQ(output.str(), "ij");
+
+    output.flush();
+    EXPECT_EQ(target.str(), "abcdefghij");
+    EXPECT_EQ(output.size(), 0u);
+
+    output << "k";
+    output.setTarget(nullptr);
+    output << "l";
+    EXPECT_EQ(target.str(), "abcdefghijk");
+    EXPECT_EQ(output.take(), "l");
+}
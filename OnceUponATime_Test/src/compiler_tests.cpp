@@ -3,10 +3,15 @@
 #include "lexer.h"
 #include "parser.h"
 #include "code_generator.h"
+#include "code_output.h"
+#include "compiler.h"
 #include "ast.h"
 #include <memory>
 #include <string>
 #include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
 
 std::unique_ptr<AST::Story> compileScript(const std::string &source) {
     Lexer lexer(source);
@@ -43,7 +48,7 @@ TEST(CompilerTest, ConditionalCompilationTest) {
     CodeGeneratorVisitor codeGen;
     story->accept(codeGen);
     std::string generated = codeGen.getGeneratedCode();
-    EXPECT_NE(generated.find("getStoryState(\"hero\") == \"brave\""), std::string::npos);
+    EXPECT_NE(generated.find("getStoryState(StoryKey::hero) == \"brave\""), std::string::npos);
     EXPECT_NE(generated.find("The hero wins"), std::string::npos);
 }
 
@@ -60,7 +65,7 @@ TEST(CompilerTest, LoopCompilationTest) {
     CodeGeneratorVisitor codeGen;
     story->accept(codeGen);
     std::string generated = codeGen.getGeneratedCode();
-    EXPECT_NE(generated.find("getStoryState(\"dragon\") == \"awake\""), std::string::npos);
+    EXPECT_NE(generated.find("getStoryState(StoryKey::dragon) == \"awake\""), std::string::npos);
     EXPECT_NE(generated.find("Hero trembles"), std::string::npos);
 }
 
@@ -87,6 +92,7 @@ TEST(CompilerTest, VariableCompilationTest) {
     std::string script = 
         "Once upon a time. "
         "The hero has strength of 10. "
+        "While hero strength is less than 12. Hero strength add 1 equals hero strength. Endwhile. "
         "The story ends.";
     auto story = compileScript(script);
     ASSERT_NE(story, nullptr);
@@ -95,6 +101,7 @@ TEST(CompilerTest, VariableCompilationTest) {
     story->accept(codeGen);
     std::string generated = codeGen.getGeneratedCode();
     EXPECT_NE(generated.find("int hero_strength = 10;"), std::string::npos);
+    EXPECT_LT(generated.find("int hero_strength = 10;"), generated.find("while ("));
 }
 
 TEST(CompilerTest, NestedWhileCompilationTest) {
@@ -112,8 +119,8 @@ TEST(CompilerTest, NestedWhileCompilationTest) {
     CodeGeneratorVisitor codeGen;
     story->accept(codeGen);
     std::string generated = codeGen.getGeneratedCode();
-    EXPECT_NE(generated.find("getStoryState(\"dragon\") == \"awake\""), std::string::npos);
-    EXPECT_NE(generated.find("getStoryState(\"hero\") == \"brave\""), std::string::npos);
+    EXPECT_NE(generated.find("getStoryState(StoryKey::dragon) == \"awake\""), std::string::npos);
+    EXPECT_NE(generated.find("getStoryState(StoryKey::hero) == \"brave\""), std::string::npos);
     EXPECT_NE(generated.find("Hero fights"), std::string::npos);
 }
 
@@ -153,7 +160,7 @@ TEST(CompilerTest, LoopWithConditionalCompilationTest) {
     story->accept(codeGen);
     std::string generated = codeGen.getGeneratedCode();
     EXPECT_NE(generated.find("for (const auto& knight : round_table)"), std::string::npos);
-    EXPECT_NE(generated.find("getStoryState(\"knight\") == \"brave\""), std::string::npos);
+    EXPECT_NE(generated.find("getStoryState(StoryKey::knight) == \"brave\""), std::string::npos);
     EXPECT_NE(generated.find("Knight fights"), std::string::npos);
 }
 
@@ -172,7 +179,7 @@ TEST(CompilerTest, WhileMultipleStatementsCompilationTest) {
     CodeGeneratorVisitor codeGen;
     story->accept(codeGen);
     std::string generated = codeGen.getGeneratedCode();
-    EXPECT_NE(generated.find("getStoryState(\"dragon\") == \"awake\""), std::string::npos);
+    EXPECT_NE(generated.find("getStoryState(StoryKey::dragon) == \"awake\""), std::string::npos);
     EXPECT_NE(generated.find("Hero trembles"), std::string::npos);
     EXPECT_NE(generated.find("Knight prepares"), std::string::npos);
     EXPECT_NE(generated.find("Wizard casts spell"), std::string::npos);
@@ -194,3 +201,302 @@ TEST(CompilerTest, ForEachWithUndeclaredCollectionTest) {
     
     EXPECT_NE(generated.find("std::vector<std::string> squad = {}"), std::string::npos);
 }
+
+TEST(CompilerTest, StreamingCompilationMatchesBatchTest) {
+    std::string script =
+        "Once upon a time. "
+        "Call greet. "
+        "The hero has companions of [\"Alice\", \"Bob\"]. "
+        "The image has width of 4 and height is 2. "
+        "Define the record Color with red number and green number and blue number. "
+        "The sky is a Color with red 0.2 and green 0.4 and blue 0.9. "
+        "Create image canvas with width image width and height image height. "
+        "For each y from 0 to image height do "
+        "For each x from 0 to image width do "
+        "X divide image width equals shade. "
+        "Paint canvas at x y with shade sky green, sky blue. "
+        "Endfor. "
+        "Endfor. "
+        "For each friend in party do Tell \"Hi\". Endfor. "
+        "Define the function greet as. "
+        "For each companion in hero companions do Tell \"Hello\". Endfor. "
+        "Endfunction. "
+        "If hero is brave then The hero wins. Else The hero hides. Endif. "
+        "The story ends.";
+
+    std::ostringstream streamed;
+    compileStoryStreaming(script, streamed);
+    EXPECT_EQ(streamed.str(), compileStory(script));
+    EXPECT_NE(streamed.str().find("void greet() {"), std::string::npos);
+    EXPECT_NE(streamed.str().find("std::vector<std::string> party = {};"), std::string::npos);
+}
+
+TEST(CompilerTest, StreamingCompilationRequiresEpilogueTest) {
+    std::string script = "Once upon a time. The hero lived bravely.";
+    std::ostringstream streamed;
+    EXPECT_THROW(compileStoryStreaming(script, streamed), std::runtime_error);
+}
+
+TEST(CompilerTest, DeeplyNestedStoryTest) {
+    const int depth = 1000;
+    std::string script = "Once upon a time. Define the function Rest as ";
+    for (int i = 0; i < depth; ++i) {
+        script += i % 3 == 0 ? "If door is open then " : i % 3 == 1 ? "While hero is awake. " : "For each n from 0 to 2 do ";
+    }
+    script += "Tell \"Deep\". ";
+    for (int i = depth - 1; i >= 0; --i) {
+        script += i % 3 == 0 ? "Else Tell \"Shallow\". End. " : i % 3 == 1 ? "Endwhile. " : "Endfor. ";
+    }
+    script += "Endfunction. Call Rest. The story ends.";
+
+    std::string code = compileStory(script);
+    size_t function = code.find("void Rest() {");
+    ASSERT_NE(function, std::string::npos);
+    size_t opened = 0;
+    size_t closed = 0;
+    for (size_t i = function; i < code.size(); ++i) {
+        opened += code[i] == '{';
+        closed += code[i] == '}';
+        if (opened > 0 && opened == closed) {
+            break;
+        }
+    }
+    EXPECT_EQ(opened, depth + 1 + depth / 3 + 1);
+    EXPECT_NE(code.find(std::string(4 * (depth + 1), ' ') + "std::cout << \"Deep\""), std::string::npos);
+
+    std::ostringstream direct;
+    compileStory(*parseStory(script), direct);
+    EXPECT_GT(code.size(), CodeOutput::defaultChunkSize);
+    EXPECT_EQ(direct.str(), code);
+    EXPECT_NE(code.find("} else {"), std::string::npos);
+}
+
+TEST(CompilerTest, QuotedNumbersAreComparedAsNumbersTest) {
+    std::string code = compileStory(
+        "Once upon a time. "
+        "The hero has score of 7. "
+        "If luck is at least 1 then Hero score add 1 equals hero score. End. "
+        "If hero score is \"7\" then Tell \"Seven\". End. "
+        "If hero score is greater than \"5\" then Tell \"More\". End. "
+        "If luck is at least \"2.5\" then Tell \"Lucky\". End. "
+        "The story ends.");
+    EXPECT_NE(code.find("if (hero_score == 7) {"), std::string::npos);
+    EXPECT_NE(code.find("if (hero_score > 5) {"), std::string::npos);
+    EXPECT_NE(code.find("if (getStoryNumber(StoryKey::luck) >= 2.5) {"), std::string::npos);
+    EXPECT_EQ(code.find("\"7\""), std::string::npos);
+    EXPECT_EQ(code.find("\"5\""), std::string::npos);
+}
+
+TEST(CompilerTest, KnownValuesAreFoldedTest) {
+    std::string code = compileStory(
+        "Once upon a time. "
+        "The image has width of 8 and height of 3. "
+        "Image width multiply 2 equals double width. "
+        "Image width divide image height equals ratio. "
+        "Create image canvas with width double width and height image height. "
+        "For each y from 0 to image height do "
+        "Paint canvas at 0 y with ratio 0 0. "
+        "Endfor. "
+        "Save image canvas to \"output/folded.ppm\". "
+        "The story ends.");
+    EXPECT_EQ(code.find("double_width"), std::string::npos);
+    EXPECT_EQ(code.find("ratio"), std::string::npos);
+    EXPECT_NE(code.find("makeImage(static_cast<int>(16.0), static_cast<int>(3));"), std::string::npos);
+    EXPECT_NE(code.find("y < static_cast<int>(3);"), std::string::npos);
+    EXPECT_NE(code.find("paintPixel(canvas, static_cast<int>(0), static_cast<int>(y), 2.0, 0, 0);"),
+              std::string::npos);
+}
+
+TEST(CompilerTest, FoldedDeclarationsAreOnlyWrittenWhenNamedTest) {
+    std::string script =
+        "Once upon a time. "
+        "The image has width of 8 and height of 4. "
+        "The hero has strength of 5. "
+        "Define the record Color with red number and green number and blue number. "
+        "The tint is a Color with red 1 and green 0.5 and blue 0.25. "
+        "The glow is a Color with red 0 and green 0 and blue 0. "
+        "Create image canvas with width image width and height image height. "
+        "Fill image canvas with tint. "
+        "Tell \"Ready\". "
+        "While hero strength is less than 9. Hero strength add 1 equals hero strength. Endwhile. "
+        "Glow red add 1 equals glow red. "
+        "The story ends.";
+
+    std::string code = compileStory(script);
+    EXPECT_EQ(code.find("image_width"), std::string::npos);
+    EXPECT_EQ(code.find("image_height"), std::string::npos);
+    EXPECT_EQ(code.find("tint"), std::string::npos);
+    EXPECT_NE(code.find("makeImage(static_cast<int>(8), static_cast<int>(4));"), std::string::npos);
+    EXPECT_NE(code.find("fillImage(canvas, 1.0, 0.5, 0.25);"), std::string::npos);
+    size_t strength = code.find("int hero_strength = 5;");
+    ASSERT_NE(strength, std::string::npos);
+    EXPECT_LT(code.find("Ready"), strength);
+    EXPECT_LT(strength, code.find("while (hero_strength < 9)"));
+    size_t glow = code.find("Color glow{};");
+    ASSERT_NE(glow, std::string::npos);
+    EXPECT_LT(code.find("while ("), glow);
+    EXPECT_LT(glow, code.find("glow.red = 1;"));
+
+    std::ostringstream streamed;
+    compileStoryStreaming(script, streamed);
+    EXPECT_EQ(streamed.str(), code);
+}
+
+TEST(CompilerTest, ValuesAssignedInBlocksAreNotFoldedTest) {
+    std::string code = compileStory(
+        "Once upon a time. "
+        "The counter has value of 3. "
+        "The total has value of 1. "
+        "While counter is greater than 0. "
+        "Total multiply 2 equals total. "
+        "Counter subtract 1 equals counter. "
+        "Endwhile. "
+        "If total is greater than 4 then Total add 1 equals total. End. "
+        "Total add 1 equals result. "
+        "The story ends.");
+    EXPECT_NE(code.find("while (counter > 0) {"), std::string::npos);
+    EXPECT_NE(code.find("total = total * 2;"), std::string::npos);
+    EXPECT_NE(code.find("counter = counter - 1;"), std::string::npos);
+    EXPECT_NE(code.find("if (total > 4) {"), std::string::npos);
+    EXPECT_NE(code.find("double result = total + 1;"), std::string::npos);
+}
+
+TEST(CompilerTest, LoopInvariantsAreHoistedTest) {
+    std::string code = compileStory(
+        "Once upon a time. "
+        "The image has width of 8 and height of 4. "
+        "Create image canvas with width image width and height image height. "
+        "For each y from 0 to image height do "
+        "For each x from 0 to image width do "
+        "X divide image width equals red. "
+        "Y divide image height equals green. "
+        "Green multiply 2 equals blue. "
+        "Paint canvas at x y with red green blue. "
+        "Endfor. "
+        "Endfor. "
+        "For each n from 0 to hero strength do "
+        "Tell \"Again\". "
+        "Endfor. "
+        "Save image canvas to \"output/hoisted.ppm\". "
+        "The story ends.");
+    size_t inner = code.find("for (int x = static_cast<int>(0);");
+    ASSERT_NE(inner, std::string::npos);
+    size_t green = code.find("double green = y / 4;");
+    size_t blue = code.find("double blue = green * 2;");
+    EXPECT_LT(green, inner);
+    EXPECT_LT(blue, inner);
+    EXPECT_GT(code.find("double red = x / 8;"), inner);
+    EXPECT_NE(code.find("rangeEnd0 = static_cast<int>(getStoryNumber(StoryKey::hero_strength)); n < rangeEnd0;"),
+              std::string::npos);
+}
+
+TEST(CompilerTest, LoopVariantStatementsStayInTheLoopTest) {
+    std::string code = compileStory(
+        "Once upon a time. "
+        "The counter has value of 3. "
+        "While counter is greater than 0. "
+        "Counter subtract 1 equals counter. "
+        "Counter multiply 2 equals doubled. "
+        "Tell \"Tick\". "
+        "Endwhile. "
+        "For each i from 0 to counter do "
+        "Tell \"Tock\". "
+        "Counter divide counter equals ratio. "
+        "Endfor. "
+        "For each j from 0 to counter do "
+        "If late is greater than 1 then Tell \"Late\". End. "
+        "Counter add 1 equals late. "
+        "Endfor. "
+        "The story ends.");
+    size_t loop = code.find("while (counter > 0) {");
+    ASSERT_NE(loop, std::string::npos);
+    EXPECT_GT(code.find("double doubled = counter * 2;"), loop);
+    EXPECT_GT(code.find("double ratio = counter / counter;"), code.find("for (int i ="));
+    EXPECT_GT(code.find("double late = counter + 1;"), code.find("for (int j ="));
+}
+
+TEST(CompilerTest, StoryStatesUseTypedSlotsTest) {
+    std::string code = compileStory(
+        "Once upon a time. "
+        "Random class leans towards kind or cruel. "
+        "If class is kind then Tell \"Lucky\". End. "
+        "The story ends.");
+    EXPECT_NE(code.find("enum class StoryKey { class_ };"), std::string::npos);
+    EXPECT_NE(code.find("StoryState storyStates[1];"), std::string::npos);
+    EXPECT_NE(code.find("setStoryState(StoryKey::class_, class_state_random);"), std::string::npos);
+    EXPECT_NE(code.find("getStoryState(StoryKey::class_) == \"kind\""), std::string::npos);
+    EXPECT_EQ(code.find("std::unordered_map"), std::string::npos);
+
+    std::string unread = compileStory("Once upon a time. Tell \"Hello\". The story ends.");
+    EXPECT_EQ(unread.find("StoryKey"), std::string::npos);
+}
+
+TEST(CompilerTest, UnreadStoryStatesAreNotWrittenTest) {
+    std::string script =
+        "Once upon a time. "
+        "The image has width of 8 and height is 8. "
+        "The gate has open of true. "
+        "The hero has strength of 5. "
+        "Create image canvas with width image width and height image height. "
+        "For each y from 0 to image height do "
+        "For each x from 0 to image width do "
+        "X divide image width equals red. "
+        "Paint canvas at x y with red 0 0.25. "
+        "Endfor. "
+        "Endfor. "
+        "Random fate leans towards kind or cruel. "
+        "If fate is kind then Tell \"Lucky\". End. "
+        "If gate open then Tell \"Open\". End. "
+        "Hero strength add 1 equals hero strength. "
+        "The story ends.";
+
+    std::string code = compileStory(script);
+    EXPECT_EQ(code.find("StoryKey::red"), std::string::npos);
+    EXPECT_EQ(code.find("StoryKey::image_width"), std::string::npos);
+    EXPECT_EQ(code.find("StoryKey::hero_strength"), std::string::npos);
+    EXPECT_NE(code.find("setStoryState(StoryKey::fate, fate_state_random);"), std::string::npos);
+    EXPECT_NE(code.find("setStoryState(StoryKey::gate_open, gate_open);"), std::string::npos);
+    EXPECT_NE(code.find("storyCondition(StoryKey::gate_open)"), std::string::npos);
+
+    std::ostringstream streamed;
+    compileStoryStreaming(script, streamed);
+    EXPECT_EQ(streamed.str(), code);
+}
+
+TEST(CompilerTest, StoriesKeepTheirOwnNamesTest) {
+    auto first = parseStory("Once upon a time. If hero is brave then Tell \"Go\". End. The story ends.");
+    size_t firstNames = first->names.size();
+    auto second = parseStory("Once upon a time. If dragon is awake then Tell \"Run\". End. The story ends.");
+    EXPECT_EQ(first->names.size(), firstNames);
+    EXPECT_EQ(second->names.size(), firstNames);
+    EXPECT_NE(compileStory(*first).find("StoryKey::hero"), std::string::npos);
+    EXPECT_EQ(compileStory(*first).find("StoryKey::dragon"), std::string::npos);
+}
+
+TEST(CompilerTest, StoriesCompileConcurrentlyTest) {
+    std::string script =
+        "Once upon a time. "
+        "The hero has strength of 5. "
+        "While hero strength is less than 9 do "
+        "Hero strength add 1 equals hero strength. "
+        "If fate is kind then Tell \"Lucky\". End. "
+        "Endwhile. "
+        "The story ends.";
+    std::string expected = compileStory(script);
+
+    std::vector<std::string> results(4);
+    std::vector<std::thread> threads;
+    for (auto& result : results) {
+        threads.emplace_back([&script, &result] {
+            for (int i = 0; i < 20; ++i) {
+                result = compileStory(script);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (const auto& result : results) {
+        EXPECT_EQ(result, expected);
+    }
+}
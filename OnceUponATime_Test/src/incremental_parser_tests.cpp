@@ -0,0 +1,136 @@
+// incremental_parser_tests.cpp
+
+#include "pch.h"
+
+#include "compiler.h"
+#include "incremental_parser.h"
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+const std::string editedScript =
+    "Once upon a time.\n"
+    "The hero has strength of 5 and magic of 2.\n"
+    "Tell \"Hello\".\n"
+    "While strength is greater than 0.\n"
+    "Strength subtract 1 equals strength.\n"
+    "Endwhile.\n"
+    "Tell \"Goodbye\".\n"
+    "The story ends.";
+
+std::string applyEdit(const std::string& text, size_t offset, size_t removed, const std::string& inserted) {
+    return text.substr(0, offset) + inserted + text.substr(offset + removed);
+}
+
+}
+
+TEST(IncrementalParserTest, EditKeepsUntouchedStatementsTest) {
+    IncrementalParser parser(editedScript);
+    ASSERT_EQ(parser.story().statements.size(), 4u);
+    AST::Statement* declaration = parser.story().statements[0];
+    AST::Statement* loop = parser.story().statements[2];
+    AST::Statement* farewell = parser.story().statements[3];
+
+    size_t offset = editedScript.find("Hello");
+    auto result = parser.edit(offset, 5, "Howdy");
+    EXPECT_EQ(result.first, 1u);
+    EXPECT_EQ(result.removed, 1u);
+    EXPECT_EQ(result.inserted, 1u);
+    EXPECT_LT(result.reparsedBytes, editedScript.size());
+
+    ASSERT_EQ(parser.story().statements.size(), 4u);
+    EXPECT_EQ(parser.story().statements[0], declaration);
+    EXPECT_EQ(parser.story().statements[2], loop);
+    EXPECT_EQ(parser.story().statements[3], farewell);
+    EXPECT_EQ(parser.text(), applyEdit(editedScript, offset, 5, "Howdy"));
+}
+
+TEST(IncrementalParserTest, EditsCompileLikeAFullParseTest) {
+    IncrementalParser parser(editedScript);
+    std::string text = editedScript;
+    struct Edit {
+        std::string anchor;
+        size_t removed;
+        std::string inserted;
+    };
+    const Edit edits[] = {
+        {"Tell \"Hello\"", 0, "The hero has wisdom of 3.\n"},
+        {"5 and", 1, "7.5"},
+        {"Endwhile.", 0, "Tell \"Again\".\n"},
+        {"The story ends.", 0, "Tell \"The end\".\n"},
+        {"Tell \"Hello\".\n", 14, ""},
+    };
+    for (const auto& edit : edits) {
+        size_t offset = text.find(edit.anchor);
+        ASSERT_NE(offset, std::string::npos);
+        parser.edit(offset, edit.removed, edit.inserted);
+        text = applyEdit(text, offset, edit.removed, edit.inserted);
+        EXPECT_EQ(parser.text(), text);
+        EXPECT_EQ(compileStory(parser.story()), compileStory(text));
+    }
+}
+
+TEST(IncrementalParserTest, OpenedBlockExtendsTheReparsedRangeTest) {
+    const std::string script =
+        "Once upon a time.\n"
+        "The hero has strength of 5.\n"
+        "Tell \"Hello\".\n"
+        "If hero is brave then\n"
+        "Tell \"Onward\".\n"
+        "End.\n"
+        "Tell \"Goodbye\".\n"
+        "The story ends.";
+    IncrementalParser parser(script);
+    ASSERT_EQ(parser.story().statements.size(), 4u);
+    AST::Statement* farewell = parser.story().statements[3];
+
+    size_t offset = script.find("Tell \"Hello\".");
+    std::string opened = "If hero is tired then\nTell \"Zzz\".\nElse";
+    auto result = parser.edit(offset, 13, opened);
+    EXPECT_EQ(result.first, 1u);
+    EXPECT_EQ(result.removed, 2u);
+    EXPECT_EQ(result.inserted, 1u);
+    ASSERT_EQ(parser.story().statements.size(), 3u);
+    EXPECT_EQ(parser.story().statements[1]->kind, AST::NodeKind::CONDITIONAL);
+    EXPECT_EQ(parser.story().statements[2], farewell);
+    EXPECT_EQ(compileStory(parser.story()), compileStory(applyEdit(script, offset, 13, opened)));
+}
+
+TEST(IncrementalParserTest, FailedEditLeavesStoryUnchangedTest) {
+    IncrementalParser parser(editedScript);
+    AST::Statement* loop = parser.story().statements[2];
+    size_t offset = editedScript.find("Endwhile.");
+    EXPECT_THROW(parser.edit(offset, 9, ""), std::runtime_error);
+    EXPECT_EQ(parser.text(), editedScript);
+    ASSERT_EQ(parser.story().statements.size(), 4u);
+    EXPECT_EQ(parser.story().statements[2], loop);
+    EXPECT_EQ(compileStory(parser.story()), compileStory(editedScript));
+}
+
+TEST(IncrementalParserTest, EditChangesOnlyTheEditedFunctionFingerprintTest) {
+    const std::string script =
+        "Once upon a time.\n"
+        "Define the function Rest as\n"
+        "Tell \"Zzz\".\n"
+        "Endfunction.\n"
+        "Define the function Train as\n"
+        "Tell \"Hup\".\n"
+        "Endfunction.\n"
+        "Call Rest.\n"
+        "The story ends.";
+    IncrementalParser parser(script);
+    ASSERT_EQ(parser.story().statements.size(), 3u);
+    AST::Fingerprint rest = AST::fingerprint(*parser.story().statements[0]);
+    AST::Fingerprint train = AST::fingerprint(*parser.story().statements[1]);
+    AST::Fingerprint story = AST::fingerprint(parser.story());
+
+    parser.edit(script.find("Hup"), 3, "Hop");
+    EXPECT_EQ(AST::fingerprint(*parser.story().statements[0]), rest);
+    EXPECT_NE(AST::fingerprint(*parser.story().statements[1]), train);
+    EXPECT_NE(AST::fingerprint(parser.story()), story);
+
+    parser.edit(script.find("Hup"), 3, "Hup");
+    EXPECT_EQ(AST::fingerprint(*parser.story().statements[1]), train);
+    EXPECT_EQ(AST::fingerprint(parser.story()), story);
+}
@@ -180,10 +180,9 @@ TEST(IntegrationTest, GeneratePpmImageFromRecordFields) {
     std::string generated = codeGen.getGeneratedCode();
 
     EXPECT_NE(generated.find("struct Color"), std::string::npos);
-    EXPECT_NE(generated.find("Color color{};"), std::string::npos);
-    EXPECT_NE(generated.find("color.red = 1;"), std::string::npos);
-    EXPECT_NE(generated.find("fillImage(canvas, color.red, color.green, color.blue);"), std::string::npos);
-    EXPECT_NE(generated.find("paintRectangle(canvas, static_cast<int>(0), static_cast<int>(0), static_cast<int>(1), static_cast<int>(1), color.red, color.green, color.blue);"), std::string::npos);
+    EXPECT_EQ(generated.find("Color color{};"), std::string::npos);
+    EXPECT_NE(generated.find("fillImage(canvas, 1.0, 0.5, 0.25);"), std::string::npos);
+    EXPECT_NE(generated.find("paintRectangle(canvas, static_cast<int>(0), static_cast<int>(0), static_cast<int>(1), static_cast<int>(1), 1.0, 0.5, 0.25);"), std::string::npos);
 
     std::filesystem::path tempDir = std::filesystem::temp_directory_path() / "ouat_record_image_integration_test";
     std::filesystem::create_directories(tempDir);
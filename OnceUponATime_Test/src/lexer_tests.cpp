@@ -65,3 +65,119 @@ TEST(LexerTest, CommaIsSeparatePunctuationTest) {
     EXPECT_EQ(tokens[1].type, TokenType::COMMA);
     EXPECT_EQ(tokens[2].type, TokenType::IDENTIFIER);
 }
+
+TEST(LexerTest, LexemesReferenceSourceBufferTest) {
+    std::string source = "The hero has 3.5 coins and \"a song\".";
+    Lexer lexer(source);
+    auto tokens = lexer.tokenize();
+    ASSERT_GE(tokens.size(), 9);
+    for (const auto& token : tokens) {
+        EXPECT_GE(token.lexeme.data(), source.data());
+        EXPECT_LE(token.lexeme.data() + token.lexeme.size(), source.data() + source.size());
+    }
+    EXPECT_EQ(tokens[3].lexeme, "3.5");
+    EXPECT_EQ(tokens[6].lexeme, "a song");
+    EXPECT_EQ(tokens[6].lexeme.data(), source.data() + 28);
+}
+
+TEST(LexerTest, KeywordRecognitionIsCaseInsensitiveTest) {
+    std::string source = "ENDFUNCTION Remark: NOTE: comment: While ifs remark endfunctions";
+    Lexer lexer(source);
+    auto tokens = lexer.tokenize();
+    ASSERT_GE(tokens.size(), 9);
+    EXPECT_EQ(tokens[0].type, TokenType::KW_ENDFUNCTION);
+    EXPECT_EQ(tokens[1].type, TokenType::KW_REMARK);
+    EXPECT_EQ(tokens[2].type, TokenType::KW_NOTE);
+    EXPECT_EQ(tokens[3].type, TokenType::KW_COMMENT);
+    EXPECT_EQ(tokens[4].type, TokenType::KW_WHILE);
+    EXPECT_EQ(tokens[5].type, TokenType::IDENTIFIER);
+    EXPECT_EQ(tokens[6].type, TokenType::IDENTIFIER);
+    EXPECT_EQ(tokens[7].type, TokenType::IDENTIFIER);
+    EXPECT_EQ(tokens[1].lexeme, "Remark:");
+}
+
+TEST(LexerTest, LongWhitespaceAndCommentRunsTrackPositionsTest) {
+    std::string source = std::string(40, ' ') + "hero\n\n\t" + std::string(33, ' ') +
+                         "# a comment that is longer than one scanning block\n" +
+                         "   extraordinarily_long_identifier_name_spanning_blocks.";
+    Lexer lexer(source);
+    auto tokens = lexer.tokenize();
+    ASSERT_EQ(tokens.size(), 4);
+    EXPECT_EQ(tokens[0].lexeme, "hero");
+    EXPECT_EQ(tokens[0].line, 1);
+    EXPECT_EQ(tokens[0].column, 41);
+    EXPECT_EQ(tokens[1].lexeme, "extraordinarily_long_identifier_name_spanning_blocks");
+    EXPECT_EQ(tokens[1].line, 4);
+    EXPECT_EQ(tokens[1].column, 4);
+    EXPECT_EQ(tokens[2].type, TokenType::PERIOD);
+    EXPECT_EQ(tokens[2].column, 56);
+}
+
+TEST(LexerTest, ParallelTokenizationMatchesSerialTest) {
+    std::string source = "Once upon a time. ";
+    for (int i = 0; i < 50; ++i) {
+        source += "x is 0.72. Remark: \"a.\n b.\" is said.\n# not. a. sentence.\n  y is \"es\\\"caped. \". ";
+    }
+    source += "The story ends.";
+    auto serial = Lexer(source).tokenize();
+    auto parallel = Lexer(source).tokenizeParallel(16);
+    ASSERT_EQ(parallel.size(), serial.size());
+    for (size_t i = 0; i < serial.size(); ++i) {
+        EXPECT_EQ(parallel.type(i), serial[i].type);
+        EXPECT_EQ(parallel.lexeme(i).data(), serial[i].lexeme.data());
+        EXPECT_EQ(parallel.lexeme(i).size(), serial[i].lexeme.size());
+        EXPECT_EQ(parallel.line(i), serial[i].line);
+        EXPECT_EQ(parallel.column(i), serial[i].column);
+        EXPECT_EQ(parallel.word(i), serial[i].word);
+    }
+}
+
+TEST(LexerTest, ParallelTokenizationReportsFirstErrorTest) {
+    std::string source;
+    for (int i = 0; i < 20; ++i) {
+        source += "x is 1.\n";
+    }
+    source += "y is @.\n z is $.";
+    std::string serialError;
+    try {
+        Lexer(source).tokenize();
+    } catch (const std::runtime_error& e) {
+        serialError = e.what();
+    }
+    try {
+        Lexer(source).tokenizeParallel(8);
+        FAIL() << "Expected std::runtime_error";
+    } catch (const std::runtime_error& e) {
+        EXPECT_EQ(std::string(e.what()), serialError);
+    }
+}
+
+TEST(LexerTest, WordsCarryFoldedSymbolIdsTest) {
+    std::string source = "The HERO met the hero. \"hero\" 3";
+    Lexer lexer(source);
+    auto tokens = lexer.tokenize();
+    ASSERT_EQ(tokens.size(), 9);
+    EXPECT_EQ(tokens[0].word, tokens[3].word);
+    EXPECT_EQ(tokens[1].word, tokens[4].word);
+    EXPECT_NE(tokens[0].word, tokens[1].word);
+    EXPECT_EQ(lexer.interner().text(tokens[1].word), "hero");
+    EXPECT_EQ(tokens[5].word, noSymbol);
+    EXPECT_EQ(tokens[6].word, noSymbol);
+    EXPECT_EQ(tokens[7].word, noSymbol);
+}
+
+TEST(LexerTest, NumbersCarryParsedValuesTest) {
+    std::string source = "42 0.72 9223372036854775807 99999999999999999999";
+    Lexer lexer(source);
+    auto tokens = lexer.tokenize();
+    ASSERT_EQ(tokens.size(), 5);
+    EXPECT_TRUE(tokens[0].integral);
+    EXPECT_EQ(tokens[0].integer, 42);
+    EXPECT_DOUBLE_EQ(tokens[0].real, 42.0);
+    EXPECT_FALSE(tokens[1].integral);
+    EXPECT_DOUBLE_EQ(tokens[1].real, 0.72);
+    EXPECT_TRUE(tokens[2].integral);
+    EXPECT_EQ(tokens[2].integer, INT64_MAX);
+    EXPECT_FALSE(tokens[3].integral);
+    EXPECT_DOUBLE_EQ(tokens[3].real, 1e20);
+}
@@ -26,7 +26,7 @@ TEST(ParserTest, NarrativeSentenceTest) {
     std::string script = "Once upon a time. The knight fought bravely. The story ends.";
     auto story = parseScript(script);
     ASSERT_NE(story, nullptr);
-    auto narrative = dynamic_cast<AST::NarrativeStatement*>(story->statements[0].get());
+    auto narrative = dynamic_cast<AST::NarrativeStatement*>(story->statements[0]);
     ASSERT_NE(narrative, nullptr);
     EXPECT_NE(narrative->text.find("The knight fought bravely"), std::string::npos);
 }
@@ -35,7 +35,7 @@ TEST(ParserTest, ConditionalStatementTest) {
     std::string script = "Once upon a time. If hero is brave then The hero wins. End. The story ends.";
     auto story = parseScript(script);
     ASSERT_NE(story, nullptr);
-    auto conditional = dynamic_cast<AST::ConditionalStatement*>(story->statements[0].get());
+    auto conditional = dynamic_cast<AST::ConditionalStatement*>(story->statements[0]);
     ASSERT_NE(conditional, nullptr);
     EXPECT_EQ(conditional->condition, "hero is brave");
     EXPECT_GE(conditional->thenBranch.size(), 1);
@@ -45,7 +45,7 @@ TEST(ParserTest, InteractiveStatementTest) {
     std::string script = "Once upon a time. Choose your next action carefully. The story ends.";
     auto story = parseScript(script);
     ASSERT_NE(story, nullptr);
-    auto interactive = dynamic_cast<AST::InteractiveStatement*>(story->statements[0].get());
+    auto interactive = dynamic_cast<AST::InteractiveStatement*>(story->statements[0]);
     ASSERT_NE(interactive, nullptr);
     EXPECT_EQ(interactive->prompt, "your next action carefully");
 }
@@ -54,7 +54,7 @@ TEST(ParserTest, RandomStatementTest) {
     std::string script = "Once upon a time. Random dragon leans towards friendly or hostile. The story ends.";
     auto story = parseScript(script);
     ASSERT_NE(story, nullptr);
-    auto random = dynamic_cast<AST::RandomStatement*>(story->statements[0].get());
+    auto random = dynamic_cast<AST::RandomStatement*>(story->statements[0]);
     ASSERT_NE(random, nullptr);
     EXPECT_EQ(random->subject, "dragon");
     EXPECT_EQ(random->randomStates.first, "friendly");
@@ -65,7 +65,7 @@ TEST(ParserTest, WhileStatementTest) {
     std::string script = "Once upon a time. While dragon is awake. Hero trembles. Endwhile. The story ends.";
     auto story = parseScript(script);
     ASSERT_NE(story, nullptr);
-    auto whileStmt = dynamic_cast<AST::WhileStatement*>(story->statements[0].get());
+    auto whileStmt = dynamic_cast<AST::WhileStatement*>(story->statements[0]);
     ASSERT_NE(whileStmt, nullptr);
     EXPECT_EQ(whileStmt->condition, "dragon is awake");
     EXPECT_GE(whileStmt->body.size(), 1);
@@ -75,7 +75,7 @@ TEST(ParserTest, ForEachStatementTest) {
     std::string script = "Once upon a time. For each knight in round table do Knight stands. Endfor. The story ends.";
     auto story = parseScript(script);
     ASSERT_NE(story, nullptr);
-    auto forEach = dynamic_cast<AST::ForEachStatement*>(story->statements[0].get());
+    auto forEach = dynamic_cast<AST::ForEachStatement*>(story->statements[0]);
     ASSERT_NE(forEach, nullptr);
     EXPECT_EQ(forEach->iterator, "knight");
     EXPECT_EQ(forEach->collection, "round table");
@@ -86,7 +86,7 @@ TEST(ParserTest, ForRangeStatementTest) {
     std::string script = "Once upon a time. For each y from 0 to height do Tell \"row\". Endfor. The story ends.";
     auto story = parseScript(script);
     ASSERT_NE(story, nullptr);
-    auto forRange = dynamic_cast<AST::ForRangeStatement*>(story->statements[0].get());
+    auto forRange = dynamic_cast<AST::ForRangeStatement*>(story->statements[0]);
     ASSERT_NE(forRange, nullptr);
     EXPECT_EQ(forRange->iterator, "y");
     EXPECT_EQ(forRange->start, "0");
@@ -98,7 +98,7 @@ TEST(ParserTest, FunctionDeclarationTest) {
     std::string script = "Once upon a time. Define the function healHero as Hero recovers health. Endfunction. The story ends.";
     auto story = parseScript(script);
     ASSERT_NE(story, nullptr);
-    auto funcDecl = dynamic_cast<AST::FunctionDeclaration*>(story->statements[0].get());
+    auto funcDecl = dynamic_cast<AST::FunctionDeclaration*>(story->statements[0]);
     ASSERT_NE(funcDecl, nullptr);
     EXPECT_EQ(funcDecl->name, "healHero");
     EXPECT_GE(funcDecl->body.size(), 1);
@@ -108,7 +108,7 @@ TEST(ParserTest, FunctionCallTest) {
     std::string script = "Once upon a time. Call healHero. The story ends.";
     auto story = parseScript(script);
     ASSERT_NE(story, nullptr);
-    auto funcCall = dynamic_cast<AST::FunctionCall*>(story->statements[0].get());
+    auto funcCall = dynamic_cast<AST::FunctionCall*>(story->statements[0]);
     ASSERT_NE(funcCall, nullptr);
     EXPECT_EQ(funcCall->name, "healHero");
 }
@@ -117,7 +117,7 @@ TEST(ParserTest, VariableDeclarationTest) {
     std::string script = "Once upon a time. The hero has strength of 10. The story ends.";
     auto story = parseScript(script);
     ASSERT_NE(story, nullptr);
-    auto varBlock = dynamic_cast<AST::VariableDeclarationBlock*>(story->statements[0].get());
+    auto varBlock = dynamic_cast<AST::VariableDeclarationBlock*>(story->statements[0]);
     ASSERT_NE(varBlock, nullptr);
     EXPECT_GE(varBlock->declarations.size(), 1);
     EXPECT_EQ(varBlock->declarations[0]->owner, "The hero");
@@ -129,12 +129,21 @@ TEST(ParserTest, ArithmeticStatementTest) {
     std::string script = "Once upon a time. Magic subtract 1 equals magic. The story ends.";
     auto story = parseScript(script);
     ASSERT_NE(story, nullptr);
-    auto arithmetic = dynamic_cast<AST::ArithmeticStatement*>(story->statements[0].get());
+    auto arithmetic = dynamic_cast<AST::ArithmeticStatement*>(story->statements[0]);
     ASSERT_NE(arithmetic, nullptr);
-    EXPECT_EQ(arithmetic->left, "Magic");
+    EXPECT_EQ(arithmetic->left.text, "Magic");
     EXPECT_EQ(arithmetic->operation, "subtract");
-    EXPECT_EQ(arithmetic->right, "1");
-    EXPECT_EQ(arithmetic->target, "magic");
+    EXPECT_EQ(arithmetic->right.text, "1");
+    EXPECT_EQ(arithmetic->target.text, "magic");
+}
+
+TEST(ParserTest, ArithmeticOperatorIsCaseInsensitiveTest) {
+    std::string script = "Once upon a time. Magic MULTIPLY 2 equals magic. The story ends.";
+    auto story = parseScript(script);
+    ASSERT_NE(story, nullptr);
+    auto arithmetic = dynamic_cast<AST::ArithmeticStatement*>(story->statements[0]);
+    ASSERT_NE(arithmetic, nullptr);
+    EXPECT_EQ(arithmetic->operation, "multiply");
 }
 
 TEST(ParserTest, RecordDeclarationAndInstanceTest) {
@@ -147,20 +156,20 @@ TEST(ParserTest, RecordDeclarationAndInstanceTest) {
     ASSERT_NE(story, nullptr);
     ASSERT_EQ(story->statements.size(), 2);
 
-    auto record = dynamic_cast<AST::RecordDeclaration*>(story->statements[0].get());
+    auto record = dynamic_cast<AST::RecordDeclaration*>(story->statements[0]);
     ASSERT_NE(record, nullptr);
     EXPECT_EQ(record->name, "Vec3");
     ASSERT_EQ(record->fields.size(), 3);
     EXPECT_EQ(record->fields[0].first, "x");
     EXPECT_EQ(record->fields[0].second, "number");
 
-    auto instance = dynamic_cast<AST::RecordInstanceDeclaration*>(story->statements[1].get());
+    auto instance = dynamic_cast<AST::RecordInstanceDeclaration*>(story->statements[1]);
     ASSERT_NE(instance, nullptr);
     EXPECT_EQ(instance->name, "The color");
     EXPECT_EQ(instance->typeName, "Vec3");
     ASSERT_EQ(instance->fieldValues.size(), 3);
     EXPECT_EQ(instance->fieldValues[1].first, "y");
-    EXPECT_EQ(instance->fieldValues[1].second, "0.5");
+    EXPECT_EQ(instance->fieldValues[1].second.text, "0.5");
 }
 
 TEST(ParserTest, ImageStatementsTest) {
@@ -176,38 +185,38 @@ TEST(ParserTest, ImageStatementsTest) {
     ASSERT_NE(story, nullptr);
     ASSERT_EQ(story->statements.size(), 5);
 
-    auto imageDecl = dynamic_cast<AST::ImageDeclaration*>(story->statements[0].get());
+    auto imageDecl = dynamic_cast<AST::ImageDeclaration*>(story->statements[0]);
     ASSERT_NE(imageDecl, nullptr);
     EXPECT_EQ(imageDecl->name, "canvas");
-    EXPECT_EQ(imageDecl->width, "image width");
-    EXPECT_EQ(imageDecl->height, "image height");
+    EXPECT_EQ(imageDecl->width.text, "image width");
+    EXPECT_EQ(imageDecl->height.text, "image height");
 
-    auto imageFill = dynamic_cast<AST::ImageFillStatement*>(story->statements[1].get());
+    auto imageFill = dynamic_cast<AST::ImageFillStatement*>(story->statements[1]);
     ASSERT_NE(imageFill, nullptr);
     EXPECT_EQ(imageFill->imageName, "canvas");
-    EXPECT_EQ(imageFill->red, "back wall red");
-    EXPECT_EQ(imageFill->green, "back wall green");
-    EXPECT_EQ(imageFill->blue, "back wall blue");
+    EXPECT_EQ(imageFill->red.text, "back wall red");
+    EXPECT_EQ(imageFill->green.text, "back wall green");
+    EXPECT_EQ(imageFill->blue.text, "back wall blue");
 
-    auto rectanglePaint = dynamic_cast<AST::RectanglePaintStatement*>(story->statements[2].get());
+    auto rectanglePaint = dynamic_cast<AST::RectanglePaintStatement*>(story->statements[2]);
     ASSERT_NE(rectanglePaint, nullptr);
     EXPECT_EQ(rectanglePaint->imageName, "canvas");
-    EXPECT_EQ(rectanglePaint->left, "0");
-    EXPECT_EQ(rectanglePaint->bottom, "0");
-    EXPECT_EQ(rectanglePaint->right, "4");
-    EXPECT_EQ(rectanglePaint->top, "4");
-    EXPECT_EQ(rectanglePaint->red, "left wall red");
+    EXPECT_EQ(rectanglePaint->left.text, "0");
+    EXPECT_EQ(rectanglePaint->bottom.text, "0");
+    EXPECT_EQ(rectanglePaint->right.text, "4");
+    EXPECT_EQ(rectanglePaint->top.text, "4");
+    EXPECT_EQ(rectanglePaint->red.text, "left wall red");
 
-    auto pixelWrite = dynamic_cast<AST::PixelWriteStatement*>(story->statements[3].get());
+    auto pixelWrite = dynamic_cast<AST::PixelWriteStatement*>(story->statements[3]);
     ASSERT_NE(pixelWrite, nullptr);
     EXPECT_EQ(pixelWrite->imageName, "canvas");
-    EXPECT_EQ(pixelWrite->x, "x");
-    EXPECT_EQ(pixelWrite->y, "y");
-    EXPECT_EQ(pixelWrite->red, "color x");
-    EXPECT_EQ(pixelWrite->green, "color y");
-    EXPECT_EQ(pixelWrite->blue, "color z");
+    EXPECT_EQ(pixelWrite->x.text, "x");
+    EXPECT_EQ(pixelWrite->y.text, "y");
+    EXPECT_EQ(pixelWrite->red.text, "color x");
+    EXPECT_EQ(pixelWrite->green.text, "color y");
+    EXPECT_EQ(pixelWrite->blue.text, "color z");
 
-    auto imageSave = dynamic_cast<AST::ImageSaveStatement*>(story->statements[4].get());
+    auto imageSave = dynamic_cast<AST::ImageSaveStatement*>(story->statements[4]);
     ASSERT_NE(imageSave, nullptr);
     EXPECT_EQ(imageSave->imageName, "canvas");
     EXPECT_EQ(imageSave->outputPath, "output/gradient.ppm");
@@ -217,7 +226,7 @@ TEST(ParserTest, CollectionDeclarationTest) {
     std::string script = "Once upon a time. The hero has companions of [\"Alice\", \"Bob\", \"Charlie\"]. The story ends.";
     auto story = parseScript(script);
     ASSERT_NE(story, nullptr);
-    auto varBlock = dynamic_cast<AST::VariableDeclarationBlock*>(story->statements[0].get());
+    auto varBlock = dynamic_cast<AST::VariableDeclarationBlock*>(story->statements[0]);
     ASSERT_NE(varBlock, nullptr);
     ASSERT_EQ(varBlock->declarations.size(), 1);
     EXPECT_EQ(varBlock->declarations[0]->owner, "The hero");
@@ -232,8 +241,8 @@ TEST(ParserTest, DisplayAndNarrateStatementsTest) {
     auto story = parseScript(script);
     ASSERT_NE(story, nullptr);
     ASSERT_EQ(story->statements.size(), 2);
-    auto display = dynamic_cast<AST::TellStatement*>(story->statements[0].get());
-    auto narrate = dynamic_cast<AST::TellStatement*>(story->statements[1].get());
+    auto display = dynamic_cast<AST::TellStatement*>(story->statements[0]);
+    auto narrate = dynamic_cast<AST::TellStatement*>(story->statements[1]);
     ASSERT_NE(display, nullptr);
     ASSERT_NE(narrate, nullptr);
     EXPECT_EQ(display->message, "Hello");
@@ -244,10 +253,10 @@ TEST(ParserTest, ElseIfUsesSingleEndifTest) {
     std::string script = "Once upon a time. If dragon is awake then Tell \"Careful\". Else if dragon is friendly then Tell \"Wave\". Endif. The story ends.";
     auto story = parseScript(script);
     ASSERT_NE(story, nullptr);
-    auto conditional = dynamic_cast<AST::ConditionalStatement*>(story->statements[0].get());
+    auto conditional = dynamic_cast<AST::ConditionalStatement*>(story->statements[0]);
     ASSERT_NE(conditional, nullptr);
     ASSERT_EQ(conditional->elseBranch.size(), 1);
-    auto elseIf = dynamic_cast<AST::ConditionalStatement*>(conditional->elseBranch[0].get());
+    auto elseIf = dynamic_cast<AST::ConditionalStatement*>(conditional->elseBranch[0]);
     ASSERT_NE(elseIf, nullptr);
     EXPECT_EQ(elseIf->condition, "dragon is friendly");
 }
@@ -256,16 +265,16 @@ TEST(ParserTest, WhileStatementMultipleBodyTest) {
     std::string script = "Once upon a time. While dragon is awake. Hero trembles. Knight prepares. Wizard casts spell. Endwhile. The story ends.";
     auto story = parseScript(script);
     ASSERT_NE(story, nullptr);
-    auto whileStmt = dynamic_cast<AST::WhileStatement*>(story->statements[0].get());
+    auto whileStmt = dynamic_cast<AST::WhileStatement*>(story->statements[0]);
     ASSERT_NE(whileStmt, nullptr);
     EXPECT_EQ(whileStmt->condition, "dragon is awake");
     EXPECT_EQ(whileStmt->body.size(), 3);
     
-    auto narrative1 = dynamic_cast<AST::NarrativeStatement*>(whileStmt->body[0].get());
+    auto narrative1 = dynamic_cast<AST::NarrativeStatement*>(whileStmt->body[0]);
     ASSERT_NE(narrative1, nullptr);
     EXPECT_EQ(narrative1->text, "Hero trembles");
     
-    auto narrative2 = dynamic_cast<AST::NarrativeStatement*>(whileStmt->body[1].get());
+    auto narrative2 = dynamic_cast<AST::NarrativeStatement*>(whileStmt->body[1]);
     ASSERT_NE(narrative2, nullptr);
     EXPECT_EQ(narrative2->text, "Knight prepares");
 }
@@ -274,12 +283,12 @@ TEST(ParserTest, NestedWhileStatementTest) {
     std::string script = "Once upon a time. While dragon is awake. While hero is brave. Hero fights. Endwhile. Endwhile. The story ends.";
     auto story = parseScript(script);
     ASSERT_NE(story, nullptr);
-    auto outerWhile = dynamic_cast<AST::WhileStatement*>(story->statements[0].get());
+    auto outerWhile = dynamic_cast<AST::WhileStatement*>(story->statements[0]);
     ASSERT_NE(outerWhile, nullptr);
     EXPECT_EQ(outerWhile->condition, "dragon is awake");
     EXPECT_EQ(outerWhile->body.size(), 1);
     
-    auto innerWhile = dynamic_cast<AST::WhileStatement*>(outerWhile->body[0].get());
+    auto innerWhile = dynamic_cast<AST::WhileStatement*>(outerWhile->body[0]);
     ASSERT_NE(innerWhile, nullptr);
     EXPECT_EQ(innerWhile->condition, "hero is brave");
     EXPECT_EQ(innerWhile->body.size(), 1);
@@ -289,17 +298,17 @@ TEST(ParserTest, ForEachStatementMultipleBodyTest) {
     std::string script = "Once upon a time. For each knight in round table do Knight stands. Knight bows. Knight sits. Endfor. The story ends.";
     auto story = parseScript(script);
     ASSERT_NE(story, nullptr);
-    auto forEach = dynamic_cast<AST::ForEachStatement*>(story->statements[0].get());
+    auto forEach = dynamic_cast<AST::ForEachStatement*>(story->statements[0]);
     ASSERT_NE(forEach, nullptr);
     EXPECT_EQ(forEach->iterator, "knight");
     EXPECT_EQ(forEach->collection, "round table");
     EXPECT_EQ(forEach->body.size(), 3); 
     
-    auto narrative1 = dynamic_cast<AST::NarrativeStatement*>(forEach->body[0].get());
+    auto narrative1 = dynamic_cast<AST::NarrativeStatement*>(forEach->body[0]);
     ASSERT_NE(narrative1, nullptr);
     EXPECT_EQ(narrative1->text, "Knight stands");
     
-    auto narrative2 = dynamic_cast<AST::NarrativeStatement*>(forEach->body[1].get());
+    auto narrative2 = dynamic_cast<AST::NarrativeStatement*>(forEach->body[1]);
     ASSERT_NE(narrative2, nullptr);
     EXPECT_EQ(narrative2->text, "Knight bows");
 }
@@ -308,13 +317,13 @@ TEST(ParserTest, NestedForEachStatementTest) {
     std::string script = "Once upon a time. For each castle in kingdom do For each room in castle do Room is cleaned. Endfor. Endfor. The story ends.";
     auto story = parseScript(script);
     ASSERT_NE(story, nullptr);
-    auto outerForEach = dynamic_cast<AST::ForEachStatement*>(story->statements[0].get());
+    auto outerForEach = dynamic_cast<AST::ForEachStatement*>(story->statements[0]);
     ASSERT_NE(outerForEach, nullptr);
     EXPECT_EQ(outerForEach->iterator, "castle");
     EXPECT_EQ(outerForEach->collection, "kingdom");
     EXPECT_EQ(outerForEach->body.size(), 1);
     
-    auto innerForEach = dynamic_cast<AST::ForEachStatement*>(outerForEach->body[0].get());
+    auto innerForEach = dynamic_cast<AST::ForEachStatement*>(outerForEach->body[0]);
     ASSERT_NE(innerForEach, nullptr);
     EXPECT_EQ(innerForEach->iterator, "room");
     EXPECT_EQ(innerForEach->collection, "castle");
@@ -325,13 +334,13 @@ TEST(ParserTest, ForEachWithConditionalTest) {
     std::string script = "Once upon a time. For each knight in round table do If knight is brave then Knight fights. End. Endfor. The story ends.";
     auto story = parseScript(script);
     ASSERT_NE(story, nullptr);
-    auto forEach = dynamic_cast<AST::ForEachStatement*>(story->statements[0].get());
+    auto forEach = dynamic_cast<AST::ForEachStatement*>(story->statements[0]);
     ASSERT_NE(forEach, nullptr);
     EXPECT_EQ(forEach->iterator, "knight");
     EXPECT_EQ(forEach->collection, "round table");
     EXPECT_EQ(forEach->body.size(), 1);
     
-    auto conditional = dynamic_cast<AST::ConditionalStatement*>(forEach->body[0].get());
+    auto conditional = dynamic_cast<AST::ConditionalStatement*>(forEach->body[0]);
     ASSERT_NE(conditional, nullptr);
     EXPECT_EQ(conditional->condition, "knight is brave");
     EXPECT_EQ(conditional->thenBranch.size(), 1);
@@ -341,13 +350,101 @@ TEST(ParserTest, WhileWithConditionalTest) {
     std::string script = "Once upon a time. While dragon is awake. If hero is brave then Hero fights. End. Endwhile. The story ends.";
     auto story = parseScript(script);
     ASSERT_NE(story, nullptr);
-    auto whileStmt = dynamic_cast<AST::WhileStatement*>(story->statements[0].get());
+    auto whileStmt = dynamic_cast<AST::WhileStatement*>(story->statements[0]);
     ASSERT_NE(whileStmt, nullptr);
     EXPECT_EQ(whileStmt->condition, "dragon is awake");
     EXPECT_EQ(whileStmt->body.size(), 1);
     
-    auto conditional = dynamic_cast<AST::ConditionalStatement*>(whileStmt->body[0].get());
+    auto conditional = dynamic_cast<AST::ConditionalStatement*>(whileStmt->body[0]);
     ASSERT_NE(conditional, nullptr);
     EXPECT_EQ(conditional->condition, "hero is brave");
     EXPECT_EQ(conditional->thenBranch.size(), 1);
 }
+
+TEST(ParserTest, SentenceClassificationTest) {
+    std::string script = "Once upon a time. "
+                         "Paint rectangle on canvas from 0, 0 to 4, 4 with 255, 0, 0. "
+                         "Paint canvas at 1, 2 with 0, 0, 255. "
+                         "Hero is a Knight with strength 5. "
+                         "Hero is ready with. "
+                         "Choose \"Left or right?\". "
+                         "The story ends.";
+    auto story = parseScript(script);
+    ASSERT_NE(story, nullptr);
+    ASSERT_EQ(story->statements.size(), 5);
+    EXPECT_NE(dynamic_cast<AST::RectanglePaintStatement*>(story->statements[0]), nullptr);
+    EXPECT_NE(dynamic_cast<AST::PixelWriteStatement*>(story->statements[1]), nullptr);
+    EXPECT_NE(dynamic_cast<AST::RecordInstanceDeclaration*>(story->statements[2]), nullptr);
+    EXPECT_EQ(dynamic_cast<AST::RecordInstanceDeclaration*>(story->statements[3]), nullptr);
+    auto interactive = dynamic_cast<AST::InteractiveStatement*>(story->statements[4]);
+    ASSERT_NE(interactive, nullptr);
+    EXPECT_EQ(interactive->prompt, "Left or right?");
+}
+
+TEST(ParserTest, ConditionStructureTest) {
+    std::string script = "Once upon a time. "
+                         "If the hero strength is at least 10 then Hero wins. End. "
+                         "If door is not \"locked up\" then Door opens. End. "
+                         "If sun shines then Day begins. End. "
+                         "While gold equals 3. Hero counts. Endwhile. "
+                         "The story ends.";
+    auto story = parseScript(script);
+    ASSERT_NE(story, nullptr);
+    ASSERT_EQ(story->statements.size(), 4);
+
+    auto atLeast = dynamic_cast<AST::ConditionalStatement*>(story->statements[0]);
+    ASSERT_NE(atLeast, nullptr);
+    EXPECT_EQ(atLeast->test.kind, AST::Condition::Kind::COMPARISON);
+    EXPECT_EQ(atLeast->test.op, AST::ComparisonOperator::AT_LEAST);
+    EXPECT_EQ(atLeast->test.left.text, "the hero strength");
+    EXPECT_EQ(atLeast->test.left.kind, AST::Operand::Kind::NAME);
+    EXPECT_EQ(atLeast->test.right.text, "10");
+    EXPECT_EQ(atLeast->test.right.kind, AST::Operand::Kind::NUMBER);
+
+    auto notEqual = dynamic_cast<AST::ConditionalStatement*>(story->statements[1]);
+    ASSERT_NE(notEqual, nullptr);
+    EXPECT_EQ(notEqual->test.op, AST::ComparisonOperator::NOT_EQUAL);
+    EXPECT_EQ(notEqual->test.right.text, "locked up");
+    EXPECT_EQ(notEqual->test.right.kind, AST::Operand::Kind::TEXT);
+
+    auto flag = dynamic_cast<AST::ConditionalStatement*>(story->statements[2]);
+    ASSERT_NE(flag, nullptr);
+    EXPECT_EQ(flag->test.kind, AST::Condition::Kind::FLAG);
+    EXPECT_EQ(flag->test.left.text, "sun shines");
+
+    auto whileStmt = dynamic_cast<AST::WhileStatement*>(story->statements[3]);
+    ASSERT_NE(whileStmt, nullptr);
+    EXPECT_EQ(whileStmt->test.op, AST::ComparisonOperator::EQUAL);
+    EXPECT_EQ(whileStmt->test.left.text, "gold");
+    EXPECT_EQ(whileStmt->test.right.kind, AST::Operand::Kind::NUMBER);
+}
+
+TEST(ParserTest, DeeplyNestedBlocksTest) {
+    const int depth = 100000;
+    std::string script = "Once upon a time. ";
+    for (int i = 0; i < depth; ++i) {
+        script += i % 2 == 0 ? "If door is open then " : "While hero is awake. ";
+    }
+    script += "Hero sleeps. ";
+    for (int i = depth - 1; i >= 0; --i) {
+        script += i % 2 == 0 ? "Else Hero waits. End. " : "Endwhile. ";
+    }
+    script += "The story ends.";
+
+    auto story = parseScript(script);
+    ASSERT_EQ(story->statements.size(), 1);
+    AST::Statement* statement = story->statements[0];
+    for (int i = 0; i < depth; ++i) {
+        if (auto conditional = AST::as<AST::ConditionalStatement>(statement)) {
+            ASSERT_EQ(conditional->thenBranch.size(), 1);
+            ASSERT_EQ(conditional->elseBranch.size(), 1);
+            statement = conditional->thenBranch[0];
+        } else {
+            auto loop = AST::as<AST::WhileStatement>(statement);
+            ASSERT_NE(loop, nullptr);
+            ASSERT_EQ(loop->body.size(), 1);
+            statement = loop->body[0];
+        }
+    }
+    EXPECT_EQ(statement->kind, AST::NodeKind::NARRATIVE);
+}
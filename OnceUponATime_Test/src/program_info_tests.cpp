@@ -0,0 +1,68 @@
+// program_info_tests.cpp
+
+#include "pch.h"
+
+#include "lexer.h"
+#include "parser.h"
+#include "program_info.h"
+#include <string>
+
+static ProgramInfo analyzeScript(const std::string& script, std::unique_ptr<AST::Story>& story) {
+    Lexer lexer(script);
+    Parser parser(lexer.tokenize());
+    story = parser.parseStory();
+    ProgramAnalyzer analyzer;
+    for (auto& stmt : story->statements) {
+        analyzer.analyze(*stmt);
+    }
+    return analyzer.finish();
+}
+
+TEST(ProgramInfoTest, GathersStructureInOnePassTest) {
+    std::unique_ptr<AST::Story> story;
+    ProgramInfo info = analyzeScript(
+        "Once upon a time. "
+        "Define the record Vec with x number. "
+        "Define the function Paint as "
+        "Create image canvas with width 2 and height 2. "
+        "Endfunction. "
+        "For each knight in round table do Knight bows. Endfor. "
+        "The hero has strength of 5. "
+        "The story ends.",
+        story);
+
+    ASSERT_EQ(info.records.size(), 1);
+    EXPECT_EQ(info.records[0]->name, "Vec");
+    ASSERT_EQ(info.functions.size(), 1);
+    EXPECT_EQ(info.functions[0]->name, "Paint");
+    EXPECT_TRUE(info.usesImages);
+    EXPECT_EQ(info.collections.count("round table"), 1);
+
+    ASSERT_EQ(info.declarations.size(), 2);
+    EXPECT_EQ(info.declarations[0].kind, ProgramInfo::Declaration::Kind::RECORD_TYPE);
+    EXPECT_EQ(info.declarations[1].kind, ProgramInfo::Declaration::Kind::VARIABLE);
+    EXPECT_EQ(info.declarations[1].owner, "The hero");
+    EXPECT_EQ(info.declarations[1].name, "strength");
+    EXPECT_TRUE(info.declarations[1].numeric);
+}
+
+TEST(ProgramInfoTest, ReportsStatementsTheInfoPointsIntoTest) {
+    AST::Arena arena;
+    ProgramAnalyzer analyzer;
+    auto narrative = arena.make<AST::NarrativeStatement>("The hero sleeps");
+    auto function = arena.make<AST::FunctionDeclaration>("Rest");
+    function->body.push_back(arena, narrative);
+    auto loop = arena.make<AST::WhileStatement>("hero is tired",
+        AST::Condition({"hero"}, AST::ComparisonOperator::EQUAL, {"tired"}));
+    loop->body.push_back(arena, arena.make<AST::ArithmeticStatement>("naps", "add", "1", "naps"));
+
+    EXPECT_FALSE(analyzer.analyze(*narrative));
+    EXPECT_TRUE(analyzer.analyze(*function));
+    EXPECT_FALSE(analyzer.analyze(*loop));
+
+    ProgramInfo info = analyzer.finish();
+    ASSERT_EQ(info.declarations.size(), 1);
+    EXPECT_EQ(info.declarations[0].kind, ProgramInfo::Declaration::Kind::ARITHMETIC_TARGET);
+    EXPECT_EQ(info.declarations[0].owner, "naps");
+    EXPECT_FALSE(info.usesImages);
+}
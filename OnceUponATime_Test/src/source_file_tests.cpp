@@ -0,0 +1,46 @@
+// source_file_tests.cpp
+
+#include "pch.h"
+
+#include "source_file.h"
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+namespace {
+
+std::filesystem::path writeTemporaryScript(const std::string& name, const std::string& content) {
+    auto path = std::filesystem::temp_directory_path() / name;
+    std::ofstream output(path, std::ios::binary);
+    output << content;
+    return path;
+}
+
+}
+
+TEST(SourceFileTest, RegularFileIsMappedTest) {
+    std::string script = "Once upon a time, x is 1. The story ends.\n";
+    auto path = writeTemporaryScript("ouat_source_file_mapped.txt", script);
+    {
+        SourceFile source(path);
+        EXPECT_TRUE(source.isMapped());
+        EXPECT_EQ(source.text(), script);
+    }
+    std::filesystem::remove(path);
+}
+
+TEST(SourceFileTest, EmptyFileFallsBackToBufferTest) {
+    auto path = writeTemporaryScript("ouat_source_file_empty.txt", "");
+    {
+        SourceFile source(path);
+        EXPECT_FALSE(source.isMapped());
+        EXPECT_TRUE(source.text().empty());
+    }
+    std::filesystem::remove(path);
+}
+
+TEST(SourceFileTest, MissingFileThrowsTest) {
+    auto path = std::filesystem::temp_directory_path() / "ouat_source_file_missing.txt";
+    std::filesystem::remove(path);
+    EXPECT_THROW(SourceFile source(path), std::runtime_error);
+}
@@ -0,0 +1,117 @@
+// story_cache_tests.cpp
+
+#include "pch.h"
+
+#include "compiler.h"
+#include "story_cache.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+namespace {
+
+const std::string cachedScript =
+    "Once upon a time. "
+    "Remark: every kind of statement. "
+    "Define the record Vec with x number and y number. "
+    "The color is a Vec with x 1 and y 0.5. "
+    "Squad has members [\"Alice\", \"Bob\"]. "
+    "The hero has strength of 5 and magic of 2. "
+    "Define the function Rest as "
+    "If hero is tired then Tell \"Zzz\". Else if hero is brave then Display \"Onward\". Else Return. End. "
+    "Endfunction. "
+    "While strength is greater than 0. Strength subtract 1 equals strength. Endwhile. "
+    "For each companion in squad do Tell \"Hello\". Endfor. "
+    "Create image canvas with width 2 and height 2. "
+    "For each y from 0 to 2 do Paint canvas at 0 y with color x, color y, 0. Endfor. "
+    "Fill image canvas with 0, 0, 1. "
+    "Paint rectangle on canvas from 0 0 to 1 1 with 1, 1, 1. "
+    "Save image canvas to \"output/cached.ppm\". "
+    "Random fate leans towards kind or cruel. "
+    "Choose \"Which path?\". "
+    "Call Rest. "
+    "The hero rests. "
+    "The story ends.";
+
+std::filesystem::path writeTemporaryScript(const std::string& name, const std::string& content) {
+    auto path = std::filesystem::temp_directory_path() / name;
+    std::ofstream output(path, std::ios::binary);
+    output << content;
+    return path;
+}
+
+}
+
+TEST(StoryCacheTest, RoundTripCompilesIdenticallyTest) {
+    auto parsed = parseStory(cachedScript);
+    std::string image = serializeStory(*parsed, cachedScript);
+
+    auto loaded = deserializeStory(image, cachedScript);
+    ASSERT_NE(loaded, nullptr);
+    ASSERT_EQ(loaded->statements.size(), parsed->statements.size());
+    for (size_t i = 0; i < parsed->statements.size(); ++i) {
+        EXPECT_EQ(loaded->statements[i]->kind, parsed->statements[i]->kind);
+    }
+    EXPECT_EQ(compileStory(*loaded), compileStory(cachedScript));
+}
+
+TEST(StoryCacheTest, RejectsStaleOrDamagedImagesTest) {
+    std::string image = serializeStory(*parseStory(cachedScript), cachedScript);
+
+    EXPECT_EQ(deserializeStory(image, cachedScript + " "), nullptr);
+    EXPECT_EQ(deserializeStory(image.substr(0, 16), cachedScript), nullptr);
+    EXPECT_THROW(deserializeStory(image.substr(0, image.size() - 1), cachedScript), std::runtime_error);
+
+    std::string otherFormat = image;
+    otherFormat[4] = static_cast<char>(otherFormat[4] ^ 1);
+    EXPECT_EQ(deserializeStory(otherFormat, cachedScript), nullptr);
+
+    std::string damaged = image;
+    damaged[48] = static_cast<char>(0xff);
+    damaged[49] = static_cast<char>(0xff);
+    EXPECT_THROW(deserializeStory(damaged, cachedScript), std::runtime_error);
+}
+
+TEST(StoryCacheTest, RejectsImagesOfOtherScriptsOfTheSameLengthTest) {
+    std::string image = serializeStory(*parseStory(cachedScript), cachedScript);
+
+    std::string swapped = cachedScript;
+    std::swap_ranges(swapped.begin() + 16, swapped.begin() + 24, swapped.begin() + 40);
+    std::string renamed = cachedScript;
+    renamed.replace(renamed.find("Alice"), 5, "Alica");
+    for (const std::string& other : {swapped, renamed}) {
+        ASSERT_EQ(other.size(), cachedScript.size());
+        EXPECT_EQ(deserializeStory(image, other), nullptr);
+    }
+
+    auto scriptPath = writeTemporaryScript("ouat_story_cache_other.ouat", cachedScript);
+    std::filesystem::remove(storyCachePath(scriptPath));
+    ASSERT_TRUE(saveCachedStory(scriptPath, cachedScript, *parseStory(cachedScript)));
+    EXPECT_EQ(loadCachedStory(scriptPath, renamed), nullptr);
+    EXPECT_NE(loadCachedStory(scriptPath, cachedScript), nullptr);
+    std::filesystem::remove(storyCachePath(scriptPath));
+    std::filesystem::remove(scriptPath);
+}
+
+TEST(StoryCacheTest, CacheFileIsReusedUntilTheScriptChangesTest) {
+    auto scriptPath = writeTemporaryScript("ouat_story_cache.ouat", cachedScript);
+    auto cachePath = storyCachePath(scriptPath);
+    std::filesystem::remove(cachePath);
+
+    EXPECT_EQ(loadCachedStory(scriptPath, cachedScript), nullptr);
+    ASSERT_TRUE(saveCachedStory(scriptPath, cachedScript, *parseStory(cachedScript)));
+    EXPECT_TRUE(std::filesystem::exists(cachePath));
+
+    auto loaded = loadCachedStory(scriptPath, cachedScript);
+    ASSERT_NE(loaded, nullptr);
+    EXPECT_NE(loaded->backing, nullptr);
+    EXPECT_EQ(compileStory(*loaded), compileStory(cachedScript));
+
+    std::string edited = cachedScript;
+    edited.replace(edited.find("The hero rests"), 14, "The hero wakes");
+    EXPECT_EQ(loadCachedStory(scriptPath, edited), nullptr);
+
+    std::filesystem::remove(cachePath);
+    std::filesystem::remove(scriptPath);
+}
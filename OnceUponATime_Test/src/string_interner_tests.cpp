@@ -0,0 +1,44 @@
+// string_interner_tests.cpp
+
+#include "pch.h"
+
+#include "string_interner.h"
+#include <string>
+
+TEST(StringInternerTest, AssignsDenseIdsInOrderTest) {
+    StringInterner interner;
+    EXPECT_EQ(interner.intern("hero"), KNOWN_WORD_COUNT);
+    EXPECT_EQ(interner.intern("dragon"), KNOWN_WORD_COUNT + 1);
+    EXPECT_EQ(interner.intern("hero"), KNOWN_WORD_COUNT);
+    EXPECT_EQ(interner.size(), KNOWN_WORD_COUNT + 2);
+    EXPECT_EQ(interner.text(KNOWN_WORD_COUNT + 1), "dragon");
+}
+
+TEST(StringInternerTest, KnownWordsArePreseededTest) {
+    StringInterner interner;
+    EXPECT_EQ(interner.internFolded("With"), WORD_WITH);
+    EXPECT_EQ(interner.internFolded("RECORD"), WORD_RECORD);
+    EXPECT_EQ(interner.text(WORD_THE), "the");
+    EXPECT_EQ(StringInterner::knownWord("And"), WORD_AND);
+    EXPECT_EQ(StringInterner::knownWord("hero"), noSymbol);
+}
+
+TEST(StringInternerTest, FoldedWordsShareIdsTest) {
+    StringInterner interner;
+    SymbolId lower = interner.internFolded("castle");
+    EXPECT_EQ(interner.internFolded("Castle"), lower);
+    EXPECT_EQ(interner.internFolded("CASTLE"), lower);
+    EXPECT_NE(interner.intern("Castle"), lower);
+    EXPECT_EQ(interner.text(lower), "castle");
+}
+
+TEST(StringInternerTest, TextSurvivesGrowthTest) {
+    StringInterner interner;
+    SymbolId first = interner.intern("once upon a time");
+    std::string_view text = interner.text(first);
+    for (int i = 0; i < 10000; ++i) {
+        interner.intern("word" + std::to_string(i));
+    }
+    EXPECT_EQ(text.data(), interner.text(first).data());
+    EXPECT_EQ(interner.intern("once upon a time"), first);
+}
@@ -0,0 +1,66 @@
+// token_stream_tests.cpp
+
+#include "pch.h"
+
+#include "lexer.h"
+#include "token_stream.h"
+#include <string>
+#include <vector>
+
+TEST(TokenStreamTest, PositionsMatchLexerTest) {
+    std::string source = "Once upon a time.\n  x is \"two\nlines\". y is 3.5.\n\n# done\n";
+    auto tokens = Lexer(source).tokenize();
+    TokenStream stream = Lexer(source).tokenizeStream();
+    ASSERT_EQ(stream.size(), tokens.size());
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        EXPECT_EQ(stream.type(i), tokens[i].type);
+        EXPECT_EQ(stream.lexeme(i).data(), tokens[i].lexeme.data());
+        EXPECT_EQ(stream.line(i), tokens[i].line);
+        EXPECT_EQ(stream.column(i), tokens[i].column);
+        EXPECT_EQ(stream.word(i), tokens[i].word);
+    }
+}
+
+TEST(TokenStreamTest, NumbersAreKeptOutOfLineTest) {
+    std::string source = "1 then 2.5 then 3";
+    TokenStream stream = Lexer(source).tokenizeStream();
+    ASSERT_EQ(stream.size(), 6);
+    EXPECT_EQ(stream.number(0).integer, 1);
+    EXPECT_DOUBLE_EQ(stream.number(2).real, 2.5);
+    EXPECT_EQ(stream.word(2), noSymbol);
+
+    stream.discardFront(3);
+    ASSERT_EQ(stream.size(), 3);
+    EXPECT_EQ(stream.lexeme(1), "3");
+    EXPECT_EQ(stream.number(1).integer, 3);
+    EXPECT_EQ(stream.at(1).integer, 3);
+}
+
+TEST(TokenStreamTest, ConvertedTokensKeepExplicitPositionsTest) {
+    std::vector<Token> tokens = {
+        {TokenType::IDENTIFIER, "hero", 4, 7},
+        {TokenType::PERIOD, ".", 4, 11},
+        {TokenType::END_OF_FILE, "", 5, 1}
+    };
+    TokenStream stream(tokens);
+    ASSERT_EQ(stream.size(), 3);
+    EXPECT_EQ(stream.lexeme(0), "hero");
+    EXPECT_EQ(stream.line(1), 4);
+    EXPECT_EQ(stream.column(1), 11);
+    EXPECT_EQ(stream.at(0).type, TokenType::IDENTIFIER);
+}
+
+TEST(TokenStreamTest, SpansViewTheStreamWithoutCopyingTest) {
+    std::string source = "hero has sword and shield.";
+    TokenStream stream = Lexer(source).tokenizeStream();
+    TokenSpan sentence(stream, 1, 5);
+    ASSERT_EQ(sentence.size(), 4);
+    EXPECT_EQ(sentence.lexeme(0), "has");
+    EXPECT_EQ(sentence.lexeme(3).data(), stream.lexeme(4).data());
+    EXPECT_EQ(sentence.word(1), stream.word(2));
+
+    TokenSpan tail = sentence.subspan(3, 10);
+    ASSERT_EQ(tail.size(), 1);
+    EXPECT_EQ(tail.lexeme(0), "shield");
+    EXPECT_TRUE(sentence.subspan(4, 2).empty());
+}